@@ -1,5 +1,13 @@
 #include "typedef.h"
 #include "sensor.h"
+#include "speed.h"
+#include "decimate.h"
+#include "derived.h"
+#include "freq.h"
+#include "calstore.h"
+#include "telemetry.h"
+#include "capture.h"
+#include "sweep.h"
 #define FIRMWARE_VER 0x0100
 
 //this macro is used to "calibrate" the count down timer against the scope while servicing the protocol polling loop
@@ -15,70 +23,229 @@
 #define PULSES_REV 10
 //this is the gain for ADC counts to force in NM. 1023 = full scale ADC. Example if 10NM full scale = 0.0999nm/V =  0.00978/cnt
 #define _10NM_FULLSCALE 0.00978
+//speed input pin, must support an external interrupt (pin 2 or 3 on UNO)
+#define SPEED_PIN 2
+//number of pulse periods averaged for the speed calculation
+#define SPEED_PERIODS 8
+//the UNO's 2KB of RAM holds the dyno core: torque, speed, power, the sweep, telemetry and the calibration store. The
+//voltage and 10Hz load channels (about 600 bytes) and the burst capture do not fit next to it, they are only built on boards
+//with more RAM (Mega) and in the host simulation. SMALL_RAM is set for 2KB parts in typedef.h, see README (RAM)
+//rate the telemetry channels are sent at, channels of the telemetry port (4 or 5 values, 3 sweep curve channels)
+#define TLM_RATE _10Hz_Rate
+#if SMALL_RAM
+#define TLM_CHANNELS 7
+#else
+#define TLM_CHANNELS 8
+#endif
+//burst capture buffer in bytes (4.5 bytes per record with torque and rpm, 910 records = 0.9s at 1kHz)
+#define CAPTURE_BYTES 4096
+//burst capture trigger level on the load cell (counts), for the 'a' (arm) command
+#define CAPTURE_TRIGGER 700
+//rpm counts are shifted into the 12 bit capture fields, 2RPM per captured count (8190RPM full scale)
+#define CAPTURE_RPM_SHIFT 2
+//inertia of the rotor (flywheel, brake and shaft) in kg*m^2, for inertia sweeps
+#define ROTOR_INERTIA 0.05
+//number of speed edges in the sweep acceleration fit
+#define SWEEP_EDGES 8
+//rate of the sweep curve output
+#define SWEEP_RATE _100Hz_Rate
+//speed resolution, 0.5RPM per count (32767RPM full scale)
+#define RPM_SLOPE 0.5
+//power resolution, 0.1W per count (6553W full scale)
+#define POWER_SLOPE 0.1
 
 
 //SENSORS DEFINITION *******************************************************************************************************************************************************************
 //
-//WE CREATE A NEW SENSOR HERE  "sensor type", "units",     pin#,       slope,     			    offset,             #samples to avg,  #samples dt,  #samples it,    acquisiton rate   
+//WE CREATE A NEW SENSOR HERE  "sensor type", "units",     pin#,       slope,     			    offset,             acquisiton rate   
 //
-NEW_SENSOR voltagePin0      =   {"Voltage" ,     "Volts",       PIN_0,       DEFAULT_5V_SLOPE,        0.0,                10,              1,            1,            _100Hz_Rate};
-NEW_SENSOR load             =   {"Load" ,        "Nm",          PIN_0,       _10NM_FULLSCALE,                       0.0,                10,              1,            1,            _100Hz_Rate};
+NEW_SENSOR load             =   {"Load" ,        "Nm",          PIN_0,       _10NM_FULLSCALE,         0.0,                _1000Hz_Rate};
+#if !SMALL_RAM
+NEW_SENSOR voltagePin0      =   {"Voltage" ,     "Volts",       PIN_0,       DEFAULT_5V_SLOPE,        0.0,                _100Hz_Rate};
+NEW_SENSOR load10Hz         =   {"Load" ,        "Nm",          PIN_0,       _10NM_FULLSCALE,         0.0,                _10Hz_Rate};
+#endif
+NEW_SENSOR speedRpm         =   {"Speed" ,       "RPM",         PIN_NONE,    RPM_SLOPE,               0.0,                _100Hz_Rate};
+NEW_SENSOR powerCalc        =   {"Power" ,       "Watts",       PIN_NONE,    POWER_SLOPE,             0.0,                _100Hz_Rate};
 
 //
 //INFORM LIBRARY: WE TELL THE SENSOR LIBRARY ABOUT OUR NEW SENSORS HERE
+//              <#samples to avg, #samples dt, #samples it, optional features (FIFO_TIMED, FIFO_LSQ, FIFO_SUMSQ, SENSOR_CACHED)>
+//features cost RAM in every sensor that has them, none of the sensors here needs more than FIFO_TIMED
 //
-cSensor LoadVolts(&voltagePin0);
-cSensor LoadTorque(&load);
+//the pin is read once at 1kHz, the slower sensors on the pin are decimated (anti-aliased) from it: 1kHz -> 100Hz -> 10Hz
+cSensor<10, 1, 1>      LoadTorque(&load);
+#if !SMALL_RAM
+cDecimSensor<10, 1, 1> LoadVolts(&voltagePin0, &LoadTorque);
+cDecimSensor<10, 1, 1> LoadTorque10Hz(&load10Hz, &LoadVolts);
+#endif
+
+//speed input, edges timestamped by interrupt
+cSpeed  Speed(SPEED_PIN, PULSES_REV, SPEED_PERIODS, SPEED_TIMEOUT_DEFAULT);
+
+//shaft speed from the edge timestamps, filtered and differentiated (RPM/sec) like the analog channels. Timed, so the
+//acceleration holds when the scan runs late (serial output)
+cFreqSensor<10, 1, 1, FIFO_TIMED> Rpm(&speedRpm, &Speed, FREQ_SPEED);
+
+//power, derived from the torque and the speed, computed by the scheduler right after they are read
+float powerWatts(const float *in, UINT8 n, void *ctx);
+cDerivedSensor<10, 1, 1> Power(&powerCalc, powerWatts);
+
+//binary telemetry output, decode with host/tlmdecode (tlm_decode prints the serial plotter text)
+cTelemetry<TLM_CHANNELS> Telemetry;
+
+#if !SMALL_RAM
+//burst capture of raw load and rpm counts at 1kHz for sweeps, dumped over telemetry afterwards (tlm_decode -x)
+cCapture<CAPTURE_BYTES> Capture(_1000Hz_Rate, &Telemetry);
+#endif
+
+//inertia sweep, power/torque vs rpm from the acceleration of the rotor plus the brake torque
+cSweep  Sweep(&Speed, &LoadTorque, ROTOR_INERTIA, SWEEP_EDGES, SWEEP_RATE);
 
 
 
 //globals
-UINT32 mSecs, mSecsNow, mSecsPrev,ontime,offtime;
-float sensor,freq,period,rpm,power,torque;
+UINT32 mSecs, mSecsNow, mSecsPrev;
+float sensor,freq;
 UINT8 _1HzCtr;
 bool tLED;
+//first telemetry channel of the sweep curve (rpm, torque, power)
+UINT8 sweepChan;
 
 
 
-void measureFreq(UINT8 pinNum)
+void measureFreq()
 {
-   ontime = pulseIn(pinNum,HIGH);
-   offtime = pulseIn(pinNum,LOW);
-   period = ontime+offtime;
-   freq = 1000000.0/period;
+   //non blocking, computed from the edge timestamps captured by the speed ISR
+   freq = Speed.getFreq();
 }
 
-void calcRPM()
+/**
+ * derived power channel, torque (Nm) * speed (RPM) / 9.5488 = Watts
+ */
+float powerWatts(const float *in, UINT8 n, void *ctx)
 {
-    if(PULSES_REV)
-        rpm =(freq/PULSES_REV)*60; 
+    (void)ctx;
+
+    return( n >= 2 ? in[0] * in[1] / 9.5488 : 0.0 );
 }
 
 
-void calcPowerWatts()
+/**
+ * start/stop the inertia sweep, the curve channels are only sent while it runs
+ */
+void runSweep(bool run)
 {
-    torque = LoadTorque.getReading(false);
-    power =  (torque * rpm) / 9.5488;
+    ACQ_RATE rate = run ? SWEEP_RATE : NONE;
+    UINT8    ch;
+
+    if (run)
+    {
+        Sweep.start();
+    }
+    else
+    {
+        Sweep.stop();
+    }
+    for (ch = sweepChan; ch < sweepChan + 3; ch++)
+    {
+        Telemetry.setRate(ch, rate);
+    }
 }
 
+/**
+ * zero the load cell at the present (10Hz filtered, or 1kHz moving average on SMALL_RAM) reading keeping the span (slope),
+ * the calibration is saved to EEPROM
+ */
+void zeroLoad()
+{
+#if SMALL_RAM
+    UINT16 zero = (LoadTorque.getReading(true) - LoadTorque.getOffset()) / LoadTorque.getSlope() + 0.5;
+#else
+    UINT16 zero = LoadTorque10Hz.getCounts();
+#endif
+    float  span = LoadTorque.getSlope() * (CAL_X2_DEFAULT - zero);
 
+    LoadTorque.setX1Y1(zero, 0.0);
+    LoadTorque.setX2Y2(CAL_X2_DEFAULT, span);
+#if !SMALL_RAM
+    LoadTorque10Hz.setX1Y1(zero, 0.0);
+    LoadTorque10Hz.setX2Y2(CAL_X2_DEFAULT, span);
+#endif
+}
+
+/**
+ * single character serial commands: s = start capture, a = arm capture (load trigger), x = stop capture, d = dump capture
+ * (not on SMALL_RAM), w = start sweep, e = end sweep, z = zero load, p = send scheduler profile (ACQ_PROFILE builds,
+ * tlm_decode -p)
+ */
+void doCommand(int cmd)
+{
+    switch (cmd)
+    {
+#if !SMALL_RAM
+    case 's': Capture.start();                               break;
+    case 'a': Capture.arm(&LoadTorque, CAPTURE_TRIGGER, true); break;
+    case 'x': Capture.stop();                                break;
+    case 'd': Capture.dump();                                break;
+#endif
+    case 'w': runSweep(true);                                break;
+    case 'e': runSweep(false);                               break;
+    case 'z': zeroLoad();                                    break;
+    case 'p': Telemetry.sendProfile();                       break;
+    }
+}
 
 void setup() 
 {
 
     //led output for  debug
     pinMode(13, OUTPUT);    
-    //set pin7 as our digital input
-    pinMode(7, INPUT);  
+    //set speed pin as our digital input, attach edge timestamp interrupt
+    Speed.begin();
     //use a digital output to simulate RPM, 490Hz %50 duty
     pinMode(9, OUTPUT);  
 
     
-    Serial.begin(9600);
+    Serial.begin(TLM_BAUD);
     Serial.flush();
 
+    //telemetry channels, same order as the serial plotter columns: volts (not on SMALL_RAM), torque, freq, rpm, power
+#if !SMALL_RAM
+    Telemetry.addSensor(&LoadVolts, TLM_READING, TLM_RATE);
+#endif
+    Telemetry.addSensor(&LoadTorque, TLM_READING, TLM_RATE);
+    Telemetry.addValue(&freq, TLM_RATE);
+    Telemetry.addSensor(&Rpm, TLM_READING, TLM_RATE);
+    Telemetry.addSensor(&Power, TLM_READING, TLM_RATE);
+
+    //sweep curve channels, enabled by the 'w' command
+    sweepChan = Telemetry.addValue(&Sweep.getPoint()->rpm, NONE);
+    Telemetry.addValue(&Sweep.getPoint()->torque, NONE);
+    Telemetry.addValue(&Sweep.getPoint()->power, NONE);
+
+    //power inputs
+    Power.addInput(&LoadTorque);
+    Power.addInput(&Rpm);
+
+#if !SMALL_RAM
+    //burst capture channels
+    Capture.addSensor(&LoadTorque);
+    Capture.addSensor(&Rpm, CAPTURE_RPM_SHIFT);
+#endif
+
+    //restore the calibration saved in EEPROM (the order of the sensors is the record order, append only)
+    cCalStore::addSensor(&LoadTorque);
+#if !SMALL_RAM
+    cCalStore::addSensor(&LoadVolts);
+    cCalStore::addSensor(&LoadTorque10Hz);
+#endif
+    cCalStore::begin();
+
     //use 1.1V ADC reference
     //analogReference(INTERNAL);    
+
+    //free running ADC, sensors consume the latest sample block instead of converting inline
+    scanAdcStart(DEFAULT);
    
 
  }
@@ -93,8 +260,23 @@ void loop()
     //simulate output
     analogWrite(9, 128);
     
-    //measure frequency input on pin 7
-    measureFreq(7);
+    //measure frequency input on speed pin
+    measureFreq();
+
+    //send telemetry channels that are due, capture dump frames as room allows
+    Telemetry.run();
+#if !SMALL_RAM
+    Capture.run();
+#endif
+
+    //calibration saves, written to EEPROM in the background
+    cCalStore::run();
+
+    //commands
+    if (Serial.available())
+    {
+        doCommand(Serial.read());
+    }
     
     //poll for num mSecs elapsed (50day rollover)
     mSecsNow = millis();
@@ -112,21 +294,6 @@ void loop()
         _1HzCtr+=1;
         if (_1HzCtr == 99)
         {
-          //must call in this order, RPM then power
-          calcRPM();
-          calcPowerWatts();
-
-          //print in this style to use serial plotter
-          Serial.print(LoadVolts.getReading(false));
-          Serial.print(" ");
-          Serial.print(torque);
-          Serial.print(" ");
-          Serial.print(freq);
-          Serial.print(" ");
-          Serial.print(rpm);
-          Serial.print(" ");
-          Serial.println(power); 
-            
            //flash status LED to indicate alive
           tLED = !tLED? 100 : 0;
           digitalWrite(13, tLED);
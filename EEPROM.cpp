@@ -21,6 +21,10 @@
  * Includes
  ******************************************************************************/
 
+#if defined(HOST_BUILD)
+//simulated EEPROM (host/simhal), same API as avr/eeprom.h
+#include "typedef.h"
+#else
 #include <avr/eeprom.h>
 
 #if  ARDUINO >= 100
@@ -29,6 +33,7 @@
 #else
 #include "WConstants.h"
 #endif
+#endif
 
 
 #include "EEPROM.h"
@@ -37,6 +42,9 @@
  * Definitions
  ******************************************************************************/
 
+//EEPROM address as the pointer avr-libc expects (int and pointers differ in size on the host)
+#define EE_ADDR(address) ((unsigned char *)(uintptr_t)(address))
+
 /******************************************************************************
  * Constructors
  ******************************************************************************/
@@ -47,12 +55,12 @@
 
 uint8_t EEPROMClass::read(int address)
     {
-    return eeprom_read_byte((unsigned char *) address);
+    return eeprom_read_byte(EE_ADDR(address));
     }
 
 void EEPROMClass::write(int address, uint8_t value)
     {
-    eeprom_write_byte((unsigned char *) address, value);
+    eeprom_write_byte(EE_ADDR(address), value);
     }
 //this function overloads for reading and writing floats, structs used to avoid type conversion issues with floats
 float EEPROMClass::readFloat(int address)
@@ -70,7 +78,7 @@ float EEPROMClass::readFloat(int address)
 
     for (i=0; i<sizeof(float); i++)
         {
-        U.b[i] = eeprom_read_byte ((unsigned char *)(address+x--)); 
+        U.b[i] = eeprom_read_byte (EE_ADDR(address+x--)); 
         }
     
     return(U.fl);
@@ -96,8 +104,44 @@ void EEPROMClass::writeFloat(int address, float f)
     //write
     for (i=0; i<sizeof(float); i++)
         {
-       eeprom_write_byte((unsigned char *)(address+i), U.b[x--]);
+       eeprom_write_byte(EE_ADDR(address+i), U.b[x--]);
+        }
+    }
+
+//read-compare-write, the byte is only written (3.3mS and a write cycle of wear) if it changed. Returns true if written
+bool EEPROMClass::update(int address, uint8_t value)
+    {
+    if (eeprom_read_byte(EE_ADDR(address)) == value)
+        {
+        return(false);
+        }
+    eeprom_write_byte(EE_ADDR(address), value);
+    return(true);
+    }
+
+//bulk read, one call for a whole record (e.g. at startup)
+void EEPROMClass::readBlock(int address, void *dest, int len)
+    {
+    eeprom_read_block(dest, EE_ADDR(address), len);
+    }
+
+//read-compare-write of a block, only the bytes that changed are written. Returns the number of bytes written
+int EEPROMClass::updateBlock(int address, const void *src, int len)
+    {
+    const uint8_t *p = (const uint8_t *) src;
+    int i, written = 0;
+
+    for (i = 0; i < len; i++)
+        {
+        written += update(address + i, p[i]);
         }
+    return(written);
+    }
+
+//true if no write is in progress, the next read or write will not wait
+bool EEPROMClass::isReady()
+    {
+    return(eeprom_is_ready());
     }
 
 EEPROMClass EEPROM;
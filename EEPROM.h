@@ -29,6 +29,10 @@ public:
     float readFloat(int);
     void write(int, uint8_t);
     void writeFloat(int address, float f);
+    bool update(int, uint8_t);
+    void readBlock(int address, void *dest, int len);
+    int  updateBlock(int address, const void *src, int len);
+    bool isReady();
 
     };
 
@@ -40,7 +44,7 @@ extern EEPROMClass EEPROM;
 
 #define READ_EE_FLOAT(addr) (float)((EEPROM.read(addr) << 24) | (EEPROM.read(addr+1) << 16) |  (EEPROM.read(addr+2) << 8) | (EEPROM.read(addr+3)));
 
-#define WRITE_EE_FLOAT(addr,ptr)    EEPROM.write(addr+3,  ptr++); \ 
+#define WRITE_EE_FLOAT(addr,ptr)    EEPROM.write(addr+3,  ptr++); \
                                     EEPROM.write(addr+2,  ptr++); \
                                     EEPROM.write(addr+1,  ptr++); \
                                     EEPROM.write(addr,    ptr++)
@@ -48,6 +52,7 @@ extern EEPROMClass EEPROM;
 
 #define PROTO_BASE 0x0000
 #define DEV_BASE 0x0080
+#define CAL_BASE 0x0100
 
 //************ EEPROM MEMORY MAP *******************
 // PROTOCOL VARIABLES
@@ -61,5 +66,7 @@ extern EEPROMClass EEPROM;
 #define EEPROM_NODEID 			DEV_BASE
 #define EEPROM_SERIAL 			DEV_BASE + sizeof(UINT16)
 #define EEPROM_FIRMWARE 		EEPROM_SERIAL + sizeof(UINT16)
+// CALIBRATION STORE (see calstore.h), CAL_STORE_SLOTS wear leveled slots
+#define EEPROM_CAL_STORE        CAL_BASE
 #endif
 
@@ -1,28 +1,54 @@
 #include "FIFOMath.h"
 
+#if defined(HOST_BUILD) && defined(__SSE2__)
+//SIMD reductions for block updates on the host (offline reprocessing of recorded runs)
+#include <emmintrin.h>
+#endif
+
+//the reciprocal division requires divisors of 128 or less and sums of less than 2^24
+static_assert(MAX_FIFO_SIZE <= 128, "MAX_FIFO_SIZE must be 128 or less for the reciprocal division");
+
 /**
- * Constructor for FIFOMath class. Here we initialize the depths and indicies for average, derivative and math computaitons
+ * Constructor for FIFOMath class. Here we initialize the depths and indicies for average, derivative and math computaitons.
+ * The lengths are range checked at compile time (FIFO_STORAGE) along with sizing the storage.
  * 
+ * @param buffers   - storage for avgLength samples and the max/min deques
  * @param avgLength - Length in samples to be used for sum, average and max, min computations indexed into FifoArray[]. This must be less than MAX_FIFO_SIZE.
  * @param dtLength  - Length in samples to be used for deravitive computations indexed into FifoArray[]. This must be equal or less than avgLength.
  * @param itLength  - Length in samples to be used for integral computations indexed into FifoArray[]. This must  be equal or less than avgLength.
  */
-cFIFOMath::cFIFOMath(UINT8 avgLength, UINT8 dtLength, UINT8 itLength )
+cFIFOMathBase::cFIFOMathBase(FIFO_BUFFERS buffers, UINT8 avgLength, UINT8 dtLength, UINT8 itLength )
 {
-    //set default max buffer size, and requested length
-    maxLen = MAX_FIFO_SIZE; 
+    UINT8 i;
+
+    //set storage and requested length
+    FifoArray = buffers.data;
+    maxQ = buffers.maxQ;
+    minQ = buffers.minQ;
+    timed = buffers.time;
+    lsq   = buffers.lsq;
+    sumSq = buffers.sumSq;
 
-    //set buffer indicies
+    //set buffer indicies, dt/it can be set to 0 for "disable" of calculations
     depth = avgLength;
     dtDepth  = dtLength;
     itDepth  = itLength;
 
-    //clip and set default depth to 1 if not specified
-    depth = (depth > 0 && depth < maxLen+1) ? depth : 1 ;
+    //power of 2 depths wrap indicies by mask
+    mask = (depth & (depth - 1)) ? 0 : depth - 1;
 
-    //It,dt members can be set to 0 for "disable" of calcuations, must be clipped to "depth" since fifo data is shared
-    dtDepth  = ( dtDepth < depth+1) ? dtDepth : 0 ;
-    itDepth  = ( dtDepth < depth+1) ? itDepth : 0 ;
+    //clear storage, the dt/it tails read samples not yet pushed until the fifo has filled
+    for (i = 0; i < depth; i++)
+    {
+        FifoArray[i] = 0;
+        if (timed)
+        {
+            timed->dt[i] = 0;
+        }
+    }
+
+    //precompute the divisor for avg
+    setDivisor(&avgDiv, depth);
 
     //initialize members
     //"tail" always points to the very oldest sample
@@ -30,10 +56,21 @@ cFIFOMath::cFIFOMath(UINT8 avgLength, UINT8 dtLength, UINT8 itLength )
 
     //"head" always points to the very newest sample
     head = 0; 
+    updateCalls = 0;
+    updateSeq   = 0;
     sum  = 0;
+    if (sumSq)
+    {
+        *sumSq = 0;
+    }
     avg  = 0;
     max  = 0;
     min  = 0xFFFF;
+    maxFront = 0;
+    maxCnt   = 0;
+    minFront = 0;
+    minCnt   = 0;
+    resetLatched();
 
     //dt members, dtTail index is defined by tail index of buffer - (dtDepth - 1) for indexing. 
     //the dt/itTails points to the "nth" oldest sample
@@ -45,6 +82,331 @@ cFIFOMath::cFIFOMath(UINT8 avgLength, UINT8 dtLength, UINT8 itLength )
     sumIt  = 0;
     derivN = 0; 
     integN = 0;
+    if (timed)
+    {
+        timed->last      = 0;
+        timed->shift     = 0;
+        timed->dtTime    = 0;
+        timed->derivN    = 0;
+        timed->derivDiv  = 0;
+        timed->integN    = 0;
+        timed->integTime = 0;
+    }
+    dtMode = FIFO_DT_DIFF;
+    setDerivativeMode(FIFO_DT_DIFF);
+}
+
+/**
+ * Select the derivative computation. The least squares sums are rebuilt from the samples in the fifo, so the mode can be
+ * changed while running.
+ *
+ *    FIFO_DT_DIFF - derivN = newest - sample dtDepth before, derivDiv = dtDepth. Cheapest, but the noise of two samples.
+ *    FIFO_DT_LSQ  - slope of the least squares line through the last L = dtDepth samples, kept in O(1) per sample from the
+ *                   running sums S0 = sum(y) and S1 = sum(i * y) (i = 0 for the oldest):
+ *                       derivN = 2 * S1 - (L - 1) * S0,   derivDiv = L * (L^2 - 1) / 6
+ *                   When a sample enters (and the oldest leaves) the indicies of the others drop by one:
+ *                       S1 = S1 - (S0 - oldest) + (L - 1) * data,   S0 = S0 - oldest + data
+ *                   Less noisy than the difference (white noise is reduced by sqrt(L^3 / 12) rather than L / sqrt(2)).
+ *
+ * @param mode - derivative computation, FIFO_DT_LSQ needs the FIFO_LSQ feature and a dtDepth of 2 or more (otherwise the
+ *               difference is used)
+ * @return - the mode in effect, FIFO_DT_DIFF when FIFO_DT_LSQ is not available
+ */
+FIFO_DT_MODE cFIFOMathBase::setDerivativeMode(FIFO_DT_MODE mode)
+{
+    UINT8 i, pos;
+
+    mode = (mode == FIFO_DT_LSQ && lsq && dtDepth >= 2) ? FIFO_DT_LSQ : FIFO_DT_DIFF;
+
+    if (mode == FIFO_DT_DIFF)
+    {
+        //back from least squares, the difference of the last update
+        if (dtMode == FIFO_DT_LSQ)
+        {
+            derivN = lsq->diff;
+        }
+        dtMode   = FIFO_DT_DIFF;
+        derivDiv = dtDepth ? dtDepth : 1;
+        if (timed)
+        {
+            rebuildTimed();
+        }
+        return(dtMode);
+    }
+
+    //the difference of the last update, until it is kept by stepLsq
+    if (dtMode == FIFO_DT_DIFF)
+    {
+        lsq->diff = derivN;
+    }
+    dtMode = FIFO_DT_LSQ;
+
+    //L*(L^2 - 1) is the product of 3 consecutive integers, so divides by 6 exactly
+    derivDiv = ((UINT32)dtDepth * ((UINT32)dtDepth * dtDepth - 1)) / 6;
+
+    //rebuild the sums of the current window, the oldest sample of the window is at dtTail
+    lsq->sum    = 0;
+    lsq->moment = 0;
+    for (i = 0, pos = dtTail; i < dtDepth; i++, pos = wrap(pos + 1))
+    {
+        lsq->sum    += FifoArray[pos];
+        lsq->moment += (UINT32)i * FifoArray[pos];
+    }
+    derivN = (updateCalls >= dtDepth) ? lsqSlope() : 0;
+
+    if (timed)
+    {
+        rebuildTimed();
+    }
+    return(dtMode);
+}
+
+/**
+ * Rebuild the timed derivative for the derivative mode. The difference is over the span already kept (dtTime), the least
+ * squares sums are rebuilt from the current window. Times are relative to the newest sample, so the newest sample is at
+ * 0 and the others are at minus the sum of the times of the samples after them.
+ */
+void cFIFOMathBase::rebuildTimed()
+{
+    FIFO_TIME *T = timed;
+    UINT8  i, pos;
+    SINT64 t = 0;
+
+    if (dtMode == FIFO_DT_DIFF)
+    {
+        T->derivN   = (updateCalls >= dtDepth) ? derivN : 0;
+        T->derivDiv = (updateCalls >= dtDepth) ? T->dtTime : 0;
+        return;
+    }
+
+    T->lsqT  = 0;
+    T->lsqTT = 0;
+    T->lsqTY = 0;
+    for (i = dtDepth, pos = wrap(dtTail + dtDepth - 1); i; i--)
+    {
+        T->lsqT  += t;
+        T->lsqTT += t * t;
+        T->lsqTY += t * FifoArray[pos];
+        if (i > 1)
+        {
+            t -= T->dt[pos];
+        }
+        pos = pos ? pos - 1 : depth - 1;
+    }
+    T->lsqSpan = (UINT32)-t;
+
+    T->derivN   = (updateCalls >= dtDepth) ? (SINT64)dtDepth * T->lsqTY - T->lsqT * (SINT64)lsq->sum : 0;
+    T->derivDiv = (updateCalls >= dtDepth) ? (SINT64)dtDepth * T->lsqTT - T->lsqT * T->lsqT : 0;
+}
+
+/**
+ * wrap an index into the FIFO (or deques), valid for index < 2 * depth
+ *
+ * @param index  - index to wrap
+ * @return - index wrapped to 0 - (depth - 1)
+ */
+inline UINT8 cFIFOMathBase::wrap(UINT8 index)
+{
+    return( mask ? (index & mask) : (index >= depth ? index - depth : index) );
+}
+
+/**
+ * Precompute a divisor: a shift for powers of 2, otherwise a reciprocal m = ceil(2^(15+l) / div) with l = ceil(log2(div)),
+ * which gives an exact floor(y / div) = (y * m) >> (15 + l) for all y < 2^15 (Granlund & Montgomery).
+ * Called at construction, the only place a division is performed.
+ *
+ * @param D      - divisor to set up
+ * @param div    - divisor value, 0 (disabled) is treated as 1
+ */
+void cFIFOMathBase::setDivisor(FIFO_DIVISOR *D, UINT8 div)
+{
+    UINT8 l;
+
+    div = div ? div : 1;
+
+    //l = ceil(log2(div))
+    for (l = 0; (1U << l) < div; l++);
+
+    D->div = div;
+    if (div & (div - 1))
+    {
+        D->shift = 15 + l;
+        D->recip = (UINT16)(((1UL << D->shift) + div - 1) / div);
+    }
+    else
+    {
+        D->shift = l;
+        D->recip = 0;
+    }
+}
+
+/**
+ * Exact floor(num / div) for num < 2^24 without a runtime division. Power of 2 divisors are a shift, otherwise a
+ * long division one byte at a time: the partial dividend is always < div * 2^8 <= 2^15, so each byte of the quotient is an
+ * exact reciprocal multiply that fits 32 bits (div <= 128).
+ *
+ * @param num    - numerator, < 2^24 (MAX_FIFO_SIZE * 0xFFFF)
+ * @param D      - precomputed divisor
+ * @return - num / div, as integer division would
+ */
+inline UINT32 cFIFOMathBase::divide(UINT32 num, const FIFO_DIVISOR *D)
+{
+    UINT32 quot = 0;
+    UINT16 rem = 0, part, q;
+    UINT8  shift;
+
+    if (!D->recip)
+    {
+        return( num >> D->shift );
+    }
+
+    //3 bytes, most significant first
+    for (shift = 24; shift; )
+    {
+        shift -= 8;
+        part = (rem << 8) | ((num >> shift) & 0xFF);
+        q    = (UINT16)(((UINT32)part * D->recip) >> D->shift);
+        rem  = part - q * D->div;
+        quot = (quot << 8) | q;
+    }
+    return(quot);
+}
+
+/**
+ * step the least squares sums, a new sample enters the window and the oldest leaves (see setDerivativeMode)
+ *
+ * @param oldest - oldest sample of the window (dtDepth samples before data)
+ * @param data   - newest sample
+ */
+inline void cFIFOMathBase::stepLsq(UINT16 oldest, UINT16 data)
+{
+    lsq->diff    = (SINT32)data - oldest;
+    lsq->moment -= lsq->sum - oldest;
+    lsq->moment += (UINT32)(dtDepth - 1) * data;
+    lsq->sum    += (UINT32)data - oldest;
+}
+
+/**
+ * @return - least squares slope numerator 2 * S1 - (L - 1) * S0, fits 31 bits for L <= MAX_FIFO_SIZE
+ */
+inline SINT32 cFIFOMathBase::lsqSlope()
+{
+    return( (SINT32)(2 * lsq->moment) - (SINT32)((UINT32)(dtDepth - 1) * lsq->sum) );
+}
+
+/**
+ * Step the sums over the sample times of a timed fifo, a new sample enters the windows and the oldest leave, and the
+ * timed derivative of the new window. Exact 64 bit integer sums, O(1) per sample whatever the depths. All of the 64 bit
+ * math is here, an untimed fifo never runs it.
+ *
+ *    integral   - integN = sum(y * dt), integTime = sum(dt) over the itDepth newest samples (each sample held for
+ *                 the time since the previous one)
+ *    difference - dtTime = sum(dt) of the dtDepth newest samples, the time from the sample dtDepth before to the newest
+ *    LSQ        - sample times t relative to the newest sample. A new sample "delta" after the newest moves the whole
+ *                 window back by delta:
+ *                     S(t^2) += L * delta^2 - 2 * delta * S(t),   S(t) -= L * delta,   S(t * y) -= delta * S(y)
+ *                 then the oldest (at -(span + delta)) leaves and the new sample enters at t = 0, adding nothing. The
+ *                 slope is then (L * S(t * y) - S(t) * S(y)) / (L * S(t^2) - S(t)^2)
+ *
+ * @param data  - newest sample
+ * @param delta - time since the previous sample
+ */
+void cFIFOMathBase::stepTimed(UINT16 data, UINT16 delta)
+{
+    FIFO_TIME *T = timed;
+    SINT64 L = dtDepth, d = delta, t;
+    UINT16 oldest;
+
+    if (itDepth)
+    {
+        T->integN    += (UINT32)data * delta;
+        T->integTime += delta;
+        if (updateCalls >= itDepth)
+        {
+            T->integN    -= (UINT32)FifoArray[itTail] * T->dt[itTail];
+            T->integTime -= T->dt[itTail];
+        }
+    }
+
+    if (dtDepth)
+    {
+        oldest = FifoArray[dtTail];
+        T->dtTime += delta;
+        T->dtTime -= T->dt[dtTail];
+
+        //the least squares sums are before stepLsq, S(y) is still of the old window
+        if (dtMode == FIFO_DT_LSQ)
+        {
+            T->lsqTT += L * d * d - 2 * d * T->lsqT;
+            T->lsqT  -= L * d;
+            T->lsqTY -= d * (SINT64)lsq->sum;
+
+            t = -(SINT64)(T->lsqSpan + delta);
+            T->lsqT  -= t;
+            T->lsqTT -= t * t;
+            T->lsqTY -= t * oldest;
+
+            //the sample after the oldest is the new oldest
+            T->lsqSpan += (UINT32)delta - T->dt[wrap(dtTail + 1)];
+        }
+
+        //wait for appropriate # of samples accumulated for deriv, S(y) of the new window is S(y) + data - oldest
+        if (updateCalls >= dtDepth && dtMode == FIFO_DT_LSQ)
+        {
+            T->derivN   = L * T->lsqTY - T->lsqT * ((SINT64)lsq->sum + data - oldest);
+            T->derivDiv = L * T->lsqTT - T->lsqT * T->lsqT;
+        }
+        else if (updateCalls >= dtDepth)
+        {
+            T->derivN   = (SINT32)data - (SINT32)oldest;
+            T->derivDiv = T->dtTime;
+        }
+    }
+
+    T->dt[head] = delta;
+}
+
+/**
+ * Write a sample into the fifo at "pos" (the oldest sample) and step the windowed max/min deques.
+ *
+ * @param pos    - fifo index to write, must be the oldest sample (head)
+ * @param data   - new sample
+ */
+inline void cFIFOMathBase::pushMaxMin(UINT8 pos, UINT16 data)
+{
+    //windowed max/min, the oldest sample (about to be overwritten at pos) leaves the window. If it is still in a deque it is at the front
+    if (maxCnt && maxQ[maxFront] == pos)
+    {
+        maxFront = wrap(maxFront + 1);
+        maxCnt--;
+    }
+    if (minCnt && minQ[minFront] == pos)
+    {
+        minFront = wrap(minFront + 1);
+        minCnt--;
+    }
+
+    //pop samples off the back that can no longer be the max (min) while the new sample is in the window
+    while (maxCnt && FifoArray[maxQ[wrap(maxFront + maxCnt - 1)]] <= data)
+    {
+        maxCnt--;
+    }
+    while (minCnt && FifoArray[minQ[wrap(minFront + minCnt - 1)]] >= data)
+    {
+        minCnt--;
+    }
+
+    //insert new data into fifo
+    FifoArray[pos] = data;
+
+    //push the new sample, the deque fronts are the window max and min
+    maxQ[wrap(maxFront + maxCnt)] = pos;
+    maxCnt++;
+    minQ[wrap(minFront + minCnt)] = pos;
+    minCnt++;
+    max = FifoArray[maxQ[maxFront]];
+    min = FifoArray[minQ[minFront]];
+
 }
 
 /** 
@@ -52,27 +414,41 @@ cFIFOMath::cFIFOMath(UINT8 avgLength, UINT8 dtLength, UINT8 itLength )
  * integral, max and min data. Average, sum, max and min are based upon the same depth indexed into the fifo. 
  * Derivative and integral calcuations are based upon thier own depth indexed into the fifo.
  * Note that all computations are based upon U16 data and U32 results to optimize for speed and memory. It is assumed 
- * that floating point computations would be applied at the next layer up.
+ * that floating point computations would be applied at the next layer up. Once the FIFO is full there is no runtime division,
+ * the average divides by precomputed shift/reciprocal (see divide), the derivative division is left to the next layer up.
  *
+ * With FIFO_SUMSQ the sum of squares (sumSq) of the same samples is kept alongside the sum, for variance / RMS at the next layer up:
+ * 
+ *     variance = (N * sumSq - sum^2) / N^2
+ * 
  * Integer based integration and derivative calculations are performed. The floating point timescale can be applied 
  * at the next layer up
  * 
  * where:
  * 
- *     derivN = sample1 - sample2 / Nsamples
+ *     derivN / derivDiv = (newest sample - sample Nsamples before) / Nsamples, or the least squares slope (see setDerivativeMode)
  * 
- *     The floating point derivative is then calculated by  di/dt =  derivN / t (where t is units of seconds)
+ *     The floating point derivative is then calculated by  di/dt =  derivN / derivDiv / t (where t is units of seconds)
  * 
  *    integN  = (sample[0] + sample[1].......sample[N]) for Nsamples (a running FIFO sum over N samples without a timescale applied)
  * 
  *    The floating point integral is calculated by  It =  integN * t (where t is units of seconds)
  * 
+ *  The maximum and minimum are of the samples in the FIFO (sliding window of depth samples), kept by monotonic deques in amortized O(1):
+ *  each sample is pushed and popped at most once per deque.
  *  Note: The maximum and minimum values that are latched are that of the "data" (all samples unitl reset) and not necesarily what is in the FIFO
  * 
- * @param data - new data for entry into the fifo
+ *  A timed fifo also keeps the derivative and integral over the measured sample times (see stepTimed), the time unit
+ *  (tick) is up to the caller:
+ * 
+ *     derivN / derivDiv = slope in counts per tick,   integN = sum(sample * ticks since the previous sample)   (FIFO_TIME)
+ * 
+ * @param data  - new data for entry into the fifo
+ * @param delta - timed fifo only, time since the previous sample in ticks (ignored when not timed)
  */
-void cFIFOMath::update(UINT16 data)
+void cFIFOMathBase::update(UINT16 data, UINT16 delta)
 {
+    updateSeq++;
 
     //perform sum and average calculations 
     if (updateCalls >= depth)
@@ -80,7 +456,12 @@ void cFIFOMath::update(UINT16 data)
         //buffer is full of samples, pop tail off (head location now points at oldest sample)
         sum -= FifoArray[head];
         sum += data;
-        avg = (UINT16)(sum/depth);
+        if (sumSq)
+        {
+            *sumSq -= (UINT32)FifoArray[head] * FifoArray[head];
+            *sumSq += (UINT32)data * data;
+        }
+        avg = (UINT16)divide(sum, &avgDiv);
 
 
     } else
@@ -88,16 +469,31 @@ void cFIFOMath::update(UINT16 data)
         //the buffer is not yet full of samples, perform avg on samples collected so far
         updateCalls++;
         sum+=data;
+        if (sumSq)
+        {
+            *sumSq += (UINT32)data * data;
+        }
         avg = (UINT16)(sum/updateCalls);
     }
 
+    //sample times of a timed fifo, before the samples leaving the windows are overwritten
+    if (timed)
+    {
+        stepTimed(data, delta);
+    }
+
     //perform derivatve calculation 
     if (dtDepth)
     {
+        if (dtMode == FIFO_DT_LSQ)
+        {
+            stepLsq(FifoArray[dtTail], data);
+        }
+
         //wait for appropriate # of samples accumulated for deriv
         if (updateCalls >= dtDepth)
         {
-            derivN = (FifoArray[dtTail] - data) / dtDepth; 
+            derivN = (dtMode == FIFO_DT_LSQ) ? lsqSlope() : (SINT32)data - (SINT32)FifoArray[dtTail];
         }
     }
 
@@ -115,19 +511,279 @@ void cFIFOMath::update(UINT16 data)
         }
     }
 
-    //insert new data into fifo
-    FifoArray[head] = data;
+    //insert new data into fifo, windowed max/min
+    pushMaxMin(head, data);
 
     //update max/min values acquired (may not necessarily in the buffer any longer)
-    max = data > max ? data : max; 
-    min = data < min ? data : min; 
+    maxLatch = data > maxLatch ? data : maxLatch; 
+    minLatch = data < minLatch ? data : minLatch; 
 
     //update head & tail indicies
-    tail = (tail >= (depth - 1)) ? 0 : tail + 1;
-    head = (head >= (depth - 1)) ? 0 : head + 1; 
-    //dt
-    dtTail = (dtTail >= (depth - 1)) ? 0 : dtTail + 1;
-    //it
-    itTail = (itTail >= (depth - 1)) ? 0 : itTail + 1;
+    if (mask)
+    {
+        tail   = (tail + 1) & mask;
+        head   = (head + 1) & mask;
+        dtTail = (dtTail + 1) & mask;
+        itTail = (itTail + 1) & mask;
+    }
+    else
+    {
+        tail = (tail >= (depth - 1)) ? 0 : tail + 1;
+        head = (head >= (depth - 1)) ? 0 : head + 1; 
+        //dt
+        dtTail = (dtTail >= (depth - 1)) ? 0 : dtTail + 1;
+        //it
+        itTail = (itTail >= (depth - 1)) ? 0 : itTail + 1;
+    }
+
+}
+
+/**
+ * Sum of a block of samples. Plain loop on the target, SSE2 on the host.
+ */
+static UINT32 blockSum(const UINT16 *data, UINT16 n)
+{
+    UINT32 sum = 0;
+    UINT16 i = 0;
+
+#if defined(HOST_BUILD) && defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128(), acc = _mm_setzero_si128(), v;
+    UINT32  lane[4];
+
+    //8 samples at a time, widened to 32 bit lanes
+    for (; i + 8 <= n; i += 8)
+    {
+        v   = _mm_loadu_si128((const __m128i *)(data + i));
+        acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+        acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+    }
+    _mm_storeu_si128((__m128i *)lane, acc);
+    sum = lane[0] + lane[1] + lane[2] + lane[3];
+#endif
+
+    for (; i < n; i++)
+    {
+        sum += data[i];
+    }
+    return(sum);
+}
+
+/**
+ * Sum of "n" fifo samples starting at index "pos", wrapping at "depth" (at most one wrap)
+ */
+static UINT32 ringSum(const UINT16 *fifo, UINT8 depth, UINT8 pos, UINT16 n)
+{
+    UINT16 first = (n < (UINT16)(depth - pos)) ? n : depth - pos;
+
+    return( blockSum(fifo + pos, first) + blockSum(fifo, n - first) );
+}
+
+/**
+ * Sum of squares of a block of samples
+ */
+static UINT64 blockSumSq(const UINT16 *data, UINT16 n)
+{
+    UINT64 sum = 0;
+    UINT16 i;
+
+    for (i = 0; i < n; i++)
+    {
+        sum += (UINT32)data[i] * data[i];
+    }
+    return(sum);
+}
+
+/**
+ * Max and min of a block of samples, merged into *max and *min. Plain loop on the target, SSE2 on the host
+ * (SSE2 only has signed 16 bit max/min, so the samples are offset by 0x8000).
+ */
+static void blockMaxMin(const UINT16 *data, UINT16 n, UINT16 *max, UINT16 *min)
+{
+    UINT16 i = 0, hi = *max, lo = *min;
+
+#if defined(HOST_BUILD) && defined(__SSE2__)
+    __m128i bias = _mm_set1_epi16((short)0x8000), vmax, vmin, v;
+    UINT16  lane[8];
+    UINT8   j;
+
+    if (n >= 8)
+    {
+        vmax = _mm_set1_epi16((short)(hi ^ 0x8000));
+        vmin = _mm_set1_epi16((short)(lo ^ 0x8000));
+        for (; i + 8 <= n; i += 8)
+        {
+            v    = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(data + i)), bias);
+            vmax = _mm_max_epi16(vmax, v);
+            vmin = _mm_min_epi16(vmin, v);
+        }
+        _mm_storeu_si128((__m128i *)lane, _mm_xor_si128(vmax, bias));
+        for (j = 0; j < 8; j++)
+        {
+            hi = lane[j] > hi ? lane[j] : hi;
+        }
+        _mm_storeu_si128((__m128i *)lane, _mm_xor_si128(vmin, bias));
+        for (j = 0; j < 8; j++)
+        {
+            lo = lane[j] < lo ? lane[j] : lo;
+        }
+    }
+#endif
 
+    for (; i < n; i++)
+    {
+        hi = data[i] > hi ? data[i] : hi;
+        lo = data[i] < lo ? data[i] : lo;
+    }
+    *max = hi;
+    *min = lo;
+}
+
+/**
+ * Push a block of samples (e.g. an ADC burst or a recorded run) through the FIFO math in one pass. The results are exactly
+ * those of n calls to update(). The block is split where it wraps the fifo, for each contiguous chunk:
+ *
+ *    sum      += sum(chunk) - sum(samples overwritten)             (overwritten samples are 0 until the fifo is full)
+ *    sumSq    += the same with squares
+ *    sumIt    += sum(chunk) - sum(samples itDepth before each one)  (from the fifo, or earlier in the chunk)
+ *    derivN, integN and avg are evaluated once for the last sample, latched max/min are a block reduction,
+ *    only the windowed max/min deques (and the least squares sums) are stepped per sample.
+ *
+ * @param samples - block of new data for entry into the fifo, oldest first
+ * @param n       - number of samples in the block
+ */
+void cFIFOMathBase::updateBlock(const UINT16 *samples, UINT16 n)
+{
+    UINT16 len, i, calls;
+    UINT32 chunkSum;
+    UINT16 older, delta;
+
+    if (!n)
+    {
+        return;
+    }
+
+    //a block has no sample times, a timed fifo takes its samples one at a time spaced at the last measured time
+    if (timed)
+    {
+        delta = timed->dt[head ? head - 1 : depth - 1];
+        for (i = 0; i < n; i++)
+        {
+            update(samples[i], delta);
+        }
+        return;
+    }
+    updateSeq += n;
+
+    while (n)
+    {
+        //chunk up to the end of the fifo array
+        len = (n < (UINT16)(depth - head)) ? n : depth - head;
+        chunkSum = blockSum(samples, len);
+
+        //sum over depth, pop the samples about to be overwritten
+        sum += chunkSum - ringSum(FifoArray, depth, head, len);
+        if (sumSq)
+        {
+            *sumSq += blockSumSq(samples, len) - blockSumSq(FifoArray + head, len);
+        }
+
+        calls = updateCalls + len;
+        updateCalls = (calls < depth) ? calls : depth;
+
+        //derivative of the last sample, the sample dtDepth before it is in the chunk or still in the fifo
+        if (dtDepth && updateCalls >= dtDepth && dtMode == FIFO_DT_DIFF)
+        {
+            older  = (len > dtDepth) ? samples[len - 1 - dtDepth] : FifoArray[wrap(dtTail + len - 1)];
+            derivN = (SINT32)samples[len - 1] - (SINT32)older;
+        }
+
+        //integral, pop the samples itDepth before each new one (in the fifo for the first itDepth, then from the chunk)
+        if (itDepth)
+        {
+            sumIt += chunkSum - ringSum(FifoArray, depth, itTail, (len < itDepth) ? len : itDepth);
+            if (len > itDepth)
+            {
+                sumIt -= blockSum(samples, len - itDepth);
+            }
+            if (updateCalls >= itDepth)
+            {
+                integN = sumIt;
+            }
+        }
+
+        //latched max/min
+        blockMaxMin(samples, len, &maxLatch, &minLatch);
+
+        //insert into the fifo, windowed max/min. The least squares window leaves from the fifo, ahead of the write
+        for (i = 0; i < len; i++)
+        {
+            if (dtMode == FIFO_DT_LSQ)
+            {
+                stepLsq(FifoArray[wrap(dtTail + i)], samples[i]);
+            }
+            pushMaxMin(head + i, samples[i]);
+        }
+        if (dtMode == FIFO_DT_LSQ && updateCalls >= dtDepth)
+        {
+            derivN = lsqSlope();
+        }
+
+        //update head & tail indicies
+        head   = wrap(head + len);
+        tail   = wrap(tail + len);
+        dtTail = wrap(dtTail + len);
+        itTail = wrap(itTail + len);
+
+        samples += len;
+        n -= len;
+    }
+
+    //average of the last sample
+    avg = (UINT16)((updateCalls >= depth) ? divide(sum, &avgDiv) : sum / updateCalls);
+}
+
+/**
+ * @return - number of samples in sum / sumSq, "depth" once the fifo has filled
+ */
+UINT8 cFIFOMathBase::getSamples()
+{
+    return(updateCalls);
+}
+
+/**
+ * @return - number of samples summed in integN (itDepth), integN is 0 until that many samples have been pushed
+ */
+UINT8 cFIFOMathBase::getIntegralDepth()
+{
+    return(itDepth);
+}
+
+/**
+ * @return - sum of squares of the samples in sum (those not yet pushed are 0), the running sum with FIFO_SUMSQ, otherwise
+ *           summed from the fifo in O(depth)
+ */
+UINT64 cFIFOMathBase::getSumSq()
+{
+    if (sumSq)
+    {
+        return(*sumSq);
+    }
+    return(blockSumSq(FifoArray, depth));
+}
+
+/**
+ * @return - true if the fifo keeps the sample times (update is passed the time since the previous sample)
+ */
+bool cFIFOMathBase::isTimed()
+{
+    return(timed != NULL);
+}
+
+/**
+ * reset the latched max/min values (since reset statistic), the windowed max/min are not affected
+ */
+void cFIFOMathBase::resetLatched()
+{
+    maxLatch = 0;
+    minLatch = 0xFFFF;
 }
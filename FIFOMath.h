@@ -6,29 +6,154 @@
 #define MAX_FIFO_SIZE 100
 
 /**
- * The FIFOMath class is an object that can be used  to compute a moving sum, moving average, derivative
+ * Precomputed divisor used to replace runtime division in the update path (no hardware divide on AVR).
+ * Power of 2 divisors are a shift, all others an exact reciprocal multiply (see cFIFOMathBase::divide).
+ */
+struct FIFO_DIVISOR
+{
+  /**
+   * reciprocal multiplier, 0 for power of 2 divisors
+   */
+  UINT16  recip;
+  /**
+   * right shift applied to the reciprocal product, or log2(div) for power of 2 divisors
+   */
+  UINT8   shift;
+  /**
+   * divisor
+   */
+  UINT8   div;
+};
+
+/**
+ * Derivative computation
+ */
+enum FIFO_DT_MODE
+{
+  FIFO_DT_DIFF,   //difference over dtDepth samples (newest - dtDepth samples before), default
+  FIFO_DT_LSQ     //least squares slope of the last dtDepth samples (dtDepth of 2 or more)
+};
+
+/**
+ * Optional FIFO features, or'd into the Features template parameter of cFIFOMath (and of the sensor classes). The state
+ * of a feature is only allocated in the FIFOs that have it, a FIFO without any has the RAM footprint of the plain FIFO math.
+ */
+enum FIFO_FEATURES
+{
+  FIFO_TIMED = 0x01,  //time since the previous sample stored with each sample, derivative and integral over the measured times
+  FIFO_LSQ   = 0x02,  //least squares derivative mode (setDerivativeMode), running sums kept in O(1) per sample
+  FIFO_SUMSQ = 0x04   //running sum of squares for an O(1) variance / RMS, computed from the samples in O(depth) otherwise
+};
+
+/**
+ * Least squares running sums of the last dtDepth samples (FIFO_LSQ), sum(y) and sum(i * y) with i = 0 for the oldest
+ * sample (sized for the worst case of MAX_FIFO_SIZE samples: 4950 * 0xFFFF). The difference numerator is kept alongside,
+ * for switching back to FIFO_DT_DIFF (the sample dtDepth before may have been overwritten)
+ */
+struct FIFO_LSQ_SUMS
+{
+  UINT32  sum, moment;
+  SINT32  diff;
+};
+
+/**
+ * State of a timed FIFO, only allocated when the FIFO is timed (FIFO_TIME_STORAGE). The 64 bit sums are exact, see
+ * cFIFOMathBase::stepTimed. Times are in the ticks of the caller (see cFIFOMathBase::update).
+ */
+struct FIFO_TIME
+{
+  /**
+   * time of each sample since the previous one, "depth" entries
+   */
+  UINT16  *dt;
+  /**
+   * clock of the caller, time of the newest sample and tick (2^shift time units), kept here so that an untimed FIFO
+   * (or sensor) has no timing state at all
+   */
+  UINT32  last;
+  UINT8   shift;
+  /**
+   * sum of the times over the derivative window (the span of the difference). Least squares sums of the sample times
+   * relative to the newest sample sum(t), sum(t^2), sum(t * y) and the time from the oldest to the newest sample of the window
+   */
+  UINT32  dtTime, lsqSpan;
+  SINT64  lsqT, lsqTT, lsqTY;
+  /**
+   * derivative over the measured times, the slope in counts per tick is derivN / derivDiv (0 / 0 until the window has
+   * time in it). Integral sum(y * dt) in count ticks over integTime ticks
+   */
+  SINT64  derivN, derivDiv;
+  UINT64  integN;
+  UINT32  integTime;
+};
+
+/**
+ * Pointers to the FIFO storage owned by the derived class (see FIFO_STORAGE), passed into cFIFOMathBase on construction
+ */
+struct FIFO_BUFFERS
+{
+  /**
+   * sample storage, "depth" samples
+   */
+  UINT16  *data;
+  /**
+   * monotonic deques of sample indicies used for the windowed max and min, "depth" entries each
+   */
+  UINT8   *maxQ, *minQ;
+  /**
+   * sample times and sums of a timed FIFO (see FIFO_TIME), NULL when the FIFO is not timed
+   */
+  FIFO_TIME *time;
+  /**
+   * least squares sums (FIFO_LSQ) and running sum of squares (FIFO_SUMSQ), NULL without the feature
+   */
+  FIFO_LSQ_SUMS *lsq;
+  UINT64  *sumSq;
+};
+
+
+/**
+ * The FIFOMath base class is an object that can be used  to compute a moving sum, moving average, derivative
  * and integral calculations on a FIFO buffer of samples. These computaitons are not floating point based, and require
  * time and unit conversion by the "next layer up" (i.e. a derived class).
  * 
  * The buffer and computations are managed by the "update" method, which would typically be called at a periodic rate. 
+ * A timed FIFO (FIFO_BUFFERS::time set) is also passed the time since the previous sample with each sample, for a derivative
+ * and integral over the measured times when the updates are not evenly spaced.
+ * The FIFO storage itself is not part of the base class, it is sized at compile time by the cFIFOMath template (or
+ * a class holding a FIFO_STORAGE) and passed in on construction.
  *
+ * @see cFIFOMath
  * @author DJK
  * @version 0.1
  */
-class cFIFOMath
+class cFIFOMathBase
 {
 private:
     /**
-    array into which newest data is pushed, and oldest data is deleted
+    array into which newest data is pushed, and oldest data is deleted (storage of "depth" samples owned by the derived class)
    */
-  UINT16  FifoArray[MAX_FIFO_SIZE] ;
+  UINT16  *FifoArray;
   
   /**
   * depth = sample depths passed into constructor. Represents number of samples used for computaiotns 
   indicies for fifo, head tail, update calls 
   *
   */
-  UINT8   depth, head, tail, maxLen, updateCalls;
+  UINT8   depth, head, tail, updateCalls;
+  /**
+   * index wraparound mask (depth - 1) when depth is a power of 2, otherwise 0 and indicies are wrapped by compare
+   */
+  UINT8   mask;
+  /**
+   * monotonic deques (ring buffers of FifoArray indicies) for windowed max/min. Values along the max deque are decreasing,
+   * along the min deque increasing, so the front is always the max (min) of the samples in the FIFO
+   */
+  UINT8   *maxQ, *minQ;
+  /**
+   * deque front index and number of entries
+   */
+  UINT8   maxFront, maxCnt, minFront, minCnt;
   /**
    * depth = sample depths passed into constructor. Represents number of samples used for computaiotns 
   * dt indicies members used for derivative calculation
@@ -41,36 +166,193 @@ private:
   */
   UINT8   itDepth, itHead, itTail;
 
+  /**
+   * precomputed divisor for the average (depth)
+   */
+  FIFO_DIVISOR avgDiv;
+
+  /**
+   * derivative mode, least squares sums (NULL without FIFO_LSQ, the mode is then always FIFO_DT_DIFF)
+   */
+  FIFO_DT_MODE  dtMode;
+  FIFO_LSQ_SUMS *lsq;
+  /**
+   * running sum of squares over the same samples as sum, for variance and RMS (NULL without FIFO_SUMSQ, see getSumSq).
+   * MAX_FIFO_SIZE * 0xFFFF^2 needs 39 bits
+   */
+  UINT64        *sumSq;
+
+  UINT8         wrap(UINT8 index);
+  void          stepLsq(UINT16 older, UINT16 data);
+  void          stepTimed(UINT16 data, UINT16 delta);
+  void          rebuildTimed();
+  SINT32        lsqSlope();
+  void          pushMaxMin(UINT8 pos, UINT16 data);
+  static void   setDivisor(FIFO_DIVISOR *D, UINT8 div);
+  static UINT32 divide(UINT32 num, const FIFO_DIVISOR *D);
+
 public:
+  /**
+   * feed samples, one at a time or a block (e.g. a recorded run being reprocessed), a block gives the results of n update calls
+   */
+  void update(UINT16 data, UINT16 delta = 0);
+  void updateBlock(const UINT16 *samples, UINT16 n);
+
+protected:
   
   /**
-   * Class constructor, pass in FIFO lengths for computaiton.
+   * Class constructor, pass in FIFO storage and lengths for computaiton. Lengths are checked at compile time by FIFO_STORAGE.
    * 
+   * @param buffers
    * @param avgLength
    * @param dtLength
    * @param itLength
    */
-  cFIFOMath(UINT8 avgLength, UINT8 dtLength, UINT8 itLength );
-
-protected:
+  cFIFOMathBase(FIFO_BUFFERS buffers, UINT8 avgLength, UINT8 dtLength, UINT8 itLength );
 
-  void update(UINT16 data);
+  void resetLatched();
+  FIFO_DT_MODE setDerivativeMode(FIFO_DT_MODE mode);
+  UINT8 getSamples();
+  UINT8 getIntegralDepth();
+  UINT64 getSumSq();
+  bool  isTimed();
   /**
-   //running sum used for average calculation, running sum used for integral calculation
+   //running sum used for average calculation, running sum used for integral calculation.
+   //sized for the worst case of MAX_FIFO_SIZE * 0xFFFF
    */
-  UINT64  sum, sumIt;
+  UINT32  sum, sumIt;
   /**
-  //average, max, min data. Note max min are latched values of acquired, not necessairly of what is in the buffer 
+  //average, max, min data. Note max min are of the samples in the buffer (sliding window of "depth" samples)
   */
   UINT16  avg,max,min;
   /**
-  //derivative calculation for N samples, before time scaling applied (update rate) 
+  //max min latched values of acquired since reset, not necessairly of what is in the buffer 
+  */
+  UINT16  maxLatch,minLatch;
+  /**
+  //derivative calculation for N samples, before time scaling applied (update rate). This is a numerator, the slope in counts
+  //per sample is derivN / derivDiv, the division is left to the next layer up (folded into its scale factor)
   */
   SINT32  derivN; 
+  UINT32  derivDiv;
   /**
   //integral calculation for N samples, before time scaling applied (update rate) 
   */
-  UINT64  integN; 
+  UINT32  integN; 
+  /**
+  //timed FIFO state (derivative and integral over the measured sample times), NULL when the FIFO is not timed
+  */
+  FIFO_TIME *timed;
+  /**
+  //update sequence number, advanced for every sample pushed (rolls over). Lets derived classes cache results per update
+  */
+  UINT16  updateSeq;
+};
+
+
+/**
+ * Sample times and state of a timed FIFO, empty (no storage) when the FIFO is not timed
+ */
+template <UINT8 Depth, bool Timed>
+struct FIFO_TIME_STORAGE
+{
+  FIFO_TIME *timeBuffer() { return(NULL); }
+};
+
+template <UINT8 Depth>
+struct FIFO_TIME_STORAGE<Depth, true>
+{
+  UINT16    timeData[Depth];
+  FIFO_TIME timeState;
+
+  FIFO_TIME *timeBuffer()
+  {
+    timeState.dt = timeData;
+    return(&timeState);
+  }
+};
+
+/**
+ * Least squares sums, empty when the FIFO has no least squares derivative mode
+ */
+template <bool Lsq>
+struct FIFO_LSQ_STORAGE
+{
+  FIFO_LSQ_SUMS *lsqBuffer() { return(NULL); }
+};
+
+template <>
+struct FIFO_LSQ_STORAGE<true>
+{
+  FIFO_LSQ_SUMS lsqSums;
+
+  FIFO_LSQ_SUMS *lsqBuffer() { return(&lsqSums); }
+};
+
+/**
+ * Running sum of squares, empty when the FIFO does not keep it
+ */
+template <bool SumSq>
+struct FIFO_SUMSQ_STORAGE
+{
+  UINT64 *sumSqBuffer() { return(NULL); }
+};
+
+template <>
+struct FIFO_SUMSQ_STORAGE<true>
+{
+  UINT64  sumSqData;
+
+  UINT64 *sumSqBuffer() { return(&sumSqData); }
+};
+
+/**
+ * FIFO storage sized at compile time. The depth rules for the FIFO math are checked here at compile time:
+ * avg depth 1 - MAX_FIFO_SIZE, derivative and integral depths (0 = disabled) no deeper than the avg depth since the fifo data is shared.
+ * The optional features (FIFO_FEATURES) add their state: a timed FIFO stores the time since the previous sample with
+ * each sample (2 bytes per sample and the FIFO_TIME sums), least squares sums 12 bytes, sum of squares 8 bytes.
+ *
+ * @param Depth    - number of samples for sum, average, max and min
+ * @param DtDepth  - number of samples for the derivative
+ * @param ItDepth  - number of samples for the integral
+ * @param Features - FIFO_FEATURES or'd, other bits are ignored (they are the sensor's, see SENSOR_FEATURES)
+ */
+template <UINT8 Depth, UINT8 DtDepth, UINT8 ItDepth, UINT8 Features = 0>
+struct FIFO_STORAGE : FIFO_TIME_STORAGE<Depth, (Features & FIFO_TIMED) != 0>, FIFO_LSQ_STORAGE<(Features & FIFO_LSQ) != 0>,
+                      FIFO_SUMSQ_STORAGE<(Features & FIFO_SUMSQ) != 0>
+{
+  static_assert(Depth > 0 && Depth <= MAX_FIFO_SIZE, "FIFO depth must be 1 - MAX_FIFO_SIZE samples");
+  static_assert(DtDepth <= Depth, "derivative depth must be equal or less than FIFO depth");
+  static_assert(ItDepth <= Depth, "integral depth must be equal or less than FIFO depth");
+  static_assert(!(Features & FIFO_LSQ) || DtDepth >= 2, "least squares derivative needs a derivative depth of 2 or more");
+
+  UINT16  fifoData[Depth];
+  UINT8   maxDeque[Depth], minDeque[Depth];
+
+  FIFO_BUFFERS buffers()
+  {
+    FIFO_BUFFERS B = {fifoData, maxDeque, minDeque, this->timeBuffer(), this->lsqBuffer(), this->sumSqBuffer()};
+    return(B);
+  }
+};
+
+
+/**
+ * FIFO math with storage sized exactly at compile time, rather than MAX_FIFO_SIZE for every instance.
+ * Power of 2 depths use mask based index wraparound.
+ *
+ * @param Depth    - number of samples for sum, average, max and min
+ * @param DtDepth  - number of samples for the derivative (0 = disabled)
+ * @param ItDepth  - number of samples for the integral (0 = disabled)
+ * @param Features - optional features, FIFO_FEATURES or'd (FIFO_TIMED: update(data, delta) with the time since the
+ *                   previous sample, FIFO_LSQ: least squares derivative, FIFO_SUMSQ: running sum of squares)
+ * @see cFIFOMathBase
+ */
+template <UINT8 Depth, UINT8 DtDepth = 1, UINT8 ItDepth = 1, UINT8 Features = 0>
+class cFIFOMath : private FIFO_STORAGE<Depth, DtDepth, ItDepth, Features>, public cFIFOMathBase
+{
+public:
+  cFIFOMath() : cFIFOMathBase(this->buffers(), Depth, DtDepth, ItDepth) {}
 };
 
 #endif 
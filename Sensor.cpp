@@ -1,14 +1,18 @@
 
+#include <math.h>
 #include "FIFOMath.h"
 #include "sensor.h"
 
 /**
  * Sensor base class from which all sensors are derived from
  * 
- * @param S      sensor structure containing slope, units, etc
+ * @param S       - sensor structure containing slope, units, etc
+ * @param buffers - FIFO storage for "depth" samples and the optional features, owned by the derived class
+ * @param depth   - avg depth, dtDepth - derivative depth, itDepth - integral depth (checked at compile time by FIFO_STORAGE)
  */
-cSensor::cSensor(NEW_SENSOR *S) : cFIFOMath(S->sample_depth,S->deriv_depth,S->integ_depth) 
+cSensorBase::cSensorBase(NEW_SENSOR *S, SENSOR_BUFFERS buffers, UINT8 depth, UINT8 dtDepth, UINT8 itDepth) : cFIFOMathBase(buffers.fifo, depth, dtDepth, itDepth) 
 {
+  cache = buffers.cache;
 
   UINT8 i,size;
 
@@ -46,19 +50,48 @@ cSensor::cSensor(NEW_SENSOR *S) : cFIFOMath(S->sample_depth,S->deriv_depth,S->in
     //set default slope and offset
     m =  S->slope;
     b =  S->offset;
+    cal = NULL;
+    storeRec = CAL_STORE_NONE;
+
+    //default calibration points, on the line
+    x1 = 0;
+    y1 = b;
+    x2 = CAL_X2_DEFAULT;
+    y2 = m * x2 + b;
 
     //set pin number for ADC read
     pinNum = S->pin;
 
+    //add pin to the free running ADC scan (shared by all sensors on the pin)
+    adcChan = (pinNum != PIN_NONE) ? cAdcScan::addChannel(pinNum, (UINT32)S->rate) : ADC_NO_CHANNEL;
+    adcSeq  = 0;
+
     //set acquisition rate
     rate = S->rate;
+
+    //time base, fixed point line equation
+    secs = (float)rate * 0.000001;
+    hz   = rate ? 1.0 / secs : 0.0;
+
+    //timed fifo, the sample times are kept in 16 bit ticks of the smallest power of 2 uSecs that fits 4x the rate
+    if (timed)
+    {
+      for (timed->shift = 0; ((UINT32)rate << 2) >> timed->shift > 0xFFFF; timed->shift++)
+      {
+      }
+    }
+    calcFixed();
+    flushCache();
     
+    if (pinNum != PIN_NONE)
+    {
 #ifdef MAPLE
-    //init pin mode for analog input  
-    pinMode(pinNum,INPUT_ANALOG);
+      //init pin mode for analog input  
+      pinMode(pinNum,INPUT_ANALOG);
 #else
-    pinMode(pinNum,INPUT);
+      pinMode(pinNum,INPUT);
 #endif
+    }
 
 
     //add sensor to acquisition list
@@ -70,7 +103,7 @@ cSensor::cSensor(NEW_SENSOR *S) : cFIFOMath(S->sample_depth,S->deriv_depth,S->in
 
 
 // Set first cal pair of points for line equation
-void cSensor::setX1Y1(UINT16 X1value, float Y1value)
+void cSensorBase::setX1Y1(UINT16 X1value, float Y1value)
 {
   x1 = X1value;
   y1 = Y1value;
@@ -79,7 +112,7 @@ void cSensor::setX1Y1(UINT16 X1value, float Y1value)
 }
 
 // Set second cal point for line equation
-void cSensor::setX2Y2(UINT16 X2value, float Y2value)
+void cSensorBase::setX2Y2(UINT16 X2value, float Y2value)
 {
   x2 = X2value;
   y2 = Y2value;
@@ -93,7 +126,7 @@ void cSensor::setX2Y2(UINT16 X2value, float Y2value)
  * This method is responsible for transforming coordinate pairs(x1,y1,x2,y2) into slope and offset (m,b). 
  * Called from withing the class when either pair is set by the user.
  */
-void cSensor::calcLine()
+void cSensorBase::calcLine()
 {
   float denom;
 
@@ -109,37 +142,222 @@ void cSensor::calcLine()
   }
   //
   // y = mx + b slope equation, solve for offset
-  // b = y1 /(m*x1)
+  // b = y1 - m*x1
   //
+  b = y1 - m * x1;
 
-  denom = m * x1;
+  calcFixed();
+  flushCache();
 
-  if (denom)
+  //store new coefficients and sensor data to the setup file
+  StoreSetupData();
+}
+
+/**
+ * Save the calibration to EEPROM, if the sensor is in the calibration store (the write is done in the background)
+ */
+void cSensorBase::StoreSetupData()
+{
+  if (storeRec != CAL_STORE_NONE)
   {
-    b = y1 /denom;
+    cCalStore::save();
+  }
+}
+
+/**
+ * copy the calibration to a store record
+ */
+void cSensorBase::getCalRecord(CAL_RECORD *R)
+{
+  R->x1 = x1;
+  R->x2 = x2;
+  R->y1 = y1;
+  R->y2 = y2;
+  R->m  = m;
+  R->b  = b;
+}
+
+/**
+ * restore the calibration from a store record (does not save it again)
+ */
+void cSensorBase::setCalRecord(const CAL_RECORD *R)
+{
+  x1 = R->x1;
+  x2 = R->x2;
+  y1 = R->y1;
+  y2 = R->y2;
+  m  = R->m;
+  b  = R->b;
+  calcFixed();
+  flushCache();
+}
+
+/**
+ * Attach a multi point calibration table (or NULL to go back to the line equation). The line equation is set to the line
+ * through the end points of the table, for the quantities that are sums of samples.
+ *
+ * @param table - calibration table, may be shared by sensors on the same kind of transducer
+ */
+void cSensorBase::setCalibration(cCalTableBase *table)
+{
+  float offset;
+
+  cal = table;
+  if (cal && cal->isValid())
+  {
+    m = cal->getLine(&offset);
+    b = offset;
+  }
+  calcFixed();
+  flushCache();
+}
+
+/**
+ * Set a point of the attached calibration table (add with index = number of points), the table is rebuilt
+ *
+ * @param index - point to set
+ * @param X     - ADC counts
+ * @param Y     - engineering units read at X
+ * @return - false if there is no table or the index is out of range
+ */
+bool cSensorBase::setCalPoint(UINT8 index, UINT16 X, float Y)
+{
+  if (!cal || !cal->setPoint(index, X, Y))
+  {
+    return(false);
+  }
+  setCalibration(cal);
+  return(true);
+}
+
+/**
+ * Precompute the fixed point transform used by the Q16 getters from the float line equation (m,b) and rate, so that the
+ * integer getters need no float math. Slope is scaled from counts to Q16.16 units, the time base to/from seconds.
+ */
+void cSensorBase::calcFixed()
+{
+  setScale(m, 16, &mFix);
+  bFix = FLOAT_TO_Q16(b);
+
+  //derivative is per second (x Hz) and per derivDiv, integral is x seconds
+  mDt = m * hz / derivDiv;
+  setScale(mDt, 16, &mDtFix);
+  setScale(m * secs, 16, &mItFix);
+  bItFix = FLOAT_TO_Q16(b * secs * getIntegralDepth());   //the offset is held over each of the itDepth sample periods
+}
+
+/**
+ * Invalidate the cached float results (line equation changed), the next read recomputes them
+ */
+void cSensorBase::flushCache()
+{
+  if (cache)
+  {
+    cache->seqRaw = cache->seqAvg = cache->seqDt = cache->seqIt = cache->seqVar = updateSeq - 1;
   }
-  //store new coefficients and sensor data to the setup file
-  //StoreSetupData();
 }
 
 /**
- * apply line equation to raw data input to produce floating point result (normalData)
+ * Set up a fixed point scale factor, the mantissa is normalized to 15 bits for best precision.
+ *
+ * @param value    - scale factor
+ * @param fracBits - number of fraction bits added to the result (16 to scale integer counts into Q16.16, 0 for Q16.16 in and out)
+ * @param S        - scale factor to set
+ */
+void cSensorBase::setScale(float value, UINT8 fracBits, FIX_SCALE *S)
+{
+  float mag = value < 0 ? -value : value;
+  UINT8 bits = 0;
+
+  //normalize, value = mant / 2^bits
+  while (mag && mag < 16383.5 && bits < 46)
+  {
+    mag *= 2;
+    bits++;
+  }
+  mag = mag > 32767 ? 32767 : mag;
+
+  S->mant   = (SINT16)(value < 0 ? -(mag + 0.5) : (mag + 0.5));
+  S->rshift = bits > fracBits ? bits - fracBits : 0;
+  S->lshift = bits < fracBits ? fracBits - bits : 0;
+}
+
+/**
+ * Multiply by a fixed point scale factor, ((data * mant) >> rshift) << lshift. The 32x16 bit product is formed from two
+ * 16x16 bit partial products, so only 32 bit math is needed. The result is truncated (towards zero), results out of the
+ * 32 bit range wrap.
+ *
+ * @param data - input value
+ * @param S    - scale factor (setScale)
+ * @return - scaled value
+ */
+SINT32 cSensorBase::scale(SINT32 data, const FIX_SCALE *S)
+{
+  UINT32 mag, mant, lo, hi;
+  bool   neg;
+
+  neg  = (data < 0) != (S->mant < 0);
+  mag  = data < 0 ? -(UINT32)data : (UINT32)data;
+  mant = S->mant < 0 ? -(SINT32)S->mant : S->mant;
+
+  //partial products, each fits 31 bits
+  lo = (mag & 0xFFFF) * mant;
+  hi = (mag >> 16) * mant;
+
+  //(hi * 2^16 + lo) >> rshift
+  if (S->rshift >= 16)
+  {
+    mag = (hi + (lo >> 16)) >> (S->rshift - 16);
+  }
+  else
+  {
+    mag = (hi << (16 - S->rshift)) + (lo >> S->rshift);
+  }
+  mag <<= S->lshift;
+
+  return( neg ? -(SINT32)mag : (SINT32)mag );
+}
+
+/**
+ * apply line equation to raw data input in fixed point, integer math only
+ *
+ * @param data - raw counts (sample, sum, derivative or integral)
+ * @return - Q16.16 result of y=mx+b transform
+ */
+Q16 cSensorBase::normalizeQ16(SINT32 data)
+{
+  return( scale(data, &mFix) + bFix );
+}
+
+/**
+ * convert a single sample (reading, avg, max, min) to fixed point, by the calibration table if one is attached
+ *
+ * @param data - counts
+ * @return - Q16.16 engineering units
+ */
+Q16 cSensorBase::sampleQ16(UINT16 data)
+{
+  return( (cal && cal->isValid()) ? cal->lookup(data) : normalizeQ16(data) );
+}
+
+/**
+ * apply line equation (or the calibration table) to raw data input to produce floating point result (normalData)
  * 
  * @param data - data to be transformed from raw unsigned counts to floating point
  *  
  * @return - floating point result of y=mx+b transform (sensor reading in floating point units)  
  */
-float cSensor::normalize(UINT16 data)
+float cSensorBase::normalize(UINT16 data)
 {
-  //apply line equaiton
-  normalData = (data * m) + b;
+  //apply line equaiton, or table lookup
+  normalData = (cal && cal->isValid()) ? Q16_TO_FLOAT(cal->lookup(data)) : (data * m) + b;
 
   //reply with normalized data
   return(normalData);
 }
 
-//overloaded for SINT64 (integral)
-float cSensor::normalize(UINT64 data)
+//overloaded for UINT32 (sum, integral)
+float cSensorBase::normalize(UINT32 data)
 {
   //apply line equaiton
   normalData = (data * m) + b;
@@ -148,29 +366,92 @@ float cSensor::normalize(UINT64 data)
   return(normalData);
 }
 
-//overloaded for SINT32 (derivative)
-float cSensor::normalize(SINT32 data)
+
+/**
+ * This method is responsible for reading sensor pin rawdata, storing into class variable.
+ * The captured value is then pushed into the FIFO math object. Can be over-ridden for other hardware.
+ * When the free running ADC is started, the latest completed block of the pin is averaged into the reading (no inline
+ * conversion). If no new block has completed since the last read, the last reading is repeated to keep the time base.
+ * The block is averaged rather than fed through updateBlock: the FIFO holds one sample per rate period (the derivative and
+ * integral are scaled by the rate), the conversions of a block are a fraction of a period apart.
+ */
+void cSensorBase::readSensor()
 {
-  //apply line equaiton
-  normalData = (data * m) + b;
+  UINT16 block[ADC_BLOCK_SIZE];
+  UINT16 total;
+  UINT8  i, shift;
 
-  //reply with normalized data
-  return(normalData);
+  if (cAdcScan::isRunning() && adcChan != ADC_NO_CHANNEL)
+  {
+    if (cAdcScan::getBlock(adcChan, block, &adcSeq))
+    {
+      //oversample, rounded average of the block (up to 8 x 12 bit fits 16 bits)
+      shift = cAdcScan::getBlockShift();
+      total = (1 << shift) >> 1;
+      for (i = 0; i < (1 << shift); i++)
+      {
+        total += block[i];
+      }
+      counts = total >> shift;
+    }
+  }
+  else
+  {
+    //result will be counts 0-1024 on UNO, 4096 on DUE
+    counts = analogRead(pinNum);
+  }
+
+  //push new raw data into FIFO buffer math algorithms
+  updateFifo(counts);
 }
 
+/**
+ * Push a sample from another source than the pin into the sensor (for derived classes overriding readSensor)
+ *
+ * @param data - new reading in counts
+ */
+void cSensorBase::putSample(UINT16 data)
+{
+  counts = data;
+  updateFifo(counts);
+}
 
 /**
- * This method is responsible for reading sensor pin rawdata, storing into class variable.
- * The captured value is then pushed into the FIFO math object. Can be over-ridden for other hardware.
+ * Push a sample into the FIFO math, with the time since the previous sample for a timed FIFO. The first sample is taken as
+ * a rate period after the one before, later times are measured (clipped to 16 bits of ticks if the sensor was not read for a while).
+ * The time of the newest sample (FIFO_TIME::last) stays on the tick grid of the first, so the ticks do not drift.
+ *
+ * @param data - new sample in counts
  */
-void cSensor::readSensor()
+void cSensorBase::updateFifo(UINT16 data)
 {
+  UINT32 ticks;
 
-  //result will be counts 0-1024 on UNO, 4096 on DUE
-  counts = analogRead(pinNum);
+  if (!timed)
+  {
+    update(data);
+    return;
+  }
 
-  //push new raw data into FIFO buffer math algorithms
-  update(counts);
+  if (getSamples())
+  {
+    ticks        = (micros() - timed->last) >> timed->shift;
+    timed->last += ticks << timed->shift;
+  }
+  else
+  {
+    ticks       = (UINT32)rate >> timed->shift;
+    timed->last = micros();
+  }
+  update(data, ticks > 0xFFFF ? 0xFFFF : (UINT16)ticks);
+}
+
+/**
+ * @return - tick of the timed FIFO sample times in seconds (2^shift uSecs)
+ */
+float cSensorBase::secsTick()
+{
+  return( (float)(1UL << timed->shift) * 0.000001 );
 }
 
 /**
@@ -178,56 +459,110 @@ void cSensor::readSensor()
  * 
  * @param filtered - TRUE = the moving average result is used for converstion to floating pont + units (based upon depth of FIFO).
  *                 - FALSE = the last known ADC reading (counts) is used
- * @return - sensor reading in floating point engineering units is returned
+ * @return - sensor reading in floating point engineering units is returned (cached until the next sample if SENSOR_CACHED)
  */
-float cSensor::getReading(bool filtered)
+float cSensorBase::getReading(bool filtered)
 {
-  float retVal;
-  
   //get the average of the raw data from moving average FIFO, pass through the sensor transfer function "Normalize"
+  if (!cache)
+  {
+    return(normalize(filtered ? avg : counts));
+  }
+
   if (filtered)
   {
-    retVal = normalize(avg);
+    if (cache->seqAvg != updateSeq)
+    {
+      cache->avg    = normalize(avg);
+      cache->seqAvg = updateSeq;
+    }
+    return(cache->avg);
   } 
-  else
+
+  if (cache->seqRaw != updateSeq)
   {
-    retVal = normalize(counts);
+    cache->raw    = normalize(counts);
+    cache->seqRaw = updateSeq;
   }
-  return(retVal);
+  return(cache->raw);
 }
 /**
  * Get the sensor integral in floating point engineering units. Apply the linearizaiton (y=mx+b) and timebase for conversion to engineering units.
- * The floating point integral is calculated by  It =  integN * t (where t is units of seconds)
+ * The floating point integral is the line integrated over the itDepth sample periods:  It = (m * integN + b * itDepth) * t
+ * (where t is units of seconds), a timed FIFO integrates the line over the measured times:  It = (m * sum(sample * dt) + b * sum(dt)) * tick
  * 
- * @return - sensor readings integrated over time in floating point engineering units is returned
+ * @return - sensor readings integrated over time in floating point engineering units is returned (cached until the next sample if SENSOR_CACHED)
  */
-float cSensor::getIntegral()
+float cSensorBase::getIntegral()
 {
-    //apply time base and floating point scaling to integral calculation, scale rate from uS to S
-    normalDataIt = normalize(integN) * ((float)rate * 0.000001);
-    
+    if (cache && cache->seqIt == updateSeq)
+    {
+        return(normalDataIt);
+    }
+
+    //apply time base and floating point scaling to integral calculation, time base precomputed in seconds
+    //timed, the line integrated over the measured sample times
+    normalDataIt = timed ? ((float)timed->integN * m + (float)timed->integTime * b) * secsTick()
+                         : ((float)integN * m + (getSamples() >= getIntegralDepth() ? (float)getIntegralDepth() * b : 0.0)) * secs;
+    if (cache)
+    {
+        cache->seqIt = updateSeq;
+    }
     return(normalDataIt);
 }
 /**
- * Get the sensor derivative in floating point engineering units. Apply the linearizaiton (y=mx+b) and timebase for conversion to engineering units.
- * The floating point derivative is calculated by  di/dt =  derivN / t (where t is units of seconds)
+ * Get the sensor derivative in floating point engineering units per second. Apply the slope (m) and timebase for conversion to engineering units.
+ * The floating point derivative is calculated by  di/dt =  derivN / derivDiv / t (where t is units of seconds), the offset
+ * of the line equation does not apply to a rate of change. The computation is selected by setDerivativeMode, a timed
+ * FIFO uses the measured times:  di/dt = m * derivN / derivDiv / tick   (FIFO_TIME)
  * 
- * @return - sensor readings derivative in floating point engineering units is returned
+ * @return - sensor readings derivative in floating point engineering units is returned (cached until the next sample if SENSOR_CACHED)
  */
-float cSensor::getDerivative()
+float cSensorBase::getDerivative()
 {
-    //apply time base and floating point scaling to derivative calculation, scale rate from uS to S
-    normalDataDt = normalize(derivN) / ((float)rate * 0.000001);
+    if (cache && cache->seqDt == updateSeq)
+    {
+        return(normalDataDt);
+    }
 
+    //apply time base and floating point scaling to derivative calculation, precomputed m * Hz / derivDiv
+    if (timed)
+    {
+        //timed, slope in counts per tick over the measured sample times
+        normalDataDt = timed->derivDiv ? (float)timed->derivN * m / ((float)timed->derivDiv * secsTick()) : 0.0;
+    }
+    else
+    {
+        normalDataDt = derivN * mDt;
+    }
+    if (cache)
+    {
+        cache->seqDt = updateSeq;
+    }
     return(normalDataDt);
 }
 
+/**
+ * Select the derivative computation used by getDerivative (and getDerivativeQ16)
+ *
+ * @param mode - FIFO_DT_DIFF (default) difference over dtDepth samples, FIFO_DT_LSQ least squares slope of the last
+ *               dtDepth samples (less noisy, needs the FIFO_LSQ feature and a dtDepth of 2 or more)
+ * @return - the mode in effect, FIFO_DT_DIFF when FIFO_DT_LSQ is not available
+ */
+FIFO_DT_MODE cSensorBase::setDerivativeMode(FIFO_DT_MODE mode)
+{
+    mode = cFIFOMathBase::setDerivativeMode(mode);
+    calcFixed();
+    flushCache();
+    return(mode);
+}
+
 /**
  * Get the sensor sum in floating point engineering units. Apply the linearizaiton (y=mx+b) for conversion to engineering units.
  * 
  * @return - sum of sensor readings in avg compution (from FIFO) floating point engineering units is returned
  */
-float cSensor::getSum()
+float cSensorBase::getSum()
 {
     return(normalize(sum));
 }
@@ -235,9 +570,9 @@ float cSensor::getSum()
 /**
  * Get the sensor Max in floating point engineering units. Apply the linearizaiton (y=mx+b) for conversion to engineering units.
  * 
- * @return - latched maximum sensor reading seen since starting acquisiton, floating point engineering units
+ * @return - maximum sensor reading of the samples in the FIFO (last "depth" samples), floating point engineering units
  */
-float cSensor::getMax()
+float cSensorBase::getMax()
 {
     return(normalize(max));
 }
@@ -246,13 +581,151 @@ float cSensor::getMax()
 /**
  * Get the sensor Min in floating point engineering units. Apply the linearizaiton (y=mx+b) for conversion to engineering units.
  * 
- * @return - latched minimum sensor reading seen since starting acquisiton, floating point engineering units
+ * @return - minimum sensor reading of the samples in the FIFO (last "depth" samples), floating point engineering units
  */
-float cSensor::getMin()
+float cSensorBase::getMin()
 {
     return(normalize(min));
 }
 
+/**
+ * Get the latched sensor Max in floating point engineering units. Apply the linearizaiton (y=mx+b) for conversion to engineering units.
+ * 
+ * @return - latched maximum sensor reading seen since starting acquisiton (or resetLatched), floating point engineering units
+ */
+float cSensorBase::getMaxLatched()
+{
+    return(normalize(maxLatch));
+}
+
+/**
+ * Get the latched sensor Min in floating point engineering units. Apply the linearizaiton (y=mx+b) for conversion to engineering units.
+ * 
+ * @return - latched minimum sensor reading seen since starting acquisiton (or resetLatched), floating point engineering units
+ */
+float cSensorBase::getMinLatched()
+{
+    return(normalize(minLatch));
+}
+
+/**
+ * Get the variance of the samples in the FIFO (last "depth" samples) in engineering units squared. Computed from the
+ * running sum and sum of squares (O(depth) without FIFO_SUMSQ), exact in integer math before the final conversion:
+ *    variance = m^2 * (N * sumSq - sum^2) / N^2
+ * 
+ * @return - windowed variance, floating point engineering units^2 (cached until the next sample if SENSOR_CACHED)
+ */
+float cSensorBase::getVariance()
+{
+    UINT8 n;
+    float var;
+
+    if (cache && cache->seqVar == updateSeq)
+    {
+        return(cache->var);
+    }
+
+    n   = getSamples();
+    var = n ? (float)(n * getSumSq() - (UINT64)sum * sum) * m * m / ((UINT16)n * n) : 0.0;
+    if (cache)
+    {
+        cache->var    = var;
+        cache->seqVar = updateSeq;
+    }
+    return(var);
+}
+
+/**
+ * @return - windowed standard deviation, floating point engineering units. A steady state test is e.g. stddev below a limit
+ */
+float cSensorBase::getStdDev()
+{
+    return(sqrt(getVariance()));
+}
+
+/**
+ * Get the RMS of the samples in the FIFO in engineering units, the line equation is applied to the mean square:
+ *    RMS^2 = mean((m * x + b)^2) = m^2 * sumSq / N + 2 * m * b * sum / N + b^2
+ * 
+ * @return - windowed RMS, floating point engineering units
+ */
+float cSensorBase::getRms()
+{
+    UINT8 n = getSamples();
+    float ms;
+
+    if (!n)
+    {
+        return(0.0);
+    }
+    ms = (m * m * (float)getSumSq() + 2.0 * m * b * sum) / n + b * b;
+
+    return(ms > 0 ? sqrt(ms) : 0.0);
+}
+
+/**
+ * Fixed point getters, same as the float getters (getReading, getDerivative etc) but the result is Q16.16 engineering units
+ * computed with integer math only (except the derivative and integral of a timed FIFO, converted from the float result).
+ * Use Q16_TO_FLOAT for display. Results converted from float saturate at +/-32767.99998 units, integer math results
+ * beyond +/-32768 units wrap.
+ */
+Q16 cSensorBase::getReadingQ16(bool filtered)
+{
+    return(sampleQ16(filtered ? avg : counts));
+}
+
+Q16 cSensorBase::getDerivativeQ16()
+{
+    //timed, the measured time base is not a precomputed scale, convert the float result
+    if (timed)
+    {
+        return(FLOAT_TO_Q16(getDerivative()));
+    }
+    return(scale(derivN, &mDtFix));
+}
+
+Q16 cSensorBase::getIntegralQ16()
+{
+    if (timed)
+    {
+        return(FLOAT_TO_Q16(getIntegral()));
+    }
+    return(scale((SINT32)integN, &mItFix) + (getSamples() >= getIntegralDepth() ? bItFix : 0));
+}
+
+Q16 cSensorBase::getSumQ16()
+{
+    return(normalizeQ16((SINT32)sum));
+}
+
+Q16 cSensorBase::getMaxQ16()
+{
+    return(sampleQ16(max));
+}
+
+Q16 cSensorBase::getMinQ16()
+{
+    return(sampleQ16(min));
+}
+
+Q16 cSensorBase::getMaxLatchedQ16()
+{
+    return(sampleQ16(maxLatch));
+}
+
+Q16 cSensorBase::getMinLatchedQ16()
+{
+    return(sampleQ16(minLatch));
+}
+
+/**
+ * Reset the latched max/min, e.g. at the start of a sweep
+ */
+void cSensorBase::resetLatched()
+{
+    cFIFOMathBase::resetLatched();
+}
+
 
 
 /**
@@ -260,8 +733,29 @@ float cSensor::getMin()
  * 
  * @return - ACQ_RATE enum, representing the acquisition rate in mSecs 
  */
-ACQ_RATE cSensor::getRate(void)
+ACQ_RATE cSensorBase::getRate(void)
 {
       return (rate);
 }
 
+/**
+ * @return - last raw reading in ADC counts
+ */
+UINT16 cSensorBase::getCounts(void)
+{
+      return (counts);
+}
+
+/**
+ * @return - slope and offset of the line equation (counts to engineering units)
+ */
+float cSensorBase::getSlope(void)
+{
+      return (m);
+}
+
+float cSensorBase::getOffset(void)
+{
+      return (b);
+}
+
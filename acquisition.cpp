@@ -1,3 +1,4 @@
+#include <string.h>
 #include "acquisition.h"
 #include "sensor.h"
 
@@ -7,20 +8,23 @@
  * This is necessary for statics in C++
  */
 UINT32 cAcquire::count;
-UINT32 cAcquire::prevCount;
-UINT32 cAcquire::ticks; 
-UINT32 cAcquire::usTicks;
-UINT16 cAcquire::_1mSCntr;
-UINT16 cAcquire::_10mSCntr;
-UINT16 cAcquire::_100mSCntr;
-UINT16 cAcquire::_1000mSCntr;
+ACQ_SLOT cAcquire::Slots[ACQ_MAX_RATES];
+UINT8  cAcquire::slotCnt;
+bool   cAcquire::started;
 UINT32 cAcquire::usTsliceEnd;
 UINT32 cAcquire::usTslice;
 UINT32 cAcquire::usTsliceMax;
-cSensor* cAcquire::Sensors[MAX_NUM_SENSORS];
+cSensorBase* cAcquire::Sensors[MAX_NUM_SENSORS];
+UINT8    cAcquire::nextSensor[MAX_NUM_SENSORS];
 /**
  */
 UINT8 cAcquire::senCnt;
+ACQ_HOOK cAcquire::Hooks[ACQ_MAX_HOOKS];
+UINT8    cAcquire::hookCnt;
+#ifdef ACQ_PROFILE
+UINT32   cAcquire::senCycles[MAX_NUM_SENSORS];
+UINT32   cAcquire::senCyclesMax[MAX_NUM_SENSORS];
+#endif
 
 /**
  * 
@@ -31,15 +35,9 @@ UINT8 cAcquire::senCnt;
 cAcquire::cAcquire()
 {
 
-    //initialize variables
-    ticks        = 0;
-    usTicks      = 0;
-    prevCount    = 0;
+    //initialize variables, deadlines are set up on the first call to runAcquisition
     count        = 0;
-    _1mSCntr     = 0;
-    _10mSCntr    = 0;
-    _100mSCntr   = 0;
-    _1000mSCntr  = 0;
+    started      = false;
     usTsliceMax  = 0;
     usTslice     = 0;
 }
@@ -47,106 +45,299 @@ cAcquire::cAcquire()
 
 /**
  * Method used by constructor's of derived cSensor classes. Adds sensor reference to the collection of references, 
- * increments counter. Bound by "MAX_NUM_SENSORS" macro
+ * increments counter. Bound by "MAX_NUM_SENSORS" macro.
+ * The sensor is also appended to the bucket of its rate (a new bucket is created for a new rate, bound by "ACQ_MAX_RATES"),
+ * buckets are kept sorted by period so that faster rates run first. Sensors with rate NONE are not scheduled.
  * 
  * @param *S - pointer to cSensor object
  */
-void cAcquire::addSensor(cSensor *S)
+void cAcquire::addSensor(cSensorBase *S)
 {
-    if (S)
+    ACQ_SLOT *slot;
+
+    //bounds check
+    if (!S || senCnt >= MAX_NUM_SENSORS)
+    {
+        return;
+    }
+
+    //add sensor into collection of pointers
+    Sensors[senCnt] = S;
+    nextSensor[senCnt] = ACQ_END_OF_LIST;
+
+    slot = addSlot(S->getRate());
+
+    //append to the bucket's list, sensors of a rate are run in the order they were created
+    if (slot)
     {
-        //add sensor into collection of pointers, bounds check
-        Sensors[senCnt] = S;       
-        senCnt = (senCnt < MAX_NUM_SENSORS)? senCnt + 1 : MAX_NUM_SENSORS - 1; 
+        if (slot->last == ACQ_END_OF_LIST)
+        {
+            slot->first = senCnt;
+        }
+        else
+        {
+            nextSensor[slot->last] = senCnt;
+        }
+        slot->last = senCnt;
     }
 
+    senCnt++;
 }
 
 /**
- * This method simply scans through class array seeking the sensors ready to run for a given rate
+ * Look up the scheduler bucket for a rate, a new rate gets a bucket inserted in period order (bound by "ACQ_MAX_RATES")
  * 
- * @param rate - run the readSensor() method fall all sensors of this rate
+ * @param rate - rate (period in uSecs)
+ * @return - pointer to the bucket, NULL for rate NONE or if the table is full
  */
-void cAcquire::runRates(ACQ_RATE rate)
+ACQ_SLOT* cAcquire::addSlot(ACQ_RATE rate)
 {
-    UINT8 i;
+    ACQ_SLOT *slot = findSlot(rate);
+    UINT32   period = (UINT32)rate;
+    UINT8    i;
 
-    //scan through sensor list and read the input for the sensors corresponding "rate"
-    for (i=0; i < senCnt; i++)
+    if (!slot && period && slotCnt < ACQ_MAX_RATES)
     {
-        if (Sensors[i]->getRate() == rate)
+        for (i = slotCnt; i > 0 && Slots[i-1].usPeriod > period; i--)
         {
-            Sensors[i]->readSensor();
+            Slots[i] = Slots[i-1];
         }
-    }   
+        slot = &Slots[i];
+        slot->usPeriod   = period;
+        slot->usDeadline = micros() + period;
+        slot->missed     = 0;
+        slot->skipped    = 0;
+        slot->first      = ACQ_END_OF_LIST;
+        slot->last       = ACQ_END_OF_LIST;
+        slot->hooks      = ACQ_END_OF_LIST;
+#ifdef ACQ_PROFILE
+        memset(&slot->prof, 0, sizeof(slot->prof));
+#endif
+        slotCnt++;
+    }
+    return(slot);
 }
 
+/**
+ * Add a function to be run on every tick of a rate, after the sensors of the rate. Hooks of a rate run in the order added.
+ * 
+ * @param rate - rate of the tick, a bucket is created if no sensor uses this rate
+ * @param func - function to run, called with "ctx"
+ * @param ctx  - context (object) passed to the function
+ * @return - false if the rate or hook tables are full
+ */
+bool cAcquire::addHook(ACQ_RATE rate, void (*func)(void *ctx), void *ctx)
+{
+    ACQ_SLOT *slot;
+    UINT8    *link;
+
+    if (!func || hookCnt >= ACQ_MAX_HOOKS || !(slot = addSlot(rate)))
+    {
+        return(false);
+    }
+
+    Hooks[hookCnt].func = func;
+    Hooks[hookCnt].ctx  = ctx;
+    Hooks[hookCnt].next = ACQ_END_OF_LIST;
+
+    //append to the rate's list
+    for (link = &slot->hooks; *link != ACQ_END_OF_LIST; link = &Hooks[*link].next)
+    {
+    }
+    *link = hookCnt++;
+
+    return(true);
+}
 
 /**
- * This is the master scheduler should be run in "loop()" function, assumes tight execution to keep on schedule.
- * This method keeps track of the number of uSeconds elapsed and calls the "runRates" method for a given rate, allowing
- * for the entire list of cSensor objects to be updated (readSensor) at it's scheduled perodic rate;
- * This is a static implementation, so the one method call is needed for all....again tight loop exectuton expected.
+ * look up the scheduler bucket for a rate
+ * 
+ * @param rate - rate (period in uSecs) to look up
+ * @return - pointer to the bucket, NULL if no sensor is scheduled at this rate
  */
-void cAcquire::runAcquisition()
+ACQ_SLOT* cAcquire::findSlot(ACQ_RATE rate)
 {
-    //sample clock to determine elapsed number of microseconds
-    count = micros();
+    UINT8 r;
 
-    //compensate for rollover
-    ticks = (prevCount < count) ? (count - prevCount) : (0xFFFFFFFF - prevCount) + count; 
+    for (r = 0; r < slotCnt; r++)
+    {
+        if (Slots[r].usPeriod == (UINT32)rate)
+        {
+            return(&Slots[r]);
+        }
+    }
+    return(NULL);
+}
 
-    //capture new previous count
-    prevCount = count;
+/**
+ * This method runs the readSensor() method for all sensors in the bucket of a rate that is due, then the rate's tick hooks.
+ * Only the sensors of this rate are visited.
+ * 
+ * @param slot - bucket of the rate that is due
+ */
+void cAcquire::runRates(ACQ_SLOT *slot)
+{
+    UINT8 i;
+#ifdef ACQ_PROFILE
+    UINT32 cycles;
+#endif
 
-    //accumulate uS ticks
-    usTicks += ticks;
+    //walk the rate's sensor list and read the inputs
+    for (i = slot->first; i != ACQ_END_OF_LIST; i = nextSensor[i])
+    {
+#ifdef ACQ_PROFILE
+        cycles = ACQ_CYCLES();
+        Sensors[i]->readSensor();
+        cycles = ACQ_CYCLES() - cycles;
+
+        senCycles[i]    = cycles;
+        senCyclesMax[i] = cycles > senCyclesMax[i] ? cycles : senCyclesMax[i];
+#else
+        Sensors[i]->readSensor();
+#endif
+    }   
 
-    //detect 1mS passed
-    if (usTicks >= 1000)
+    //then the hooks, they see this tick's readings
+    for (i = slot->hooks; i != ACQ_END_OF_LIST; i = Hooks[i].next)
     {
-        //clear uSec count we've detected 1ms has passed
-        usTicks = 0;
+        Hooks[i].func(Hooks[i].ctx);
+    }
+}
 
-        //increment 1mS tick counter
-        _1mSCntr++;
 
-        //after Xms has passed, run all xHz acquisitions based upon 1-1000ms tick counter
+/**
+ * This is the master scheduler should be run in "loop()" function, assumes tight execution to keep on schedule.
+ * Each rate (bucket) keeps an absolute deadline (in uSecs) and calls the "runRates" method when it is reached, allowing
+ * for the entire list of cSensor objects to be updated (readSensor) at it's scheduled perodic rate.
+ * The deadline is advanced by exactly one period per tick (not re-based on the time the tick actually ran), so any
+ * overshoot is carried forward and the average rate does not drift under load. When a rate falls behind, at most
+ * ACQ_MAX_CATCHUP ticks are run back to back per call, the remaining due ticks are skipped to stay on the time grid.
+ * Ticks serviced a period or more late, or skipped, are counted as missed deadlines per rate.
+ * With ACQ_PROFILE defined the start jitter (uSecs after the deadline) and time slice of every tick are added to the
+ * rate's histograms, a tick whose time slice is a period or more is counted as an overrun.
+ * This is a static implementation, so the one method call is needed for all....again tight loop exectuton expected.
+ */
+void cAcquire::runAcquisition()
+{
+    ACQ_SLOT *slot;
+    UINT8    r, runs;
+    UINT32   late, due;
+    bool     ran = false;
+#ifdef ACQ_PROFILE
+    UINT32   usStart, usRun;
+#endif
 
-        //1000Hz 
-        cAcquire::runRates(_1000Hz_Rate);
+    //sample clock to determine elapsed number of microseconds
+    count = micros();
 
-        //100Hz
-        if ((_1mSCntr - _10mSCntr) >= 10)
+    //first call, start all rates from a common time base so slower ticks coincide with the faster ones
+    if (!started)
+    {
+        for (r = 0; r < slotCnt; r++)
         {
-            cAcquire::runRates(_100Hz_Rate);
-            _10mSCntr = _1mSCntr;
+            Slots[r].usDeadline = count + Slots[r].usPeriod;
         }
+        started = true;
+    }
 
-        //10Hz
-        if ((_1mSCntr - _100mSCntr) >= 100)
-        {
-            cAcquire::runRates(_10Hz_Rate);
-            _100mSCntr = _1mSCntr;
-        }
+    //run all rates that are due, fastest first
+    for (r = 0; r < slotCnt; r++)
+    {
+        slot = &Slots[r];
+        runs = 0;
 
-        //1Hz
-        if (_1mSCntr >= 1000)
+        //signed difference is rollover safe
+        while ((SINT32)(count - slot->usDeadline) >= 0)
         {
-            cAcquire::runRates(_1Hz_Rate);
-            _1mSCntr    = 0;
-            _10mSCntr   = 0;
-            _100mSCntr  = 0;
+            late = count - slot->usDeadline;
 
+            //serviced a full period (or more) after the deadline
+            if (late >= slot->usPeriod)
+            {
+                slot->missed++;
+            }
+
+            if (runs < ACQ_MAX_CATCHUP)
+            {
+#ifdef ACQ_PROFILE
+                //faster rates (or catch up ticks) run first, so the start is sampled per tick
+                usStart = micros();
+                cAcquire::runRates(slot);
+                usRun = micros() - usStart;
+
+                addHist(slot->prof.hist[ACQ_HIST_JITTER], usStart - slot->usDeadline);
+                addHist(slot->prof.hist[ACQ_HIST_SLICE], usRun);
+                if (usRun >= slot->usPeriod)
+                {
+                    slot->prof.overruns++;
+                }
+#else
+                cAcquire::runRates(slot);
+#endif
+                slot->usDeadline += slot->usPeriod;
+                runs++;
+                ran = true;
+            }
+            else
+            {
+                //too far behind, skip the remaining due ticks, every skipped tick is a missed deadline
+                //(less the one already counted above when this tick is a full period late)
+                due = (late / slot->usPeriod) + 1;
+                slot->skipped += due;
+                slot->missed  += due - (late >= slot->usPeriod ? 1 : 0);
+                slot->usDeadline += due * slot->usPeriod;
+            }
         }
+    }
 
-        //perform diagnostic timer, provides service routine timing in uSec
+    if (ran)
+    {
+        //perform diagnostic timer, provides service routine timing in uSec (unsigned subtraction is rollover safe)
         usTsliceEnd = micros();
-        usTslice = (count < usTsliceEnd) ? usTsliceEnd - count : (0xFFFFFFFF - count) + usTsliceEnd; 
+        usTslice = usTsliceEnd - count;
 
         //latch maximum value
         usTsliceMax = usTslice > usTsliceMax ? usTslice : usTsliceMax;
+    }
+}
+
+/**
+ * diagnostic method. Retrieves number of missed deadlines for a rate, ticks that ran a period or more late, or were skipped.
+ *
+ * @param rate - rate of interest
+ * @return - number of missed deadlines since the last reset
+ */
+UINT32 cAcquire::getMissed(ACQ_RATE rate)
+{
+    ACQ_SLOT *slot = findSlot(rate);
 
+    return( slot ? slot->missed : 0 );
+}
+
+/**
+ * diagnostic method. Retrieves number of ticks skipped (not run at all) for a rate to get back on schedule.
+ *
+ * @param rate - rate of interest
+ * @return - number of skipped ticks since the last reset
+ */
+UINT32 cAcquire::getSkipped(ACQ_RATE rate)
+{
+    ACQ_SLOT *slot = findSlot(rate);
+
+    return( slot ? slot->skipped : 0 );
+}
+
+/**
+ * resets missed and skipped deadline counters for all rates
+ */
+void cAcquire::resetMissed()
+{
+    UINT8 r;
+
+    for (r = 0; r < slotCnt; r++)
+    {
+        Slots[r].missed  = 0;
+        Slots[r].skipped = 0;
     }
 }
 
@@ -168,3 +359,136 @@ void cAcquire::resetTimeSlice()
 {
     usTsliceMax = 0;
 }
+
+/**
+ * @return - number of scheduled rates (buckets)
+ */
+UINT8 cAcquire::getRateCount()
+{
+    return(slotCnt);
+}
+
+/**
+ * @return - number of sensors created (scheduled or not)
+ */
+UINT8 cAcquire::getSensorCount()
+{
+    return(senCnt);
+}
+
+/**
+ * @param S - sensor of interest
+ * @return - position in creation order, ACQ_END_OF_LIST if the sensor is not in the acquisition list
+ */
+UINT8 cAcquire::getSensorIndex(const cSensorBase *S)
+{
+    UINT8 i;
+
+    for (i = 0; i < senCnt; i++)
+    {
+        if (Sensors[i] == S)
+        {
+            return(i);
+        }
+    }
+    return(ACQ_END_OF_LIST);
+}
+
+#ifdef ACQ_PROFILE
+/**
+ * Add a value to a log2 histogram, bucket N holds 2^(N-1) to 2^N - 1 (bucket 0 holds 0), the last bucket holds anything
+ * larger. Counts saturate.
+ * 
+ * @param hist  - histogram, ACQ_HIST_BUCKETS counts
+ * @param value - value in uSecs
+ */
+void cAcquire::addHist(UINT16 *hist, UINT32 value)
+{
+    UINT8 b;
+
+    for (b = 0; value && b < ACQ_HIST_BUCKETS - 1; b++)
+    {
+        value >>= 1;
+    }
+
+    if (hist[b] != 0xFFFF)
+    {
+        hist[b]++;
+    }
+}
+
+/**
+ * profiling method. Retrieves the latency histograms and overrun counter of a rate
+ * 
+ * @param rate - rate of interest
+ * @return - profile of the rate, NULL if no sensor or hook is scheduled at this rate
+ */
+const ACQ_PROF* cAcquire::getProfile(ACQ_RATE rate)
+{
+    ACQ_SLOT *slot = findSlot(rate);
+
+    return( slot ? &slot->prof : NULL );
+}
+
+/**
+ * profiling method. Retrieves the profile of a rate by position, for walking all rates
+ * 
+ * @param r        - position of the rate, 0 (fastest) to getRateCount() - 1
+ * @param usPeriod - set to the period of the rate in uSecs, may be NULL
+ * @return - profile of the rate, NULL if "r" is out of range
+ */
+const ACQ_PROF* cAcquire::getProfile(UINT8 r, UINT32 *usPeriod)
+{
+    if (r >= slotCnt)
+    {
+        return(NULL);
+    }
+    if (usPeriod)
+    {
+        *usPeriod = Slots[r].usPeriod;
+    }
+    return(&Slots[r].prof);
+}
+
+/**
+ * profiling method. Retrieves the CPU cycles taken by the readSensor method of a sensor
+ * 
+ * @param S   - sensor of interest
+ * @param max - "true" specifies maximum seen value (latched), otherwise last measured value returned
+ * @return - cycles (see ACQ_CYCLES), 0 if the sensor is not known
+ */
+UINT32 cAcquire::getSensorCycles(const cSensorBase *S, bool max)
+{
+    return(getSensorCycles(getSensorIndex(S), max));
+}
+
+/**
+ * @param i - sensor in creation order, 0 to getSensorCount() - 1
+ */
+UINT32 cAcquire::getSensorCycles(UINT8 i, bool max)
+{
+    if (i >= senCnt)
+    {
+        return(0);
+    }
+    return( max ? senCyclesMax[i] : senCycles[i] );
+}
+
+/**
+ * clears the histograms and overrun counters of all rates and the sensor cycle counts
+ */
+void cAcquire::resetProfile()
+{
+    UINT8 i;
+
+    for (i = 0; i < slotCnt; i++)
+    {
+        memset(&Slots[i].prof, 0, sizeof(Slots[i].prof));
+    }
+    for (i = 0; i < senCnt; i++)
+    {
+        senCycles[i]    = 0;
+        senCyclesMax[i] = 0;
+    }
+}
+#endif
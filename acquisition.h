@@ -1,110 +1,340 @@
-#ifndef ACQ_H
-#define ACQ_H
-#include "typedef.h"
-
-//defines current max numer of sensors allowed
-#define  MAX_NUM_SENSORS 20
-
-
-/**
-    forward declare the sensor class to the base class to support circular reference
- */
-class cSensor;
-
-/**
- * This enum represents the rates at which a sensor's update funciton may be called ( data acquried, fifo math executed).
- * Untis are in uSecs
- */
-enum ACQ_RATE
-{
-  _1000Hz_Rate  = 1000,
-  _100Hz_Rate   = 10000,
-  _10Hz_Rate    = 100000,
-  _1Hz_Rate     = 1000000,
-  NONE          = 0
-};
-
-
-
-/**
- * The acquire class is intended to act as a simple perodic acquisition scheduler for all created sensor objects. It is therefore implemented as a static base class.
- * A sensor object"s "ACQ_RATE" enum defines it's update rate, and "registers it" into the scheduler (unless NONE is specified). 
- * The Acquire class's "runAcquisition" method assumes a tight loop call (while(1)) within which it tracks elapsed time (in uSecs)
- * and runs each sensors "readSensor" method at the defined perodic rate.
- * 
- * @author DJK
- * @version v0.1
- */
-class cAcquire
-{
-private:
-    /**
-     * counters used to accumulate usTicks for acquisition timing
-     */
-    static  UINT32 count, prevCount, ticks, usTicks;
-    /**
-     * counters used to determine # of mSecs that have elapsed
-     */
-    static UINT16 _1mSCntr, _10mSCntr, _100mSCntr, _1000mSCntr;
-    
-    /**
-     * diagnostic timing varibles used to track the execution time of the scheduler
-     */
-    static UINT32 usTsliceEnd, usTslice, usTsliceMax;
-
-    /**
-     * This is the array of sensor class pointers. One entry is created each time an object is created. 
-     * bound by #define macro "MAX_NUM_SENSORS"
-     */
-    static cSensor *Sensors[MAX_NUM_SENSORS];
-
-    /**
-     * static counter that keeps track of the number of sensors that have been created
-     */
-    static UINT8 senCnt;
-
-    /**
-     * This method simply scans through class array seeking the sensors ready to run for a given rate
-     * 
-     * @param rate - run the readSensor() method fall all sensors of this rate
-     */
-    static void runRates(ACQ_RATE rate);
-
-public:
-
-    /**
-     * constructor definition for Acquire class
-     */
-    cAcquire();
-    
-    /**
-     * this is the master scheduler should be run in "loop()" function, assumes tight execution to keep on schedule
-     */
-    static void runAcquisition();
-    
-    /**
-     * diagnostic method. Retrieves acquisition execution time in uS, diagnostics.
-     * 
-     * @param max - "true" specifies maximum seen value (latched), otherwise last measured value returned
-     * @return - number of uSecs elapsed during "runAcquisition" method 
-     */
-    static UINT32 getTimeSlice(bool max);
-    
-    /**
-     * resets "max" capture time returned by getTimeSlice. This is used for debugging
-     */
-    static void resetTimeSlice();
-
-protected:
-    /**
-     * Called by derived class's constructor to add sensor (pointer) to the acquisition list
-     * 
-     * @param S      - pointer to sensor object to be added to acquisition list
-     */
-    void addSensor(cSensor *S);
-
-    
-};   
-
-
+#ifndef ACQ_H
+#define ACQ_H
+#include "typedef.h"
+
+//defines current max numer of sensors allowed, max number of distinct acquisition rates (periods) the scheduler can hold
+//(fewer on SMALL_RAM, 3 and 19 bytes each)
+#if SMALL_RAM
+#define  MAX_NUM_SENSORS 8
+#define  ACQ_MAX_RATES 4
+#else
+#define  MAX_NUM_SENSORS 20
+#define  ACQ_MAX_RATES 8
+#endif
+
+//end of list marker for the per rate sensor lists
+#define  ACQ_END_OF_LIST 0xFF
+
+//max number of tick hooks (functions run after the sensors of a rate, e.g. burst capture, decimation filters)
+#if SMALL_RAM
+#define  ACQ_MAX_HOOKS 4
+#else
+#define  ACQ_MAX_HOOKS 8
+#endif
+
+//max number of ticks of one rate run back to back in one scheduler call when catching up, further due ticks are skipped
+#define  ACQ_MAX_CATCHUP 2
+
+//scheduler profiling: per rate latency histograms (time slice, start jitter), overrun counters and per sensor readSensor
+//cycle counts. Costs RAM and a few uSecs per tick, compiled out unless defined (the host build defines it, see Makefile)
+//#define  ACQ_PROFILE
+
+#ifdef ACQ_PROFILE
+//number of log2 histogram buckets: bucket 0 holds 0uS, bucket N holds 2^(N-1) to 2^N - 1 uSecs, the last bucket holds the rest
+#ifndef ACQ_HIST_BUCKETS
+#define  ACQ_HIST_BUCKETS 14
+#endif
+
+//cycle counter for the per sensor timing: the TSC on a PC, on the target micros() scaled to CPU cycles (the resolution
+//is one micros() tick, 4uS = 64 cycles on a 16MHz UNO)
+#if defined(HOST_BUILD) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define  ACQ_CYCLES() ((UINT32)__rdtsc())
+#else
+#ifdef F_CPU
+#define  ACQ_CPU_MHZ (F_CPU / 1000000UL)
+#else
+#define  ACQ_CPU_MHZ 16UL
+#endif
+#define  ACQ_CYCLES() (micros() * ACQ_CPU_MHZ)
+#endif
+#endif
+
+
+/**
+    forward declare the sensor class to the base class to support circular reference
+ */
+class cSensorBase;
+
+/**
+ * This enum represents the rates at which a sensor's update funciton may be called ( data acquried, fifo math executed).
+ * Untis are in uSecs. The scheduler is keyed by period, so any period may be used (see ACQ_RATE_HZ), the enum
+ * simply names the common ones.
+ */
+enum ACQ_RATE
+{
+  _2000Hz_Rate  = 500,
+  _1000Hz_Rate  = 1000,
+  _500Hz_Rate   = 2000,
+  _100Hz_Rate   = 10000,
+  _50Hz_Rate    = 20000,
+  _10Hz_Rate    = 100000,
+  _1Hz_Rate     = 1000000,
+  NONE          = 0
+};
+
+/**
+ * build an arbitrary acquisition rate from a frequency in Hz (1Hz and above)
+ */
+#define ACQ_RATE_HZ(hz) ((ACQ_RATE)(1000000UL / (hz)))
+
+/**
+ * tick hook, a function run on every tick of a rate after the rate's sensors have been read
+ */
+struct ACQ_HOOK
+{
+  void  (*func)(void *ctx);
+  void  *ctx;
+  /**
+   * next hook of the same rate (index into Hooks[]), ACQ_END_OF_LIST terminated
+   */
+  UINT8 next;
+};
+
+#ifdef ACQ_PROFILE
+/**
+ * profiled latency histograms
+ */
+enum ACQ_HIST
+{
+  ACQ_HIST_SLICE,     //time to run the rate's sensors and hooks for one tick
+  ACQ_HIST_JITTER     //time the tick started after its deadline
+};
+
+/**
+ * Profile of a rate: log2 histograms (uSecs, counts saturate at 0xFFFF) of the time slice and the start jitter of its
+ * ticks, and the number of overruns, ticks that finished after the next deadline of the rate.
+ */
+struct ACQ_PROF
+{
+  UINT16 hist[2][ACQ_HIST_BUCKETS];
+  UINT32 overruns;
+};
+#endif
+
+/**
+ * One scheduler bucket per distinct rate (period). Holds the rate's deadline, diagnostic counters and
+ * a linked list (indices into Sensors[]) of the sensors sampled at this rate, so a tick only visits the sensors that are due.
+ */
+struct ACQ_SLOT
+{
+  /**
+   * period of the rate in uSecs
+   */
+  UINT32 usPeriod;
+  /**
+   * absolute time in uSecs at which the rate is next due
+   */
+  UINT32 usDeadline;
+  /**
+   * diagnostic counters of missed deadlines (ran a period or more late, or skipped) and skipped ticks
+   */
+  UINT32 missed, skipped;
+  /**
+   * first and last sensor in the list (index into Sensors[]), ACQ_END_OF_LIST if empty
+   */
+  UINT8  first, last;
+  /**
+   * first tick hook of the rate (index into Hooks[]), ACQ_END_OF_LIST if none
+   */
+  UINT8  hooks;
+#ifdef ACQ_PROFILE
+  ACQ_PROF prof;
+#endif
+};
+
+
+
+/**
+ * The acquire class is intended to act as a simple perodic acquisition scheduler for all created sensor objects. It is therefore implemented as a static base class.
+ * A sensor object"s "ACQ_RATE" enum defines it's update rate, and "registers it" into the scheduler (unless NONE is specified). 
+ * The Acquire class's "runAcquisition" method assumes a tight loop call (while(1)) within which it tracks elapsed time (in uSecs)
+ * and runs each sensors "readSensor" method at the defined perodic rate.
+ * 
+ * @author DJK
+ * @version v0.1
+ */
+class cAcquire
+{
+private:
+    /**
+     * time in uSecs sampled at the start of the scheduler call
+     */
+    static  UINT32 count;
+    /**
+     * scheduler buckets, one per distinct rate, sorted fastest first
+     */
+    static ACQ_SLOT Slots[ACQ_MAX_RATES];
+    /**
+     * number of scheduler buckets in use
+     */
+    static UINT8 slotCnt;
+    /**
+     * set once the deadlines have been initialized (first scheduler call)
+     */
+    static bool started;
+    
+    /**
+     * diagnostic timing varibles used to track the execution time of the scheduler
+     */
+    static UINT32 usTsliceEnd, usTslice, usTsliceMax;
+
+    /**
+     * This is the array of sensor class pointers. One entry is created each time an object is created. 
+     * bound by #define macro "MAX_NUM_SENSORS"
+     */
+    static cSensorBase *Sensors[MAX_NUM_SENSORS];
+
+    /**
+     * next sensor in the same rate bucket (index into Sensors[]), ACQ_END_OF_LIST terminated
+     */
+    static UINT8 nextSensor[MAX_NUM_SENSORS];
+
+    /**
+     * static counter that keeps track of the number of sensors that have been created
+     */
+    static UINT8 senCnt;
+
+    /**
+     * tick hooks, number of hooks in use
+     */
+    static ACQ_HOOK Hooks[ACQ_MAX_HOOKS];
+    static UINT8 hookCnt;
+
+#ifdef ACQ_PROFILE
+    /**
+     * readSensor cycle counts per sensor (index into Sensors[]), last and max seen
+     */
+    static UINT32 senCycles[MAX_NUM_SENSORS], senCyclesMax[MAX_NUM_SENSORS];
+
+    /**
+     * add a value in uSecs to a histogram
+     */
+    static void addHist(UINT16 *hist, UINT32 value);
+#endif
+
+    /**
+     * This method runs the readSensor() method of every sensor in a rate bucket
+     * 
+     * @param slot - bucket of the rate that is due
+     */
+    static void runRates(ACQ_SLOT *slot);
+
+    /**
+     * look up the scheduler bucket for a rate
+     */
+    static ACQ_SLOT* findSlot(ACQ_RATE rate);
+
+    /**
+     * look up or create the scheduler bucket for a rate
+     */
+    static ACQ_SLOT* addSlot(ACQ_RATE rate);
+
+public:
+
+    /**
+     * constructor definition for Acquire class
+     */
+    cAcquire();
+    
+    /**
+     * this is the master scheduler should be run in "loop()" function, assumes tight execution to keep on schedule
+     */
+    static void runAcquisition();
+    
+    /**
+     * diagnostic method. Retrieves acquisition execution time in uS, diagnostics.
+     * 
+     * @param max - "true" specifies maximum seen value (latched), otherwise last measured value returned
+     * @return - number of uSecs elapsed during "runAcquisition" method 
+     */
+    static UINT32 getTimeSlice(bool max);
+    
+    /**
+     * resets "max" capture time returned by getTimeSlice. This is used for debugging
+     */
+    static void resetTimeSlice();
+
+    /**
+     * diagnostic method. Retrieves number of missed deadlines for a rate (ticks run a period or more late, or skipped)
+     * 
+     * @param rate - rate of interest
+     * @return - number of missed deadlines since last reset
+     */
+    static UINT32 getMissed(ACQ_RATE rate);
+
+    /**
+     * diagnostic method. Retrieves number of ticks skipped for a rate to get back on schedule
+     * 
+     * @param rate - rate of interest
+     * @return - number of skipped ticks since last reset
+     */
+    static UINT32 getSkipped(ACQ_RATE rate);
+
+    /**
+     * resets missed and skipped deadline counters. This is used for debugging
+     */
+    static void resetMissed();
+
+    /**
+     * Add a function to be run on every tick of a rate, after the sensors of the rate have been read
+     * 
+     * @param rate - rate of the tick, a bucket is created if no sensor uses this rate
+     * @param func - function to run, called with "ctx"
+     * @param ctx  - context (object) passed to the function
+     * @return - false if the rate or hook tables are full
+     */
+    static bool addHook(ACQ_RATE rate, void (*func)(void *ctx), void *ctx);
+
+    /**
+     * number of scheduled rates and sensors created
+     */
+    static UINT8 getRateCount();
+    static UINT8 getSensorCount();
+
+    /**
+     * position of a sensor in creation order (the order the sensors of a rate are run in)
+     * 
+     * @param S - sensor of interest
+     * @return - 0 to getSensorCount() - 1, ACQ_END_OF_LIST if the sensor is not in the acquisition list
+     */
+    static UINT8 getSensorIndex(const cSensorBase *S);
+
+#ifdef ACQ_PROFILE
+    /**
+     * profiling (ACQ_PROFILE). Retrieves the profile of a rate, by rate or by position (0 = fastest)
+     * 
+     * @param usPeriod - period of the rate in uSecs, may be NULL
+     * @return - profile, NULL if the rate is not scheduled
+     */
+    static const ACQ_PROF* getProfile(ACQ_RATE rate);
+    static const ACQ_PROF* getProfile(UINT8 r, UINT32 *usPeriod);
+
+    /**
+     * profiling (ACQ_PROFILE). Retrieves the readSensor cycle count of a sensor, by sensor or by creation order
+     * 
+     * @param max - "true" specifies maximum seen value (latched), otherwise last measured value returned
+     * @return - CPU cycles (see ACQ_CYCLES), 0 for an unknown sensor
+     */
+    static UINT32 getSensorCycles(const cSensorBase *S, bool max);
+    static UINT32 getSensorCycles(UINT8 i, bool max);
+
+    /**
+     * clears the histograms, overrun counters and sensor cycle counts
+     */
+    static void resetProfile();
+#endif
+
+protected:
+    /**
+     * Called by derived class's constructor to add sensor (pointer) to the acquisition list
+     * 
+     * @param S      - pointer to sensor object to be added to acquisition list
+     */
+    void addSensor(cSensorBase *S);
+
+    
+};   
+
+
 #endif
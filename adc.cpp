@@ -0,0 +1,287 @@
+#include "adc.h"
+
+/**
+ * Static re-declarations for cAdcScan class (memory allocation for statics)
+ */
+volatile UINT16 cAdcScan::blocks[2][ADC_MAX_CHANNELS][ADC_BLOCK_SIZE];
+UINT8          cAdcScan::pins[ADC_MAX_CHANNELS];
+UINT8          cAdcScan::chanCnt;
+UINT32         cAdcScan::usMinPeriod;
+UINT8          cAdcScan::blockLen   = ADC_BLOCK_SIZE;
+UINT8          cAdcScan::blockShift = ADC_BLOCK_SHIFT;
+volatile UINT8 cAdcScan::fill;
+volatile UINT8 cAdcScan::chan;
+volatile UINT8 cAdcScan::sample;
+volatile UINT8 cAdcScan::blockSeq;
+bool           cAdcScan::running;
+
+/**
+ * Add a pin to the scan list, called from the sensor constructors. A pin already in the list returns its existing channel.
+ * Bound by ADC_MAX_CHANNELS, channels can not be added while the engine is running.
+ *
+ * @param pin      - analog pin number (as passed to analogRead)
+ * @param usPeriod - period of the sensor reading the pin (uSecs), the blocks are sized to complete within the fastest
+ *                   (0 for a sensor that does not read the blocks)
+ * @return - channel index, ADC_NO_CHANNEL if the list is full
+ */
+UINT8 cAdcScan::addChannel(UINT8 pin, UINT32 usPeriod)
+{
+    UINT8 ch = findChannel(pin);
+
+    if (ch == ADC_NO_CHANNEL && chanCnt < ADC_MAX_CHANNELS && !running)
+    {
+        pins[chanCnt] = pin;
+        ch = chanCnt++;
+    }
+    if (ch != ADC_NO_CHANNEL && usPeriod && (!usMinPeriod || usPeriod < usMinPeriod))
+    {
+        usMinPeriod = usPeriod;
+    }
+    return(ch);
+}
+
+/**
+ * look up the channel of a pin
+ *
+ * @param pin - analog pin number
+ * @return - channel index, ADC_NO_CHANNEL if the pin is not scanned
+ */
+UINT8 cAdcScan::findChannel(UINT8 pin)
+{
+    UINT8 ch;
+
+    for (ch = 0; ch < chanCnt; ch++)
+    {
+        if (pins[ch] == pin)
+        {
+            return(ch);
+        }
+    }
+    return(ADC_NO_CHANNEL);
+}
+
+/**
+ * Start the free running conversions, call from setup(). Replaces analogRead() for the scanned pins, analogRead() must
+ * not be used while the engine is running (on AVR it would steal the ADC).
+ *
+ * @param reference - ADC reference (DEFAULT, INTERNAL, EXTERNAL as for analogReference)
+ * @return - false if there are no channels or there is no ADC backend for this hardware (sensors keep using analogRead)
+ */
+bool cAdcScan::begin(UINT8 reference)
+{
+    if (!chanCnt)
+    {
+        return(false);
+    }
+
+    fill     = 0;
+    chan     = 0;
+    sample   = 0;
+    blockSeq = 0;
+
+    //halve the block until all channels are converted within the fastest sensor period
+    for (blockShift = ADC_BLOCK_SHIFT; blockShift && usMinPeriod && getBlockPeriod() > usMinPeriod; blockShift--);
+    blockLen = 1 << blockShift;
+
+#if defined(__AVR__)
+    //ADC on, conversion complete interrupt, /128 prescaler (125kHz ADC clock at 16MHz)
+    ADMUX  = (reference << 6);
+    ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+    running = true;
+    startConversion(pins[0]);
+#elif defined(HOST_BUILD)
+    //conversions are performed by cAdcSim
+    (void)reference;
+    running = true;
+#else
+    //no backend (yet), stay with analogRead
+    (void)reference;
+    running = false;
+#endif
+
+    return(running);
+}
+
+/**
+ * Stop the conversions, the sensors return to analogRead()
+ */
+void cAdcScan::end()
+{
+    running = false;
+#if defined(__AVR__)
+    //let a conversion in progress finish without interrupt
+    ADCSRA &= ~_BV(ADIE);
+#endif
+}
+
+bool cAdcScan::isRunning()
+{
+    return(running);
+}
+
+/**
+ * @return - pin of the conversion in progress (used by the simulated backend)
+ */
+UINT8 cAdcScan::getPendingPin()
+{
+    return(pins[chan]);
+}
+
+/**
+ * start a conversion on a pin
+ */
+void cAdcScan::startConversion(UINT8 pin)
+{
+#if defined(__AVR__)
+    //pins may be given as channel (0-7) or digital pin number (A0 = 14), same as analogRead
+    if (pin >= 14)
+    {
+        pin -= 14;
+    }
+    ADMUX = (ADMUX & 0xF0) | (pin & 0x07);
+    ADCSRA |= _BV(ADSC);
+#else
+    (void)pin;
+#endif
+}
+
+/**
+ * Store a completed conversion into the block being filled and start the next one. Called from interrupt context.
+ * When a block is complete (blockLen samples of all channels) the buffers are swapped and the sequence number
+ * advanced, the completed block is left alone until the next swap.
+ *
+ * @param counts - result of the conversion of the pending channel
+ */
+void cAdcScan::conversion(UINT16 counts)
+{
+    if (!running)
+    {
+        return;
+    }
+
+    blocks[fill][chan][sample] = counts;
+
+    //next channel, next sample after all channels
+    if (++chan >= chanCnt)
+    {
+        chan = 0;
+        if (++sample >= blockLen)
+        {
+            sample = 0;
+            fill ^= 1;
+            blockSeq++;
+        }
+    }
+
+    startConversion(pins[chan]);
+}
+
+/**
+ * Copy the latest completed block of a channel. The copy is repeated if the interrupt swapped buffers while copying.
+ *
+ * @param ch   - channel index (from addChannel/findChannel)
+ * @param dest - ADC_BLOCK_SIZE samples, the first 1 << getBlockShift() are copied, oldest first
+ * @param seq  - in: sequence number of the block the caller has already consumed, out: sequence number of the block copied
+ * @return - true if a new block was copied, false if there is no new block since "seq" (dest not changed)
+ */
+bool cAdcScan::getBlock(UINT8 ch, UINT16 *dest, UINT8 *seq)
+{
+    UINT8 s, i;
+    volatile UINT16 *src;
+
+    if (ch >= chanCnt || !running)
+    {
+        return(false);
+    }
+
+    do
+    {
+        s = blockSeq;
+        if (s == *seq)
+        {
+            return(false);
+        }
+        src = blocks[fill ^ 1][ch];
+        for (i = 0; i < blockLen; i++)
+        {
+            dest[i] = src[i];
+        }
+    } while (s != blockSeq);
+
+    *seq = s;
+    return(true);
+}
+
+/**
+ * @return - log2 of the samples per channel in a block (set by begin)
+ */
+UINT8 cAdcScan::getBlockShift()
+{
+    return(blockShift);
+}
+
+/**
+ * @return - time to convert a block of all channels in uSecs, longer than the fastest sensor period (usMinPeriod) only
+ *           if a single sample per channel does not fit it
+ */
+UINT32 cAdcScan::getBlockPeriod()
+{
+    return(((UINT32)chanCnt << blockShift) * ADC_CONVERSION_US);
+}
+
+
+#if defined(__AVR__)
+/**
+ * AVR conversion complete interrupt
+ */
+ISR(ADC_vect)
+{
+    cAdcScan::conversion(ADC);
+}
+#endif
+
+
+#ifdef HOST_BUILD
+/**
+ * Constructor for the simulated ADC
+ *
+ * @param usConv - conversion time in uSecs (ADC_SIM_CONVERSION for a 16MHz AVR)
+ */
+cAdcSim::cAdcSim(UINT32 usConv)
+{
+    usConversion = usConv ? usConv : ADC_SIM_CONVERSION;
+    usNext       = micros() + usConversion;
+    conversions  = 0;
+}
+
+/**
+ * Perform all conversions that have come due, call periodically (main loop).
+ *
+ * @param usNow - current time in uSecs (micros())
+ */
+void cAdcSim::run(UINT32 usNow)
+{
+    if (!cAdcScan::isRunning())
+    {
+        usNext = usNow + usConversion;
+        return;
+    }
+
+    //signed compare is rollover safe
+    while ((SINT32)(usNow - usNext) >= 0)
+    {
+        //sample the input at the time the conversion completed
+        cAdcScan::conversion(simAnalogValue(cAdcScan::getPendingPin(), simTime() - (UINT32)(usNow - usNext)));
+        usNext += usConversion;
+        conversions++;
+    }
+}
+
+/**
+ * @return - number of simulated conversions
+ */
+UINT32 cAdcSim::getConversions()
+{
+    return(conversions);
+}
+#endif
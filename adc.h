@@ -0,0 +1,125 @@
+#ifndef ADC_H
+#define ADC_H
+#include "typedef.h"
+
+/**
+ * max number of analog channels (pins) scanned by the ADC engine, UNO has 6 analog inputs. 2 on SMALL_RAM (a channel holds
+ * 32 bytes of blocks), pins beyond that are read with analogRead.
+ */
+#ifndef ADC_MAX_CHANNELS
+#if SMALL_RAM
+#define ADC_MAX_CHANNELS 2
+#else
+#define ADC_MAX_CHANNELS 6
+#endif
+#endif
+
+/**
+ * max number of samples per channel in a block. Must be a power of 2, the block average is computed with a shift.
+ * begin() shortens the block (by powers of 2) until a block of all channels completes within the fastest sensor period.
+ */
+#define ADC_BLOCK_SIZE 8
+#define ADC_BLOCK_SHIFT 3
+
+/**
+ * returned by channel lookups for a pin that is not scanned
+ */
+#define ADC_NO_CHANNEL 0xFF
+
+/**
+ * conversion time in uSecs (13 ADC clocks at 125kHz, 16MHz AVR with /128 prescaler), sizes the blocks. Also the default
+ * conversion time of the simulated ADC.
+ */
+#define ADC_CONVERSION_US 104
+#define ADC_SIM_CONVERSION ADC_CONVERSION_US
+
+
+/**
+ * Free running ADC acquisition engine. The configured channels are converted back to back by the ADC, each conversion
+ * complete interrupt stores the result and starts the next conversion, so no CPU time is spent waiting on the ADC.
+ * Samples are collected into blocks of up to ADC_BLOCK_SIZE samples per channel, double buffered (ping-pong): the interrupt
+ * fills one block while the last completed block is read by the sensors (cSensor::readSensor). A block sequence number
+ * tells the reader when a new block is available. A block takes samples * channels conversions, the samples per channel
+ * are halved until a block completes within the fastest sensor period, so each sensor tick sees a new block. If one
+ * sample per channel is still too slow the block period is longer than a tick and the sensor repeats readings
+ * (getBlockPeriod, fewer scanned pins or a slower rate).
+ *
+ * Channels are added by the sensor constructors (one channel per pin, sensors on the same pin share it). The engine is
+ * started from setup() with begin(), until then (or on hardware without a backend) the sensors fall back to analogRead().
+ *
+ * Backends: AVR conversion complete interrupt, simulated ADC on the host build (cAdcSim). The "conversion" method is
+ * public so that the samples can come from another source (DMA complete, simulation).
+ *
+ * @author DJK
+ * @version 0.1
+ */
+class cAdcScan
+{
+private:
+    /**
+     * ping-pong sample blocks, [buffer][channel][sample]
+     */
+    static volatile UINT16 blocks[2][ADC_MAX_CHANNELS][ADC_BLOCK_SIZE];
+    /**
+     * pins of the scanned channels, number of channels
+     */
+    static UINT8 pins[ADC_MAX_CHANNELS];
+    static UINT8 chanCnt;
+    /**
+     * shortest period of the sensors reading the blocks (uSecs), samples per channel in a block and log2 of it
+     */
+    static UINT32 usMinPeriod;
+    static UINT8 blockLen, blockShift;
+    /**
+     * buffer being filled by the interrupt, channel and sample being converted
+     */
+    static volatile UINT8 fill, chan, sample;
+    /**
+     * number of completed blocks (rolls over), single byte so that it is read atomically
+     */
+    static volatile UINT8 blockSeq;
+    static bool running;
+
+    static void startConversion(UINT8 pin);
+
+public:
+    static UINT8 addChannel(UINT8 pin, UINT32 usPeriod);
+    static UINT8 findChannel(UINT8 pin);
+    static bool  begin(UINT8 reference);
+    static void  end();
+    static bool  isRunning();
+    static UINT8 getPendingPin();
+    static void  conversion(UINT16 counts);
+    static bool  getBlock(UINT8 ch, UINT16 *dest, UINT8 *seq);
+    static UINT8 getBlockShift();
+    static UINT32 getBlockPeriod();
+};
+
+
+#ifdef HOST_BUILD
+/**
+ * Simulated ADC backend for the host build. Performs the conversions of the free running engine that have come due
+ * (one every "usConversion" uSecs of virtual time), sampling the scripted waveform of the pin at the time of the conversion.
+ *
+ * @see cAdcScan
+ */
+class cAdcSim
+{
+private:
+    /**
+     * conversion time in uSecs, timestamp of the next conversion complete
+     */
+    UINT32 usConversion, usNext;
+    /**
+     * number of conversions performed
+     */
+    UINT32 conversions;
+
+public:
+    cAdcSim(UINT32 usConv);
+    void   run(UINT32 usNow);
+    UINT32 getConversions();
+};
+#endif
+
+#endif
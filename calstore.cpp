@@ -0,0 +1,271 @@
+#include <string.h>
+#include "calstore.h"
+#include "sensor.h"
+#include "telemetry.h"
+
+#if defined(E2END)
+static_assert(EEPROM_CAL_STORE + CAL_STORE_SLOTS * CAL_IMAGE_SIZE <= E2END + 1, "calibration store does not fit the EEPROM");
+#elif defined(HOST_BUILD)
+static_assert(EEPROM_CAL_STORE + CAL_STORE_SLOTS * CAL_IMAGE_SIZE <= SIM_EEPROM_SIZE, "calibration store does not fit the EEPROM");
+#endif
+
+/**
+ * Static re-declarations for cCalStore class
+ */
+cSensorBase* cCalStore::Sensors[CAL_STORE_RECORDS];
+UINT8        cCalStore::senCnt;
+CAL_HEADER   cCalStore::header;
+UINT8        cCalStore::config[CAL_STORE_CONFIG];
+UINT8        cCalStore::slot;
+UINT16       cCalStore::writePos = CAL_IMAGE_SIZE;
+CAL_RECORD   cCalStore::rec;
+UINT8        cCalStore::recIdx;
+UINT16       cCalStore::crc;
+UINT32       cCalStore::writes;
+
+/**
+ * Add a sensor to the store, the record index is the order of adding so it must not change between builds
+ * (the sketch adds its sensors in setup, before begin). Bound by CAL_STORE_RECORDS.
+ *
+ * @return - record index, CAL_STORE_NONE if the store is full
+ */
+UINT8 cCalStore::addSensor(cSensorBase *S)
+{
+    if (!S || senCnt >= CAL_STORE_RECORDS)
+    {
+        return(CAL_STORE_NONE);
+    }
+
+    Sensors[senCnt] = S;
+    S->storeRec = senCnt;
+
+    return(senCnt++);
+}
+
+/**
+ * @return - CRC of the image in a slot, computed from the EEPROM a byte at a time
+ */
+UINT16 cCalStore::slotCrc(UINT8 s)
+{
+    UINT16 c = 0xFFFF;
+    UINT16 i;
+    UINT8  d;
+
+    for (i = 0; i < offsetof(CAL_IMAGE, crc); i++)
+    {
+        d = EEPROM.read(CAL_SLOT_ADDR(s) + i);
+        c = cTelemetryBase::crc16(&d, 1, c);
+    }
+    return(c);
+}
+
+/**
+ * @return - true if the header is of this layout (the CRC is checked separately)
+ */
+bool cCalStore::valid(const CAL_HEADER *H)
+{
+    return( H->magic == CAL_STORE_MAGIC && H->version == CAL_STORE_VERSION &&
+            H->size == CAL_IMAGE_SIZE && H->records <= CAL_STORE_RECORDS );
+}
+
+/**
+ * Load the newest valid image and apply it to the sensors, call from setup() after the sensors are added.
+ * Sensors without a record (added since the image was saved) keep their defaults.
+ *
+ * @return - false if no valid image was found (first start, or layout changed), the defaults are kept
+ */
+bool cCalStore::begin()
+{
+    CAL_HEADER H[CAL_STORE_SLOTS];
+    UINT8      s, best, i;
+    UINT16     stored;
+    bool       tried[CAL_STORE_SLOTS];
+
+    for (s = 0; s < CAL_STORE_SLOTS; s++)
+    {
+        EEPROM.readBlock(CAL_SLOT_ADDR(s), &H[s], sizeof(CAL_HEADER));
+        tried[s] = false;
+    }
+
+    //newest first (sequence numbers compared rollover safe), until one has a good CRC
+    for (;;)
+    {
+        best = CAL_STORE_SLOTS;
+        for (s = 0; s < CAL_STORE_SLOTS; s++)
+        {
+            if (!tried[s] && valid(&H[s]) &&
+                (best == CAL_STORE_SLOTS || (SINT16)(H[s].seq - H[best].seq) > 0))
+            {
+                best = s;
+            }
+        }
+        if (best == CAL_STORE_SLOTS)
+        {
+            //nothing valid, start a new image at slot 0 (the first save goes to slot 1)
+            memset(&header, 0, sizeof(header));
+            memset(config, 0, sizeof(config));
+            slot = 0;
+            return(false);
+        }
+
+        tried[best] = true;
+        EEPROM.readBlock(CAL_SLOT_ADDR(best) + offsetof(CAL_IMAGE, crc), &stored, sizeof(stored));
+        if (slotCrc(best) == stored)
+        {
+            break;
+        }
+    }
+
+    slot   = best;
+    header = H[best];
+    EEPROM.readBlock(CAL_SLOT_ADDR(best) + offsetof(CAL_IMAGE, config), config, CAL_STORE_CONFIG);
+    for (i = 0; i < senCnt && i < header.records; i++)
+    {
+        EEPROM.readBlock(CAL_SLOT_ADDR(best) + offsetof(CAL_IMAGE, rec) + i * sizeof(CAL_RECORD), &rec, sizeof(CAL_RECORD));
+        Sensors[i]->setCalRecord(&rec);
+    }
+    return(true);
+}
+
+/**
+ * Save the sensors (and the configuration) as a new image, written in the background by run(). A save while the previous
+ * one is still being written restarts the write in the same slot (that slot is not valid yet). The records are read from
+ * the sensors as they are written, so a change during the write is picked up by the save it triggers.
+ */
+void cCalStore::save()
+{
+    if (writePos >= CAL_IMAGE_SIZE)
+    {
+        slot = (slot + 1) % CAL_STORE_SLOTS;
+    }
+
+    header.magic   = CAL_STORE_MAGIC;
+    header.version = CAL_STORE_VERSION;
+    header.records = senCnt;
+    header.seq++;
+    header.size    = CAL_IMAGE_SIZE;
+
+    recIdx   = CAL_STORE_NONE;
+    crc      = 0xFFFF;
+    writePos = 0;
+}
+
+/**
+ * Build the image byte at writePos and add it to the CRC, the CRC itself once all before it are done. Call with writePos
+ * stepping through the image in order.
+ *
+ * @return - image byte
+ */
+UINT8 cCalStore::nextByte()
+{
+    UINT16 pos = writePos;
+    UINT8  idx, d;
+
+    if (pos >= offsetof(CAL_IMAGE, crc))
+    {
+        return(((const UINT8 *)&crc)[pos - offsetof(CAL_IMAGE, crc)]);
+    }
+
+    if (pos < offsetof(CAL_IMAGE, config))
+    {
+        d = ((const UINT8 *)&header)[pos];
+    }
+    else if (pos < offsetof(CAL_IMAGE, rec))
+    {
+        d = config[pos - offsetof(CAL_IMAGE, config)];
+    }
+    else
+    {
+        pos -= offsetof(CAL_IMAGE, rec);
+        idx  = pos / sizeof(CAL_RECORD);
+        if (idx != recIdx)
+        {
+            //unused records are zero
+            memset(&rec, 0, sizeof(rec));
+            if (idx < senCnt)
+            {
+                Sensors[idx]->getCalRecord(&rec);
+            }
+            recIdx = idx;
+        }
+        d = ((const UINT8 *)&rec)[pos - idx * sizeof(CAL_RECORD)];
+    }
+
+    crc = cTelemetryBase::crc16(&d, 1, crc);
+    return(d);
+}
+
+/**
+ * Background writer, call from loop(). Builds the image byte by byte, compares it to the slot and writes the next byte
+ * that differs, one write per call and only when the EEPROM is ready (never waits).
+ *
+ * @return - true while a save is being written
+ */
+bool cCalStore::run()
+{
+    while (writePos < CAL_IMAGE_SIZE && EEPROM.isReady())
+    {
+        writes += EEPROM.update(CAL_SLOT_ADDR(slot) + writePos, nextByte());
+        writePos++;
+    }
+    return(writePos < CAL_IMAGE_SIZE);
+}
+
+/**
+ * finish the save in progress, blocking (e.g. before a reset)
+ */
+void cCalStore::flush()
+{
+    while (writePos < CAL_IMAGE_SIZE)
+    {
+        writes += EEPROM.update(CAL_SLOT_ADDR(slot) + writePos, nextByte());
+        writePos++;
+    }
+}
+
+/**
+ * @return - true while a save is being written
+ */
+bool cCalStore::isBusy()
+{
+    return(writePos < CAL_IMAGE_SIZE);
+}
+
+/**
+ * Set the sketch configuration bytes (saved with the next save), e.g. a struct of settings
+ *
+ * @param data - configuration
+ * @param len  - bytes, clipped to CAL_STORE_CONFIG
+ */
+void cCalStore::setConfig(const void *data, UINT8 len)
+{
+    memcpy(config, data, len < CAL_STORE_CONFIG ? len : CAL_STORE_CONFIG);
+}
+
+/**
+ * @param data - destination for the configuration loaded by begin (zero if none was stored)
+ * @param len  - bytes, clipped to CAL_STORE_CONFIG
+ * @return - bytes copied
+ */
+UINT8 cCalStore::getConfig(void *data, UINT8 len)
+{
+    len = len < CAL_STORE_CONFIG ? len : CAL_STORE_CONFIG;
+    memcpy(data, config, len);
+    return(len);
+}
+
+/**
+ * @return - sequence number of the current image (number of saves)
+ */
+UINT16 cCalStore::getSeq()
+{
+    return(header.seq);
+}
+
+/**
+ * @return - EEPROM bytes written since startup
+ */
+UINT32 cCalStore::getWrites()
+{
+    return(writes);
+}
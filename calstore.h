@@ -0,0 +1,135 @@
+#ifndef CALSTORE_H
+#define CALSTORE_H
+#include <stddef.h>
+#include "typedef.h"
+#include "EEPROM.h"
+
+/**
+ * header magic, layout version (bump when CAL_IMAGE changes, older images are then ignored)
+ */
+#define CAL_STORE_MAGIC    0xCA1B
+#define CAL_STORE_VERSION  1
+
+/**
+ * max number of sensors held, bytes of sketch configuration, number of wear leveling slots
+ */
+#define CAL_STORE_RECORDS  6
+#define CAL_STORE_CONFIG   16
+#define CAL_STORE_SLOTS    4
+
+/**
+ * record index of a sensor that is not in the store
+ */
+#define CAL_STORE_NONE     0xFF
+
+/**
+ * calibration of a sensor, the 2 point line and the line equation computed from it
+ */
+struct CAL_RECORD
+{
+  UINT16  x1, x2;
+  float   y1, y2;
+  float   m, b;
+};
+
+/**
+ * image header, "size" is the image size in bytes as a layout check. 8 bytes so the records are aligned on all targets.
+ */
+struct CAL_HEADER
+{
+  UINT16  magic;
+  UINT8   version;
+  UINT8   records;
+  UINT16  seq;
+  UINT16  size;
+};
+
+/**
+ * store image, as held in one EEPROM slot. CRC-16/CCITT of everything before it.
+ */
+struct CAL_IMAGE
+{
+  CAL_HEADER  header;
+  UINT8       config[CAL_STORE_CONFIG];
+  CAL_RECORD  rec[CAL_STORE_RECORDS];
+  UINT16      crc;
+};
+
+/**
+ * bytes of an image in EEPROM (the struct may have tail padding on the host)
+ */
+#define CAL_IMAGE_SIZE  (offsetof(CAL_IMAGE, crc) + sizeof(UINT16))
+
+/**
+ * first EEPROM address of a slot
+ */
+#define CAL_SLOT_ADDR(s) (EEPROM_CAL_STORE + (s) * CAL_IMAGE_SIZE)
+
+
+class cSensorBase;
+
+/**
+ * Persistent calibration and configuration store in EEPROM (see EEPROM.h memory map). Sensors added to the store are
+ * saved whenever their calibration changes (cSensorBase::calcLine) and restored at startup.
+ *
+ * Each save is a complete image (header with a sequence number, sketch configuration, a record per sensor, CRC) written to
+ * the next of CAL_STORE_SLOTS slots, so the writes are spread over the slots (wear leveling) and the previous image is
+ * intact if power is lost during a write. At startup the headers of all slots are read, the valid image with the newest
+ * sequence number is CRC checked straight from the EEPROM (falling back to the next newest) and its records are applied
+ * to the sensors one at a time.
+ *
+ * Writes are read-compare-write: only the bytes that differ from the slot contents are written (3.3mS and a write cycle
+ * each on AVR). They are done in the background by run(), one byte when the EEPROM is ready, so a save never stalls the
+ * acquisition. There is no RAM copy of the image: each byte is built as run() reaches it (header and configuration from
+ * RAM, a record from its sensor when the first of its bytes is due) and the CRC is accumulated as it goes, so only the
+ * header, the configuration and one record are held.
+ *
+ * Static, there is one EEPROM.
+ *
+ * @author DJK
+ * @version 0.1
+ */
+class cCalStore
+{
+private:
+  /**
+   * sensors in the store, record index = order added
+   */
+  static cSensorBase *Sensors[CAL_STORE_RECORDS];
+  static UINT8        senCnt;
+  /**
+   * header and configuration of the newest image, slot it is (being) written to, next byte to write (CAL_IMAGE_SIZE when idle)
+   */
+  static CAL_HEADER   header;
+  static UINT8        config[CAL_STORE_CONFIG];
+  static UINT8        slot;
+  static UINT16       writePos;
+  /**
+   * record being written and its index, CRC of the bytes before writePos
+   */
+  static CAL_RECORD   rec;
+  static UINT8        recIdx;
+  static UINT16       crc;
+  /**
+   * number of bytes written since startup (wear)
+   */
+  static UINT32       writes;
+
+  static UINT16 slotCrc(UINT8 s);
+  static bool   valid(const CAL_HEADER *H);
+  static UINT8  nextByte();
+
+public:
+  static UINT8  addSensor(cSensorBase *S);
+  static bool   begin();
+  static void   save();
+  static bool   run();
+  static void   flush();
+  static bool   isBusy();
+  static void   setConfig(const void *data, UINT8 len);
+  static UINT8  getConfig(void *data, UINT8 len);
+  static UINT16 getSeq();
+  static UINT32 getWrites();
+};
+
+#endif
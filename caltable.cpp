@@ -0,0 +1,177 @@
+#include "caltable.h"
+
+/**
+ * Calibration table constructor, the table is empty (invalid) until 2 points are set
+ *
+ * @param pointStorage - storage for "pointsMax" calibration points
+ * @param pointsMax    - max number of points
+ * @param lutStorage   - storage for 2^tableBits + 1 table entries
+ * @param tableBits    - log2 of the number of segments
+ * @param adcBits      - resolution of the counts converted (10 on UNO, 12 on DUE), at least tableBits
+ */
+cCalTableBase::cCalTableBase(CAL_POINT *pointStorage, UINT8 pointsMax, Q16 *lutStorage, UINT8 tableBits, UINT8 adcBits)
+{
+    points    = pointStorage;
+    lut       = lutStorage;
+    maxPoints = pointsMax;
+    segBits   = tableBits;
+
+    adcBits   = adcBits > CAL_MAX_ADC_BITS ? CAL_MAX_ADC_BITS : adcBits;
+    adcBits   = adcBits < segBits ? segBits : adcBits;
+    shift     = adcBits - segBits;
+    maxCounts = (UINT16)((1UL << adcBits) - 1);
+
+    clear();
+}
+
+/**
+ * remove all points, conversions fall back to the line equation of the sensor
+ */
+void cCalTableBase::clear()
+{
+    numPoints = 0;
+    valid     = false;
+}
+
+/**
+ * Set a calibration point (add with index = number of points), the table is rebuilt
+ *
+ * @param index - point to set, 0 - number of points (appends)
+ * @param x     - ADC counts
+ * @param y     - engineering units read at x
+ * @return - false if the index is out of range
+ */
+bool cCalTableBase::setPoint(UINT8 index, UINT16 x, float y)
+{
+    if (index > numPoints || index >= maxPoints)
+    {
+        return(false);
+    }
+
+    points[index].x = x;
+    points[index].y = y;
+    numPoints = (index == numPoints) ? numPoints + 1 : numPoints;
+
+    build();
+    return(true);
+}
+
+/**
+ * evaluate the piecewise linear curve through the (sorted) points, the end segments are extrapolated
+ */
+float cCalTableBase::curve(float x)
+{
+    UINT8 i;
+
+    //segment of the points that contains x (first or last for extrapolation)
+    for (i = 1; i < numPoints - 1 && x > points[i].x; i++);
+
+    return( points[i-1].y + (x - points[i-1].x) * (points[i].y - points[i-1].y) / (points[i].x - points[i-1].x) );
+}
+
+/**
+ * Sort the points and compile the table. Points with the same counts are removed (last one kept).
+ */
+void cCalTableBase::build()
+{
+    CAL_POINT P;
+    UINT8     i, j;
+    UINT16    k;
+    float     y;
+
+    //insertion sort by counts, few points
+    for (i = 1; i < numPoints; i++)
+    {
+        P = points[i];
+        for (j = i; j > 0 && points[j-1].x > P.x; j--)
+        {
+            points[j] = points[j-1];
+        }
+        points[j] = P;
+    }
+    for (i = 1; i < numPoints; )
+    {
+        if (points[i].x == points[i-1].x)
+        {
+            points[i-1] = points[i];
+            for (j = i; j < numPoints - 1; j++)
+            {
+                points[j] = points[j+1];
+            }
+            numPoints--;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    valid = numPoints >= 2;
+    if (!valid)
+    {
+        return;
+    }
+
+    //sample the curve at every segment boundary
+    for (k = 0; k <= (1U << segBits); k++)
+    {
+        y = curve((float)((UINT32)k << shift));
+        y = y > 32767.0 ? 32767.0 : (y < -32768.0 ? -32768.0 : y);
+        lut[k] = (Q16)(y * 65536.0 + (y < 0 ? -0.5 : 0.5));
+    }
+}
+
+/**
+ * @return - true if the table holds 2 points or more
+ */
+bool cCalTableBase::isValid()
+{
+    return(valid);
+}
+
+/**
+ * @return - number of calibration points
+ */
+UINT8 cCalTableBase::getPoints()
+{
+    return(numPoints);
+}
+
+/**
+ * Convert counts to engineering units, O(1). Integer math only, the interpolation product is split so it fits 32 bits:
+ *    dy * frac / 2^shift = (dy >> shift) * frac + ((dy & mask) * frac) >> shift
+ *
+ * @param x - counts, clipped to the ADC range
+ * @return - Q16.16 engineering units
+ */
+Q16 cCalTableBase::lookup(UINT16 x)
+{
+    UINT16 seg, frac;
+    SINT32 dy;
+
+    x    = x > maxCounts ? maxCounts : x;
+    seg  = x >> shift;
+    frac = x & ((1U << shift) - 1);
+    dy   = lut[seg + 1] - lut[seg];
+
+    return( lut[seg] + (dy >> shift) * frac + (SINT32)(((UINT32)(dy & ((1UL << shift) - 1)) * frac) >> shift) );
+}
+
+/**
+ * line through the first and last calibration points, for the quantities that are not single samples (sum, derivative etc)
+ *
+ * @param offset - offset of the line
+ * @return - slope of the line
+ */
+float cCalTableBase::getLine(float *offset)
+{
+    float slope;
+
+    if (!valid)
+    {
+        return(0.0);
+    }
+    slope   = (points[numPoints-1].y - points[0].y) / (points[numPoints-1].x - points[0].x);
+    *offset = points[0].y - slope * points[0].x;
+    return(slope);
+}
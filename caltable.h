@@ -0,0 +1,94 @@
+#ifndef CALTABLE_H
+#define CALTABLE_H
+#include "typedef.h"
+
+/**
+ * Q16.16 fixed point engineering units (see sensor.h)
+ */
+typedef SINT32 Q16;
+
+/**
+ * max resolution of the lookup table (2^bits segments) and of the ADC counts it is indexed by
+ */
+#define CAL_MAX_SEG_BITS  8
+#define CAL_MAX_ADC_BITS  16
+#define CAL_ADC_BITS_DEFAULT 10
+
+/**
+ * calibration point, ADC counts and the engineering units they read
+ */
+struct CAL_POINT
+{
+  UINT16  x;
+  float   y;
+};
+
+/**
+ * Multi point calibration. N calibration points define a piecewise linear curve (counts to engineering units), extrapolated
+ * beyond the first and last points. The curve is compiled into a lookup table with a uniform step of 2^(adcBits - segBits)
+ * counts, so a conversion is O(1) with no search: the high bits of the counts select the segment, the low bits
+ * interpolate between its end points.
+ *
+ *    y = lut[x >> shift] + (lut[(x >> shift) + 1] - lut[x >> shift]) * (x & mask) / 2^shift
+ *
+ * The table is only rebuilt when the points change. It is exact where the calibration points fall on the segment
+ * boundaries, otherwise a break in the curve is rounded over one segment, size the table so segments are short against the
+ * spacing of the points. Results are Q16.16 (range +/-32768 units, a segment may not span more than 32768 units).
+ *
+ * @see cCalTable
+ * @author DJK
+ * @version 0.1
+ */
+class cCalTableBase
+{
+private:
+  /**
+   * calibration points (sorted by x when the table is built) and table storage, owned by the derived class
+   */
+  CAL_POINT *points;
+  Q16       *lut;
+  UINT8      maxPoints, numPoints;
+  /**
+   * segments = 2^segBits, counts per segment = 2^shift, max ADC counts
+   */
+  UINT8      segBits, shift;
+  UINT16     maxCounts;
+  bool       valid;
+
+  float      curve(float x);
+
+protected:
+  cCalTableBase(CAL_POINT *pointStorage, UINT8 pointsMax, Q16 *lutStorage, UINT8 tableBits, UINT8 adcBits);
+
+public:
+  bool       setPoint(UINT8 index, UINT16 x, float y);
+  void       clear();
+  void       build();
+  bool       isValid();
+  UINT8      getPoints();
+  Q16        lookup(UINT16 x);
+  float      getLine(float *offset);
+};
+
+
+/**
+ * Calibration table with storage sized at compile time
+ *
+ * @param Points  - max number of calibration points
+ * @param SegBits - table of 2^SegBits segments (2^SegBits + 1 Q16 entries)
+ */
+template <UINT8 Points, UINT8 SegBits>
+class cCalTable : public cCalTableBase
+{
+  static_assert(Points >= 2, "calibration needs 2 points or more");
+  static_assert(SegBits >= 1 && SegBits <= CAL_MAX_SEG_BITS, "table must have 2 - 2^CAL_MAX_SEG_BITS segments");
+
+private:
+  CAL_POINT calPoints[Points];
+  Q16       table[(1U << SegBits) + 1];
+
+public:
+  cCalTable(UINT8 adcBits = CAL_ADC_BITS_DEFAULT) : cCalTableBase(calPoints, Points, table, SegBits, adcBits) {}
+};
+
+#endif
@@ -0,0 +1,403 @@
+#include <string.h>
+#include "capture.h"
+
+/**
+ * Capture base class constructor, registers the recording tick with the acquisition scheduler
+ *
+ * @param storage  - record buffer, owned by the derived class
+ * @param size     - size of the record buffer in bytes
+ * @param tickRate - recording rate (e.g. _1000Hz_Rate), sensors should be read at this rate or faster
+ * @param T        - telemetry port for the dump
+ */
+cCaptureBase::cCaptureBase(UINT8 *storage, UINT16 size, ACQ_RATE tickRate, cTelemetryBase *T)
+{
+    buf        = storage;
+    bytes      = size;
+    tlm        = T;
+    rate       = tickRate;
+    chanCnt    = 0;
+    mode       = CAP_ONESHOT;
+    trigSensor = NULL;
+    reset();
+
+    //time field tick, room for a tick up to 4 periods late
+    for (timeShift = 0; ((UINT32)rate << 2) >> timeShift > CAP_FIELD_MAX; timeShift++)
+    {
+    }
+
+    cAcquire::addHook(rate, cCaptureBase::tickHook, this);
+}
+
+/**
+ * discard the records
+ */
+void cCaptureBase::reset()
+{
+    state    = CAP_IDLE;
+    recSize  = 1 + chanCnt;
+    capacity = CAP_FIELDS(bytes) / recSize;
+    first    = 0;
+    count    = 0;
+    usFirst  = 0;
+    usLast   = 0;
+    clipped  = 0;
+    dumpNext = 0;
+    infoSent = false;
+}
+
+/**
+ * Add a sensor to record, only while nothing is captured (the record size changes). Bound by CAP_MAX_CHANNELS.
+ *
+ * @param S     - sensor to record
+ * @param shift - right shift of the counts into the 12 bit field, e.g. 4 for a sensor using all 16 bits of counts
+ *                (0 for ADC sensors up to 12 bits)
+ * @return - channel index, CAP_MAX_CHANNELS if it can not be added
+ */
+UINT8 cCaptureBase::addSensor(cSensorBase *S, UINT8 shift)
+{
+    if (!S || chanCnt >= CAP_MAX_CHANNELS || state != CAP_IDLE || CAP_FIELDS(bytes) < (UINT16)(chanCnt + 2) ||
+        shift > 16 - CAP_FIELD_BITS)
+    {
+        return(CAP_MAX_CHANNELS);
+    }
+
+    Shifts[chanCnt]     = shift;
+    Channels[chanCnt++] = S;
+    reset();
+
+    return(chanCnt - 1);
+}
+
+/**
+ * @param capMode - CAP_ONESHOT (default) stops when full, CAP_RING keeps the latest records until stopped
+ */
+void cCaptureBase::setMode(CAP_MODE capMode)
+{
+    mode = capMode;
+}
+
+/**
+ * start recording now, previous records are discarded
+ */
+void cCaptureBase::start()
+{
+    if (chanCnt)
+    {
+        reset();
+        state = CAP_RUNNING;
+    }
+}
+
+/**
+ * stop recording (or waiting for the trigger), the records are held for dump
+ */
+void cCaptureBase::stop()
+{
+    if (state == CAP_RUNNING || state == CAP_ARMED)
+    {
+        state = count ? CAP_STOPPED : CAP_IDLE;
+    }
+}
+
+/**
+ * Arm the capture, recording starts on the tick a sensor crosses a level. Previous records are discarded.
+ *
+ * @param S      - trigger sensor (need not be recorded)
+ * @param level  - trigger level in raw counts
+ * @param rising - true: triggers when counts go from below to at/above level, false: from above to at/below
+ */
+void cCaptureBase::arm(cSensorBase *S, UINT16 level, bool rising)
+{
+    if (chanCnt && S)
+    {
+        reset();
+        trigSensor    = S;
+        trigLevel     = level;
+        trigRising    = rising;
+        trigPrevValid = false;
+        state         = CAP_ARMED;
+    }
+}
+
+/**
+ * Start sending the records as telemetry frames (a running capture is stopped). The frames are sent by "run" as the
+ * telemetry TX ring buffer has room. The records are kept, a capture can be dumped again.
+ *
+ * @return - false if there is nothing to dump
+ */
+bool cCaptureBase::dump()
+{
+    stop();
+    if (state != CAP_STOPPED || !tlm)
+    {
+        return(false);
+    }
+
+    dumpNext = 0;
+    infoSent = false;
+    state    = CAP_DUMPING;
+    return(true);
+}
+
+/**
+ * Capture service, call from loop(). Sends one dump frame per call when there is room, never waits.
+ */
+void cCaptureBase::run()
+{
+    if (state != CAP_DUMPING)
+    {
+        return;
+    }
+
+    if (!infoSent)
+    {
+        infoSent = sendInfo();
+    }
+    else if (sendData() && dumpNext >= count)
+    {
+        state = CAP_STOPPED;
+    }
+}
+
+/**
+ * send the info frame
+ *
+ * @return - false if there was no room
+ */
+bool cCaptureBase::sendInfo()
+{
+    UINT8  payload[15 + 8 * CAP_MAX_CHANNELS];
+    UINT8  len = 12, ch;
+    UINT32 raw;
+    float  value;
+
+    if (tlm->getTxFree() < (UINT16)(TLM_HEADER_SIZE + 15 + 8 * chanCnt + TLM_CRC_SIZE))
+    {
+        return(false);
+    }
+
+    payload[0] = chanCnt;
+    payload[1] = CAP_FIELD_BITS;
+    cTelemetryBase::putU16(&payload[2], count);
+    cTelemetryBase::putU32(&payload[4], usFirst);
+    cTelemetryBase::putU32(&payload[8], (UINT32)rate);
+
+    for (ch = 0; ch < chanCnt; ch++)
+    {
+        value = Channels[ch]->getSlope() * (float)(1U << Shifts[ch]);
+        memcpy(&raw, &value, 4);
+        cTelemetryBase::putU32(&payload[len], raw);
+        value = Channels[ch]->getOffset();
+        memcpy(&raw, &value, 4);
+        cTelemetryBase::putU32(&payload[len + 4], raw);
+        len += 8;
+    }
+    payload[len] = timeShift;
+    cTelemetryBase::putU16(&payload[len + 1], clipped);
+    len += 3;
+
+    return(tlm->sendFrame(TLM_FRAME_CAP_INFO, payload, len));
+}
+
+/**
+ * send the next data frame, as many whole records as fit the payload
+ *
+ * @return - false if there was no room
+ */
+bool cCaptureBase::sendData()
+{
+    UINT8  payload[TLM_MAX_PAYLOAD];
+    UINT16 recs, f, fields, r, len;
+
+    recs = CAP_FIELDS(TLM_MAX_PAYLOAD - 2) / recSize;
+    recs = (count - dumpNext) < recs ? count - dumpNext : recs;
+    fields = recs * recSize;
+    len = 2 + (fields * 3 + 1) / 2;
+
+    if (tlm->getTxFree() < TLM_HEADER_SIZE + len + TLM_CRC_SIZE)
+    {
+        return(false);
+    }
+
+    //repack the records from the ring into the payload, oldest first
+    cTelemetryBase::putU16(payload, dumpNext);
+    payload[len - 1] = 0;
+    for (f = 0; f < fields; f++)
+    {
+        r = first + dumpNext + f / recSize;
+        r = r >= capacity ? r - capacity : r;
+        putField(&payload[2], f, getField(buf, r * recSize + f % recSize));
+    }
+
+    if (!tlm->sendFrame(TLM_FRAME_CAP_DATA, payload, (UINT8)len))
+    {
+        return(false);
+    }
+    dumpNext += recs;
+    return(true);
+}
+
+/**
+ * scheduler tick hook trampoline
+ */
+void cCaptureBase::tickHook(void *ctx)
+{
+    ((cCaptureBase *)ctx)->tick();
+}
+
+/**
+ * recording tick, after the sensors of the rate have been read
+ */
+void cCaptureBase::tick()
+{
+    UINT16 value;
+    bool   fire;
+
+    if (state == CAP_ARMED)
+    {
+        value = trigSensor->getCounts();
+        fire  = trigPrevValid && (trigRising ? (trigPrev < trigLevel && value >= trigLevel) :
+                                               (trigPrev > trigLevel && value <= trigLevel));
+        trigPrev      = value;
+        trigPrevValid = true;
+        if (!fire)
+        {
+            return;
+        }
+        state = CAP_RUNNING;
+    }
+
+    if (state == CAP_RUNNING)
+    {
+        record();
+    }
+}
+
+/**
+ * add a record, timestamp delta and the counts of all channels
+ */
+void cCaptureBase::record()
+{
+    UINT32 now = micros(), ticks;
+    UINT16 r, base;
+    UINT8  ch;
+
+    if (count >= capacity)
+    {
+        if (mode == CAP_ONESHOT)
+        {
+            state = CAP_STOPPED;
+            return;
+        }
+
+        //ring, drop the oldest record, the next one becomes the first (its delta is from the dropped one)
+        first = (first + 1 >= capacity) ? 0 : first + 1;
+        usFirst += (UINT32)getField(buf, first * recSize) << timeShift;
+        count--;
+    }
+
+    //time in ticks, the newest timestamp stays on the tick grid of the first record so the ticks do not drift
+    if (count)
+    {
+        ticks   = (now - usLast) >> timeShift;
+        usLast += ticks << timeShift;
+    }
+    else
+    {
+        ticks   = 0;
+        usFirst = now;
+        usLast  = now;
+    }
+
+    r = first + count;
+    r = r >= capacity ? r - capacity : r;
+    base = r * recSize;
+
+    putField(buf, base, clip(ticks));
+    for (ch = 0; ch < chanCnt; ch++)
+    {
+        putField(buf, base + 1 + ch, clip(Channels[ch]->getCounts() >> Shifts[ch]));
+    }
+    count++;
+
+    if (mode == CAP_ONESHOT && count >= capacity)
+    {
+        state = CAP_STOPPED;
+    }
+}
+
+/**
+ * clip a field value to CAP_FIELD_MAX, counting the clipped fields
+ */
+UINT16 cCaptureBase::clip(UINT32 value)
+{
+    if (value > CAP_FIELD_MAX)
+    {
+        clipped += (clipped < 0xFFFF);
+        return(CAP_FIELD_MAX);
+    }
+    return((UINT16)value);
+}
+
+CAP_STATE cCaptureBase::getState()
+{
+    return(state);
+}
+
+/**
+ * @return - number of records held
+ */
+UINT16 cCaptureBase::getRecords()
+{
+    return(count);
+}
+
+/**
+ * @return - number of records the buffer holds with the current channels
+ */
+UINT16 cCaptureBase::getCapacity()
+{
+    return(capacity);
+}
+
+/**
+ * @return - number of fields clipped to CAP_FIELD_MAX since the capture started (also sent in the info frame)
+ */
+UINT16 cCaptureBase::getClipped()
+{
+    return(clipped);
+}
+
+/**
+ * Write 12 bit field "i" of a packed buffer. Fields pair up into 3 bytes, even fields take the low byte and the low nibble
+ * of the middle byte, odd fields the high nibble of the middle byte and the high byte.
+ */
+void cCaptureBase::putField(UINT8 *data, UINT16 i, UINT16 value)
+{
+    UINT8 *p = &data[(i >> 1) * 3];
+
+    if (i & 1)
+    {
+        p[1] = (p[1] & 0x0F) | (UINT8)(value << 4);
+        p[2] = (UINT8)(value >> 4);
+    }
+    else
+    {
+        p[0] = (UINT8)value;
+        p[1] = (p[1] & 0xF0) | ((value >> 8) & 0x0F);
+    }
+}
+
+/**
+ * Read 12 bit field "i" of a packed buffer
+ */
+UINT16 cCaptureBase::getField(const UINT8 *data, UINT16 i)
+{
+    const UINT8 *p = &data[(i >> 1) * 3];
+
+    if (i & 1)
+    {
+        return( (p[1] >> 4) | ((UINT16)p[2] << 4) );
+    }
+    return( p[0] | ((UINT16)(p[1] & 0x0F) << 8) );
+}
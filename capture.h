@@ -0,0 +1,170 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+#include "typedef.h"
+#include "sensor.h"
+#include "telemetry.h"
+
+/**
+ * max number of sensors recorded by a capture, bound by the size of the info frame
+ */
+#define CAP_MAX_CHANNELS 6
+
+/**
+ * records are packed as 12 bit fields (2 fields in 3 bytes): timestamp delta, then the raw counts of each channel
+ */
+#define CAP_FIELD_BITS   12
+#define CAP_FIELD_MAX    0x0FFF
+
+/**
+ * number of 12 bit fields that fit a number of bytes
+ */
+#define CAP_FIELDS(bytes) ((UINT16)(((UINT32)(bytes) * 2) / 3))
+
+/**
+ * capture state
+ */
+enum CAP_STATE
+{
+  CAP_IDLE,       //nothing captured
+  CAP_ARMED,      //waiting for the trigger
+  CAP_RUNNING,    //recording on every tick
+  CAP_STOPPED,    //stopped (full or stop), records held for dump
+  CAP_DUMPING     //records being sent as telemetry frames
+};
+
+/**
+ * what happens when the buffer is full
+ */
+enum CAP_MODE
+{
+  CAP_ONESHOT,    //stop recording
+  CAP_RING        //overwrite the oldest records, keeps the last N until stopped
+};
+
+
+/**
+ * Burst capture engine. Records the raw counts of selected sensors, with timestamps, into a pre-allocated RAM buffer on
+ * every tick of its rate (a cAcquire tick hook, so the counts are the ones just read), for sweeps faster than any serial
+ * link can stream live. The capture is sent afterwards ("dump") as telemetry frames, paced by the room in the telemetry
+ * TX ring buffer so the acquisition never waits.
+ *
+ * Record format, packed 12 bit fields: time since the previous record (0 for the first record), then the counts of each
+ * channel. With 2 channels a record is 4.5 bytes.
+ *    time   - in ticks of 2^timeShift uSecs, the smallest that fits 4x the recording period (1uSec at 1kHz, 16uSecs at 100Hz)
+ *    counts - the sensor counts >> the shift given to addSensor, for sensors with more than 12 bits of counts (the slope
+ *             sent in the info frame is scaled to match)
+ * A field that does not fit (a tick 4 periods late, counts out of range for the shift) is clipped to CAP_FIELD_MAX and
+ * counted (getClipped), the timestamps after a clipped time are short by the excess.
+ *
+ * Dump: one TLM_FRAME_CAP_INFO frame
+ *    UINT8 channels, UINT8 field bits, UINT16 records, UINT32 timestamp of the first record, UINT32 period (uSecs),
+ *    per channel: float slope, float offset (IEEE754, the line equation of the sensor, slope per captured count)
+ *    UINT8 time shift, UINT16 clipped fields
+ * followed by TLM_FRAME_CAP_DATA frames
+ *    UINT16 index of the first record in the frame, packed fields of whole records
+ *
+ * @see cCapture
+ * @author DJK
+ * @version 0.1
+ */
+class cCaptureBase
+{
+private:
+  /**
+   * packed record buffer, owned by the derived class, size in bytes
+   */
+  UINT8        *buf;
+  UINT16        bytes;
+  /**
+   * recorded sensors
+   */
+  cSensorBase  *Channels[CAP_MAX_CHANNELS];
+  UINT8         Shifts[CAP_MAX_CHANNELS];
+  UINT8         chanCnt;
+  /**
+   * telemetry port used for the dump, recording rate and the time field tick (2^timeShift uSecs)
+   */
+  cTelemetryBase *tlm;
+  ACQ_RATE        rate;
+  UINT8           timeShift;
+
+  CAP_STATE     state;
+  CAP_MODE      mode;
+  /**
+   * fields per record, capacity in records, oldest record, number of records held
+   */
+  UINT16        recSize, capacity, first, count;
+  /**
+   * timestamp of the oldest and the newest record
+   */
+  UINT32        usFirst, usLast;
+  /**
+   * number of fields clipped to CAP_FIELD_MAX since the capture started
+   */
+  UINT16        clipped;
+  /**
+   * trigger sensor, level (counts) and edge, last value seen while armed
+   */
+  cSensorBase  *trigSensor;
+  UINT16        trigLevel, trigPrev;
+  bool          trigRising, trigPrevValid;
+  /**
+   * dump progress, next record to send and whether the info frame has gone out
+   */
+  UINT16        dumpNext;
+  bool          infoSent;
+
+  static void   tickHook(void *ctx);
+  void          tick();
+  void          record();
+  void          reset();
+  UINT16        clip(UINT32 value);
+  bool          sendInfo();
+  bool          sendData();
+
+protected:
+  cCaptureBase(UINT8 *storage, UINT16 size, ACQ_RATE tickRate, cTelemetryBase *T);
+
+public:
+  UINT8     addSensor(cSensorBase *S, UINT8 shift = 0);
+  void      setMode(CAP_MODE capMode);
+  void      start();
+  void      stop();
+  void      arm(cSensorBase *S, UINT16 level, bool rising);
+  bool      dump();
+  void      run();
+  CAP_STATE getState();
+  UINT16    getRecords();
+  UINT16    getCapacity();
+  UINT16    getClipped();
+
+  static void   putField(UINT8 *data, UINT16 i, UINT16 value);
+  static UINT16 getField(const UINT8 *data, UINT16 i);
+};
+
+
+/**
+ * capture buffer sized at compile time
+ */
+template <UINT16 Bytes>
+struct CAP_STORAGE
+{
+  static_assert(Bytes >= 6, "capture buffer too small");
+
+  UINT8 capData[Bytes];
+};
+
+/**
+ * Burst capture with the record buffer sized at compile time, this is the class created by the sketch.
+ *
+ * @param Bytes - size of the record buffer in bytes
+ * @see cCaptureBase
+ */
+template <UINT16 Bytes>
+class cCapture : private CAP_STORAGE<Bytes>, public cCaptureBase
+{
+public:
+  cCapture(ACQ_RATE tickRate, cTelemetryBase *T) : cCaptureBase(this->capData, Bytes, tickRate, T) {}
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include "decimate.h"
+
+/**
+ * Decimated sensor constructor, sets up the CIC filter and registers it as a tick hook of the source rate
+ *
+ * @param S        - sensor structure, the rate is the output rate (a multiple of the source rate, up to 255 times)
+ * @param buffers  - FIFO storage, owned by the derived class
+ * @param depth    - avg depth, dtDepth - derivative depth, itDepth - integral depth
+ * @param src      - faster sensor on the same pin (or a decimated sensor, to chain) whose every sample is filtered
+ * @param cicOrder - 1 - DECIM_MAX_ORDER, clipped so that the filter gain fits the registers
+ */
+cDecimSensorBase::cDecimSensorBase(NEW_SENSOR *S, SENSOR_BUFFERS buffers, UINT8 depth, UINT8 dtDepth, UINT8 itDepth,
+                                   cSensorBase *src, UINT8 cicOrder) : cSensorBase(S, buffers, depth, dtDepth, itDepth)
+{
+    UINT32 gain;
+    UINT8  bits, i;
+
+    source  = src;
+    ratio   = 1;
+    outSeq  = 0;
+    readSeq = 0;
+    output  = 0;
+    phase   = 0;
+    exact   = false;
+
+    //an inexact or too large ratio would publish at the wrong rate, pass the source through instead
+    if (source && source->getRate() && (UINT32)getRate() >= (UINT32)source->getRate())
+    {
+        gain  = (UINT32)getRate() / (UINT32)source->getRate();
+        exact = gain <= 0xFF && gain * (UINT32)source->getRate() == (UINT32)getRate();
+        ratio = exact ? gain : 1;
+    }
+
+    //bits of gain per stage, ceil(log2(ratio))
+    for (bits = 0; (1U << bits) < ratio; bits++);
+
+    order = cicOrder < 1 ? 1 : (cicOrder > DECIM_MAX_ORDER ? DECIM_MAX_ORDER : cicOrder);
+    while (order > 1 && DECIM_INPUT_BITS + order * bits > DECIM_REG_BITS)
+    {
+        order--;
+    }
+    fill = order;
+
+    //gain = ratio^order, recip = 2^32 / gain (rounded, from (2^32 - 1) / gain in 32 bits), gain 1 is handled as a pass through
+    for (gain = 1, i = 0; i < order; i++)
+    {
+        gain *= ratio;
+        integ[i] = 0;
+        comb[i]  = 0;
+    }
+    recip = (gain > 1) ? 0xFFFFFFFFUL / gain + (0xFFFFFFFFUL % gain + 1 + gain / 2) / gain : 0;
+
+    if (source)
+    {
+        ::cAcquire::addHook(source->getRate(), cDecimSensorBase::tickHook, this);
+    }
+}
+
+/**
+ * Remove the filter gain, (x * recip + 2^31) >> 32. The 32x32 bit product is formed from four 16x16 bit partial products,
+ * so only 32 bit math is needed (as cSensorBase::scale), the result is the same as the 64 bit product.
+ *
+ * @param x     - comb output
+ * @param recip - 2^32 / gain
+ * @return - rounded high 32 bits of the product
+ */
+static UINT32 mulRecip(UINT32 x, UINT32 recip)
+{
+    UINT32 lo, mid1, mid2, hi, carry;
+
+    lo   = (x & 0xFFFF) * (recip & 0xFFFF);
+    mid1 = (x >> 16)    * (recip & 0xFFFF);
+    mid2 = (x & 0xFFFF) * (recip >> 16);
+    hi   = (x >> 16)    * (recip >> 16);
+
+    //bits 16 - 31 of the product plus the rounding bit, carried into the high word
+    carry = (lo >> 16) + (mid1 & 0xFFFF) + (mid2 & 0xFFFF) + 0x8000;
+
+    return( hi + (mid1 >> 16) + (mid2 >> 16) + (carry >> 16) );
+}
+
+void cDecimSensorBase::tickHook(void *ctx)
+{
+    ((cDecimSensorBase*)ctx)->tick();
+}
+
+/**
+ * filter one source sample, runs after the source sensor has been read
+ */
+void cDecimSensorBase::tick()
+{
+    filter(source->getCounts());
+}
+
+/**
+ * filter a sample, an output every "ratio" samples
+ *
+ * @param in - source counts
+ */
+void cDecimSensorBase::filter(UINT16 in)
+{
+    UINT32 x, y;
+    UINT8  k;
+
+    //integrators, wrap around is intended
+    integ[0] += in;
+    for (k = 1; k < order; k++)
+    {
+        integ[k] += integ[k-1];
+    }
+
+    if (++phase < ratio)
+    {
+        return;
+    }
+    phase = 0;
+
+    //combs at the output rate
+    x = integ[order-1];
+    for (k = 0; k < order; k++)
+    {
+        y       = x - comb[k];
+        comb[k] = x;
+        x       = y;
+    }
+
+    if (fill)
+    {
+        //filter filling, publish the raw sample
+        fill--;
+        output = in;
+    }
+    else
+    {
+        output = recip ? (UINT16)mulRecip(x, recip) : (UINT16)x;
+    }
+    outSeq++;
+}
+
+/**
+ * Take the latest filter output as the sensor reading, the previous reading is repeated if no new output is ready
+ * (keeps the time base, as the free running ADC path of cSensorBase::readSensor)
+ */
+void cDecimSensorBase::readSensor(void)
+{
+    //the output is due on this tick, source ticks were skipped if the filter is part way into one: hold the last source
+    //sample over them to realign the phase with this deadline
+    if (source && phase)
+    {
+        while (phase)
+        {
+            filter(source->getCounts());
+        }
+    }
+
+    if (outSeq != readSeq)
+    {
+        readSeq = outSeq;
+        putSample(output);
+    }
+    else
+    {
+        putSample(getCounts());
+    }
+}
+
+/**
+ * @return - decimation ratio (source samples per output)
+ */
+UINT8 cDecimSensorBase::getRatio(void)
+{
+    return(ratio);
+}
+
+/**
+ * @return - false if the rate is not an exact multiple of the source rate (up to 255 times), the source is passed through
+ */
+bool cDecimSensorBase::isRatioExact(void)
+{
+    return(exact);
+}
+
+/**
+ * @return - CIC order in use (may be clipped from the requested order)
+ */
+UINT8 cDecimSensorBase::getOrder(void)
+{
+    return(order);
+}
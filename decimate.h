@@ -0,0 +1,93 @@
+#ifndef DECIMATE_H
+#define DECIMATE_H
+#include "typedef.h"
+#include "sensor.h"
+
+/**
+ * max CIC order (number of integrator / comb pairs)
+ */
+#define DECIM_MAX_ORDER      4
+#define DECIM_ORDER_DEFAULT  3
+
+/**
+ * CIC register width, the order is clipped so that a 16 bit input plus the filter gain (order * log2(ratio) bits) fits
+ */
+#define DECIM_REG_BITS       32
+#define DECIM_INPUT_BITS     16
+
+
+/**
+ * Decimated sensor: a sensor at a slower rate whose samples are the output of a CIC (cascaded integrator comb) decimation
+ * filter fed with every sample of a faster "source" sensor on the same pin, so one ADC read feeds several output rates and the
+ * slow outputs are anti-aliased rather than picking every Nth sample. Sources may be chained, e.g. 1kHz raw -> 100Hz -> 10Hz.
+ *
+ * The filter runs as a cAcquire tick hook of the source rate (after the source has been read). Integer math only:
+ *    integrators, every source sample:     I[0] += in,  I[k] += I[k-1]                (modulo 2^32, wraparound cancels in the combs)
+ *    combs, every "ratio" source samples:  C[k] = x - x(previous output),  x = I[order-1] for k = 0
+ *    output = C[order-1] / ratio^order                                             (gain removed by reciprocal multiply)
+ * The response is sinc^order, with nulls at every multiple of the output rate, where the aliases of the output fold from.
+ * The first "order" outputs are the filter filling, until then the raw source sample is published. An output is due on
+ * every sensor tick (the rates share a time base), when source ticks were skipped to catch up the last source sample is
+ * held over them at the sensor tick, so the outputs stay on the sensor's deadlines.
+ *
+ * The decimated counts use the sensor's own line equation (NEW_SENSOR slope / offset), so one pin can be published in different
+ * units at each rate. The ratio is the sensor rate / source rate, a rate that is not an exact multiple of the source rate
+ * (or is more than 255 source samples) is rejected: the source is passed through unfiltered and isRatioExact is false.
+ *
+ * @see cDecimSensor
+ * @author DJK
+ * @version 0.1
+ */
+class cDecimSensorBase : public cSensorBase
+{
+private:
+  cSensorBase  *source;
+  /**
+   * filter order, decimation ratio, source samples into the current output, outputs before the filter has filled
+   */
+  UINT8         order, ratio, phase, fill;
+  bool          exact;
+  /**
+   * integrator and comb (previous input) registers
+   */
+  UINT32        integ[DECIM_MAX_ORDER], comb[DECIM_MAX_ORDER];
+  /**
+   * gain removal, output = (C * recip) >> 32 (rounded)
+   */
+  UINT32        recip;
+  /**
+   * latest output and its sequence number, sequence number consumed by readSensor
+   */
+  UINT16        output;
+  UINT8         outSeq, readSeq;
+
+  static void   tickHook(void *ctx);
+  void          tick();
+  void          filter(UINT16 in);
+
+protected:
+  cDecimSensorBase(NEW_SENSOR *S, SENSOR_BUFFERS buffers, UINT8 depth, UINT8 dtDepth, UINT8 itDepth, cSensorBase *src, UINT8 cicOrder);
+
+public:
+  virtual void  readSensor(void);
+  UINT8         getRatio(void);
+  UINT8         getOrder(void);
+  bool          isRatioExact(void);
+};
+
+
+/**
+ * Decimated sensor with FIFO storage sized at compile time, this is the class created by the sketch.
+ *
+ * @param Depth, DtDepth, ItDepth, Features - FIFO depths and optional features as cSensor
+ * @see cDecimSensorBase
+ */
+template <UINT8 Depth, UINT8 DtDepth = 1, UINT8 ItDepth = 1, UINT8 Features = 0>
+class cDecimSensor : private SENSOR_STORAGE<Depth, DtDepth, ItDepth, Features>, public cDecimSensorBase
+{
+public:
+  cDecimSensor(NEW_SENSOR *S, cSensorBase *src, UINT8 cicOrder = DECIM_ORDER_DEFAULT) :
+    cDecimSensorBase(S, this->buffers(), Depth, DtDepth, ItDepth, src, cicOrder) {}
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "derived.h"
+
+/**
+ * Derived sensor constructor
+ *
+ * @param S       - sensor structure, pin PIN_NONE, slope / offset set the resolution and range of the FIFO counts
+ * @param buffers - FIFO storage, owned by the derived class
+ * @param depth   - avg depth, dtDepth - derivative depth, itDepth - integral depth
+ * @param f       - function computing the value from the inputs
+ * @param context - passed to the function
+ */
+cDerivedSensorBase::cDerivedSensorBase(NEW_SENSOR *S, SENSOR_BUFFERS buffers, UINT8 depth, UINT8 dtDepth, UINT8 itDepth,
+                                       DERIVED_FUNC f, void *context) : cSensorBase(S, buffers, depth, dtDepth, itDepth)
+{
+    inCnt = 0;
+    func  = f;
+    ctx   = context;
+}
+
+/**
+ * Add an input, bound by DERIVED_MAX_INPUTS. The input must be read before the derived sensor in a tick (see the
+ * evaluation order): at a faster rate whose period divides the derived period, or at the same rate and created before
+ * it. Any other input would be stale by up to one of its ticks (a non harmonic rate only lands on some derived ticks),
+ * so it is rejected.
+ *
+ * @param S - input sensor, may be another derived sensor
+ * @return - input index (position in the function's "in" array), DERIVED_MAX_INPUTS if the list is full or the input
+ *           is not read before the derived sensor
+ */
+UINT8 cDerivedSensorBase::addInput(cSensorBase *S)
+{
+    UINT8  pos, self;
+    UINT32 period;
+
+    if (!S || S == this || inCnt >= DERIVED_MAX_INPUTS)
+    {
+        return(DERIVED_MAX_INPUTS);
+    }
+
+    //evaluation order, an input at rate NONE is not scheduled (fed by its owner), it holds whatever it was given last
+    pos    = ::cAcquire::getSensorIndex(S);
+    self   = ::cAcquire::getSensorIndex(this);
+    period = (UINT32)S->getRate();
+    if (period && (pos == ACQ_END_OF_LIST || period > (UINT32)getRate() || ((UINT32)getRate() % period) ||
+                   (period == (UINT32)getRate() && pos > self)))
+    {
+        return(DERIVED_MAX_INPUTS);
+    }
+    inputs[inCnt] = S;
+    return(inCnt++);
+}
+
+/**
+ * Scheduler tick: compute the value from the inputs' latest readings and push it into the FIFO as counts
+ */
+void cDerivedSensorBase::readSensor(void)
+{
+    float value = getValue();
+    float data  = 0;
+
+    //to counts through the line equation, rounded and clipped
+    if (m != 0)
+    {
+        data = (value - b) / m + 0.5;
+    }
+    data = data < 0 ? 0 : (data > 65535.0 ? 65535.0 : data);
+
+    putSample((UINT16)data);
+}
+
+/**
+ * compute the value now, unfiltered and at full float precision (not limited by the FIFO counts)
+ *
+ * @return - function of the inputs' latest readings, 0 if there is no function
+ */
+float cDerivedSensorBase::getValue(void)
+{
+    float in[DERIVED_MAX_INPUTS];
+    UINT8 i;
+
+    for (i = 0; i < inCnt; i++)
+    {
+        in[i] = inputs[i]->getReading(false);
+    }
+    return( func ? func(in, inCnt, ctx) : 0.0 );
+}
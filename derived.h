@@ -0,0 +1,67 @@
+#ifndef DERIVED_H
+#define DERIVED_H
+#include "typedef.h"
+#include "sensor.h"
+
+/**
+ * max number of input sensors of a derived sensor
+ */
+#define DERIVED_MAX_INPUTS  4
+
+/**
+ * Function computing a derived value in engineering units from the latest readings of the inputs (in the order added).
+ * "ctx" is the context given to the derived sensor, e.g. a scale factor or an object the inputs do not cover.
+ */
+typedef float (*DERIVED_FUNC)(const float *in, UINT8 n, void *ctx);
+
+
+/**
+ * Derived (virtual) sensor: a channel computed from other sensors, e.g. power = torque * rpm / 9.5488, scheduled by
+ * cAcquire at its own rate like a pin sensor. Every tick the inputs' latest readings are passed to the function, the result
+ * is converted to counts with the sensor's line equation (NEW_SENSOR slope = units per count, offset = units at 0 counts,
+ * clipped to 0 - 0xFFFF) and pushed into the FIFO, so a derived channel has the same average, max/min, derivative, integral
+ * and variance as a raw one. The pin is PIN_NONE.
+ *
+ * Evaluation order: the scheduler runs the rates fastest first and the sensors of a rate in the order they were created, so
+ * a derived sensor created after its inputs is computed right after they are read in the same tick (the rates share a
+ * time base, so a tick lands on one of a faster rate when the faster period divides its period). addInput rejects an
+ * input that would not be read first (a slower or non harmonic rate, or the same rate and created after the derived
+ * sensor). A derived sensor can be the input of another one.
+ *
+ * @see cDerivedSensor
+ * @author DJK
+ * @version 0.1
+ */
+class cDerivedSensorBase : public cSensorBase
+{
+private:
+  cSensorBase  *inputs[DERIVED_MAX_INPUTS];
+  UINT8         inCnt;
+  DERIVED_FUNC  func;
+  void         *ctx;
+
+protected:
+  cDerivedSensorBase(NEW_SENSOR *S, SENSOR_BUFFERS buffers, UINT8 depth, UINT8 dtDepth, UINT8 itDepth, DERIVED_FUNC f, void *context);
+
+public:
+  UINT8         addInput(cSensorBase *S);
+  virtual void  readSensor(void);
+  float         getValue(void);
+};
+
+
+/**
+ * Derived sensor with FIFO storage sized at compile time, this is the class created by the sketch.
+ *
+ * @param Depth, DtDepth, ItDepth, Features - FIFO depths and optional features as cSensor
+ * @see cDerivedSensorBase
+ */
+template <UINT8 Depth, UINT8 DtDepth = 1, UINT8 ItDepth = 1, UINT8 Features = 0>
+class cDerivedSensor : private SENSOR_STORAGE<Depth, DtDepth, ItDepth, Features>, public cDerivedSensorBase
+{
+public:
+  cDerivedSensor(NEW_SENSOR *S, DERIVED_FUNC f, void *context = NULL) :
+    cDerivedSensorBase(S, this->buffers(), Depth, DtDepth, ItDepth, f, context) {}
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include "freq.h"
+
+/**
+ * Frequency sensor constructor, precomputes the integer scale factor from the slope and the pulses per revolution
+ *
+ * @param S        - sensor structure, pin PIN_NONE, slope in RPM (FREQ_SPEED) or uSecs (FREQ_PERIOD) per count
+ * @param buffers  - FIFO storage, owned by the derived class
+ * @param depth    - avg depth, dtDepth - derivative depth, itDepth - integral depth
+ * @param src      - speed input (edge timestamps)
+ * @param freqMode - FREQ_SPEED or FREQ_PERIOD
+ */
+cFreqSensorBase::cFreqSensorBase(NEW_SENSOR *S, SENSOR_BUFFERS buffers, UINT8 depth, UINT8 dtDepth, UINT8 itDepth,
+                                 cSpeed *src, FREQ_MODE freqMode) : cSensorBase(S, buffers, depth, dtDepth, itDepth)
+{
+    float pulses, k;
+
+    source = src;
+    mode   = freqMode;
+    pulses = (src && src->getPulsesRev()) ? src->getPulsesRev() : 1;
+
+    //rev/min = 60e6 / (period * pulses), counts = rev/min / slope
+    k      = (S && S->slope > 0) ? 60000000.0 / (pulses * S->slope) : 0;
+    speedK = k > 4294967295.0 ? 0xFFFFFFFF : (UINT32)(k + 0.5);
+
+    //uSecs/rev = period * pulses, counts = uSecs/rev / slope
+    setScale((S && S->slope > 0) ? pulses / S->slope : 0, 0, &periodK);
+}
+
+/**
+ * Scheduler tick: push the speed (or revolution period) of the input as counts
+ */
+void cFreqSensorBase::readSensor(void)
+{
+    UINT32 period = source ? source->getPeriod() : 0;
+    UINT32 data   = 0;
+
+    if (period)
+    {
+        data = (mode == FREQ_SPEED) ? speedK / period : (UINT32)scale((SINT32)period, &periodK);
+    }
+
+    putSample( data > 0xFFFF ? 0xFFFF : (UINT16)data );
+}
+
+/**
+ * @return - quantity pushed into the FIFO
+ */
+FREQ_MODE cFreqSensorBase::getMode(void)
+{
+    return(mode);
+}
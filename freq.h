@@ -0,0 +1,65 @@
+#ifndef FREQ_H
+#define FREQ_H
+#include "typedef.h"
+#include "sensor.h"
+#include "speed.h"
+
+/**
+ * quantity a frequency sensor pushes into its FIFO
+ */
+enum FREQ_MODE
+{
+  FREQ_SPEED,     //shaft speed, NEW_SENSOR slope in RPM per count (counts = K / period, one division per tick)
+  FREQ_PERIOD     //time per shaft revolution, NEW_SENSOR slope in uSecs per count (multiply and shift, no division)
+};
+
+
+/**
+ * Frequency sensor: the shaft speed (or revolution period) of a cSpeed input as a scheduled sensor, so RPM gets the FIFO
+ * average, max/min, derivative (acceleration) and integral (revolutions) of any other channel. readSensor takes the
+ * averaged pulse period from the edge timestamps (cSpeed::getPeriod, with its zero speed timeout and deceleration
+ * handling) instead of an ADC read, applies the pulses per revolution of the input and pushes the counts:
+ *    FREQ_SPEED:   counts = 60000000 / (period * pulsesRev * slope)      0 when stopped
+ *    FREQ_PERIOD:  counts = period * pulsesRev / slope                   0 when stopped
+ * clipped to 0xFFFF, the slope is chosen for the resolution and full scale (e.g. 0.5 RPM per count = 32767 RPM).
+ * The scale factor is fixed at construction, calibration (setX1Y1 etc.) trims the line on top of it. The pin is PIN_NONE.
+ *
+ * @see cFreqSensor
+ * @author DJK
+ * @version 0.1
+ */
+class cFreqSensorBase : public cSensorBase
+{
+private:
+  cSpeed     *source;
+  FREQ_MODE   mode;
+  /**
+   * FREQ_SPEED: counts = speedK / period, FREQ_PERIOD: counts = scale(period, periodK)
+   */
+  UINT32      speedK;
+  FIX_SCALE   periodK;
+
+protected:
+  cFreqSensorBase(NEW_SENSOR *S, SENSOR_BUFFERS buffers, UINT8 depth, UINT8 dtDepth, UINT8 itDepth, cSpeed *src, FREQ_MODE freqMode);
+
+public:
+  virtual void  readSensor(void);
+  FREQ_MODE     getMode(void);
+};
+
+
+/**
+ * Frequency sensor with FIFO storage sized at compile time, this is the class created by the sketch.
+ *
+ * @param Depth, DtDepth, ItDepth, Features - FIFO depths and optional features as cSensor
+ * @see cFreqSensorBase
+ */
+template <UINT8 Depth, UINT8 DtDepth = 1, UINT8 ItDepth = 1, UINT8 Features = 0>
+class cFreqSensor : private SENSOR_STORAGE<Depth, DtDepth, ItDepth, Features>, public cFreqSensorBase
+{
+public:
+  cFreqSensor(NEW_SENSOR *S, cSpeed *src, FREQ_MODE freqMode = FREQ_SPEED) :
+    cFreqSensorBase(S, this->buffers(), Depth, DtDepth, ItDepth, src, freqMode) {}
+};
+
+#endif
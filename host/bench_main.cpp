@@ -0,0 +1,1182 @@
+/**
+ * Host benchmarks of the hot paths: FIFO math update, scheduler dispatch and the sensor conversions. Every benchmark is
+ * checked against a plain reference implementation before it is timed, and the timings can be compared with a stored
+ * baseline, so an optimization can be shown to help (and a change that slows a path down is caught).
+ *
+ * usage: dyno_bench [-b baseline file] [-w baseline file] [-t tolerance %] [-n ops scale] [-f name filter]
+ *
+ * -b compares with a baseline and fails (exit code 1) if a benchmark is slower by more than the tolerance (default 40%),
+ *    -w writes the timings as a new baseline. Baselines are only comparable on the same machine, see "make bench" (the
+ *    benchmark is built without ACQ_PROFILE whatever PROFILE is). The comparison is made on the time relative to a fixed integer loop timed alongside each run, so a
+ *    machine that is slower as a whole (clock scaling, a busy host) does not read as a regression.
+ *
+ * The benchmark is pinned to the CPU it starts on. The suite is run in BENCH_ROUNDS rounds, each in a new process (-x),
+ * BENCH_REPEATS runs of every benchmark per round: a timing can be stuck slow for a process (code and data placement) or
+ * for a while on a busy machine, another round catches it fast. A benchmark slower than the baseline gets more rounds
+ * before it is a regression. Timings are the best (min) of all runs, in host ns and cycles (TSC, x86 only) per operation:
+ *    fifo_*      one cFIFOMath update, per depth and derivative mode. *_blkN: per sample of updateBlock with N sample blocks,
+ *                *_timed_*: timed fifo update(data, delta) with a jittered sample time
+ *    dispatch_*  one scheduler call (1kHz tick) with N sensors, all at 1kHz or a 1kHz/100Hz/10Hz/1Hz mix (includes the
+ *                sensors' FIFO update, the virtual clock does not move inside a tick so the ticks never miss)
+ *    convert_*   one sample conversion, float line, Q16 line, Q16 calibration table
+ *    sensor_*    one sample of a timed sensor read on time (update with the measured time, float derivative and integral),
+ *                checked against an untimed sensor fed the same samples
+ *
+ * @author DJK
+ * @version 0.1
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/wait.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "sensor.h"
+#include "caltable.h"
+
+//rounds of the whole suite and runs of each benchmark per round, the fastest of all is reported
+#define BENCH_ROUNDS     5
+#define BENCH_REPEATS    5
+//more rounds of a benchmark that reads slower than the baseline before it is a regression, spread over a few seconds
+#define BENCH_RECHECKS   10
+#define BENCH_RECHECK_MS 500
+//default operations per run (scaled by -n) and regression tolerance in percent
+#define BENCH_OPS        200000
+#define BENCH_TOLERANCE  40.0
+//differences below this are timer noise, never a regression
+#define BENCH_MIN_NS     0.5
+//iterations of the speed reference loop per run
+#define BENCH_CAL_OPS    20000
+//max number of benchmarks / baseline entries
+#define BENCH_MAX        64
+
+struct BENCH_RESULT
+{
+    char   name[32];
+    double ns, cycles;
+    /**
+     * time per operation relative to the speed reference loop
+     */
+    double rel;
+    bool   ok;
+};
+
+static BENCH_RESULT Results[BENCH_MAX];
+static int          resultCnt;
+static double       opsScale = 1.0;
+static const char  *filter;
+
+//results the compiler must not drop
+static volatile UINT32 sink;
+
+
+static double wallNs(void)
+{
+    struct timespec T;
+
+    clock_gettime(CLOCK_MONOTONIC, &T);
+    return( T.tv_sec * 1e9 + T.tv_nsec );
+}
+
+static UINT64 cycleCount(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return( __rdtsc() );
+#else
+    return( 0 );
+#endif
+}
+
+static bool wanted(const char *name)
+{
+    return( !filter || strstr(name, filter) );
+}
+
+static UINT32 benchOps(UINT32 ops)
+{
+    ops = (UINT32)(ops * opsScale);
+    return( ops ? ops : 1 );
+}
+
+/**
+ * add the result of a round, a benchmark already run in an earlier round keeps the best timings (and fails if any round did)
+ */
+static void addResult(const char *name, double ns, double cycles, double rel, bool ok)
+{
+    BENCH_RESULT *R;
+    int r;
+
+    for (r = 0; r < resultCnt && strcmp(Results[r].name, name); r++)
+    {
+    }
+    if (r < resultCnt)
+    {
+        R = &Results[r];
+        R->ns     = ns < R->ns ? ns : R->ns;
+        R->cycles = cycles < R->cycles ? cycles : R->cycles;
+        R->rel    = rel < R->rel ? rel : R->rel;
+        R->ok     = R->ok && ok;
+        return;
+    }
+    if (resultCnt >= BENCH_MAX)
+    {
+        return;
+    }
+    R = &Results[resultCnt++];
+    snprintf(R->name, sizeof(R->name), "%s", name);
+    R->ns     = ns;
+    R->cycles = cycles;
+    R->rel    = rel;
+    R->ok     = ok;
+}
+
+/**
+ * pin to the CPU the benchmark started on (inherited by the dispatch children), so runs are not migrated between cores
+ */
+static void pinCpu(void)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    int       cpu = sched_getcpu();
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu < 0 ? 0 : cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set))
+    {
+        fprintf(stderr, "cannot pin to cpu %d, timings may be noisier\n", cpu);
+    }
+#endif
+}
+
+/**
+ * speed reference, a mix of the work in the benchmarks: integer math, small table loads and stores, data dependent branches
+ */
+static void speedLoop(void)
+{
+    static UINT16 table[64];
+    UINT32 x = sink, i, hi = 0;
+
+    for (i = 0; i < BENCH_CAL_OPS; i++)
+    {
+        x = x * 1103515245UL + 12345;
+        table[i & 63] = (UINT16)(x >> 16);
+        if (table[(x >> 8) & 63] > table[hi])
+        {
+            hi = (x >> 8) & 63;
+        }
+    }
+    sink = x + hi;
+}
+
+/**
+ * time "ops" calls of a benchmark body, best of BENCH_REPEATS, per operation. The speed reference loop is timed before
+ * every run, "rel" is the body time over the reference time (best of each).
+ */
+template <class T>
+static void timeOps(T &body, UINT32 ops, double *ns, double *cycles, double *rel)
+{
+    double t, bestNs = 1e30, bestCycles = 1e30, bestCal = 1e30;
+    UINT64 c;
+    int    r;
+
+    for (r = 0; r < BENCH_REPEATS; r++)
+    {
+        t = wallNs();
+        speedLoop();
+        t = wallNs() - t;
+        bestCal = t < bestCal ? t : bestCal;
+
+        t = wallNs();
+        c = cycleCount();
+        body.run(ops);
+        c = cycleCount() - c;
+        t = wallNs() - t;
+
+        bestNs     = t < bestNs ? t : bestNs;
+        bestCycles = c < bestCycles ? c : bestCycles;
+    }
+    *ns     = bestNs / ops;
+    *cycles = bestCycles / ops;
+    *rel    = bestNs / bestCal;
+}
+
+/**
+ * test input, a deterministic pseudo random 10 bit sequence with slow trends so the max/min deques see both runs and noise
+ */
+static UINT16 sample(UINT32 i)
+{
+    UINT32 h = i * 2654435761UL;
+
+    return( (UINT16)((512 + ((i >> 4) & 0xFF) + ((h >> 24) & 0x3F)) & 0x3FF) );
+}
+
+/**
+ * test sample time of a timed fifo, a 1kHz tick (uSecs) with up to 128uS of jitter
+ */
+static UINT16 tick(UINT32 i)
+{
+    UINT32 h = (i + 7) * 2246822519UL;
+
+    return( (UINT16)(1000 - 64 + (h >> 25)) );
+}
+
+
+/******************************************************************************
+ * FIFO math
+ ******************************************************************************/
+
+/**
+ * FIFO under test, exposes the results
+ */
+template <UINT8 Depth, UINT8 DtDepth, UINT8 ItDepth, UINT8 Features>
+class cBenchFifo : public cFIFOMath<Depth, DtDepth, ItDepth, Features>
+{
+public:
+    void   put(UINT16 data)               { this->update(data); }
+    void   put(UINT16 data, UINT16 delta) { this->update(data, delta); }
+    void   putBlock(const UINT16 *s, UINT16 n) { this->updateBlock(s, n); }
+    FIFO_DT_MODE setMode(FIFO_DT_MODE mode) { return(this->setDerivativeMode(mode)); }
+    UINT16 getAvg()                       { return(this->avg); }
+    UINT16 getMax()                       { return(this->max); }
+    UINT16 getMin()                       { return(this->min); }
+    SINT32 getDerivN()                    { return(this->derivN); }
+    UINT32 getIntegN()                    { return(this->integN); }
+    UINT64 getSumSq()                     { return(cFIFOMathBase::getSumSq()); }
+    SINT64 getTimedN()                    { return(this->timed->derivN); }
+    SINT64 getTimedDiv()                  { return(this->timed->derivDiv); }
+    UINT64 getTimedIntegN()               { return(this->timed->integN); }
+    UINT32 getTimedIntegTime()            { return(this->timed->integTime); }
+
+    /**
+     * same results as another fifo
+     */
+    template <class F>
+    bool same(F &R)
+    {
+        return( getAvg() == R.getAvg() && getMax() == R.getMax() && getMin() == R.getMin() && getDerivN() == R.getDerivN() &&
+                getIntegN() == R.getIntegN() && getSumSq() == R.getSumSq() );
+    }
+};
+
+/**
+ * reference FIFO math, recomputed from the full history on every sample (samples before the first read as 0, as in the FIFO)
+ */
+struct REF_FIFO
+{
+    UINT8  depth, dtDepth, itDepth;
+    FIFO_DT_MODE mode;
+    UINT16 hist[MAX_FIFO_SIZE * 4], times[MAX_FIFO_SIZE * 4];
+    UINT32 n;
+    SINT32 derivN;
+    UINT32 integN;
+    /**
+     * timed: slope timedN / timedDiv in counts per tick, integral sum(y * dt) over sum(dt)
+     */
+    SINT64 timedN, timedDiv;
+    UINT64 timedIntegN;
+    UINT32 timedIntegTime;
+
+    UINT16 at(UINT32 back)
+    {
+        return( back < n ? hist[(n - 1 - back) % (MAX_FIFO_SIZE * 4)] : 0 );
+    }
+
+    UINT16 dtAt(UINT32 back)
+    {
+        return( back < n ? times[(n - 1 - back) % (MAX_FIFO_SIZE * 4)] : 0 );
+    }
+
+    /**
+     * timed results over the sample times, exact integer sums. LSQ times t relative to the newest sample
+     */
+    void putTimed(UINT16 data, UINT16 delta)
+    {
+        UINT32 k;
+        SINT64 t = 0, st = 0, stt = 0, sty = 0, sy = 0, L = dtDepth;
+
+        put(data);
+        times[(n - 1) % (MAX_FIFO_SIZE * 4)] = delta;
+
+        if (dtDepth && n >= dtDepth && mode == FIFO_DT_LSQ)
+        {
+            for (k = 0; k < dtDepth; t -= dtAt(k), k++)
+            {
+                st  += t;
+                stt += t * t;
+                sty += t * at(k);
+                sy  += at(k);
+            }
+            timedN   = L * sty - st * sy;
+            timedDiv = L * stt - st * st;
+        }
+        else if (dtDepth && n >= dtDepth)
+        {
+            for (k = 0, timedDiv = 0; k < dtDepth; k++)
+            {
+                timedDiv += dtAt(k);
+            }
+            timedN = (SINT32)data - (SINT32)at(dtDepth);
+        }
+        for (k = 0, timedIntegN = 0, timedIntegTime = 0; k < itDepth; k++)
+        {
+            timedIntegN    += (UINT32)at(k) * dtAt(k);
+            timedIntegTime += dtAt(k);
+        }
+    }
+
+    void put(UINT16 data)
+    {
+        UINT32 k;
+        SINT32 num = 0;
+        UINT32 total = 0;
+
+        hist[n % (MAX_FIFO_SIZE * 4)] = data;
+        times[n % (MAX_FIFO_SIZE * 4)] = 0;
+        n++;
+
+        if (dtDepth && n >= dtDepth)
+        {
+            if (mode == FIFO_DT_LSQ)
+            {
+                //sum over the window, j = 0 oldest
+                for (k = 0; k < dtDepth; k++)
+                {
+                    num += (SINT32)(2 * (dtDepth - 1 - k) - (dtDepth - 1)) * at(k);
+                }
+                derivN = num;
+            }
+            else
+            {
+                derivN = (SINT32)data - (SINT32)at(dtDepth);
+            }
+        }
+        if (itDepth && n >= itDepth)
+        {
+            for (k = 0; k < itDepth; k++)
+            {
+                total += at(k);
+            }
+            integN = total;
+        }
+    }
+
+    UINT32 count()
+    {
+        return( n < depth ? n : depth );
+    }
+
+    UINT16 avg()
+    {
+        UINT32 k, total = 0;
+
+        for (k = 0; k < count(); k++)
+        {
+            total += at(k);
+        }
+        return( (UINT16)(total / count()) );
+    }
+
+    UINT16 max()
+    {
+        UINT32 k;
+        UINT16 v = 0;
+
+        for (k = 0; k < count(); k++)
+        {
+            v = at(k) > v ? at(k) : v;
+        }
+        return(v);
+    }
+
+    UINT16 min()
+    {
+        UINT32 k;
+        UINT16 v = 0xFFFF;
+
+        for (k = 0; k < count(); k++)
+        {
+            v = at(k) < v ? at(k) : v;
+        }
+        return(v);
+    }
+
+    UINT64 sumSq()
+    {
+        UINT32 k;
+        UINT64 total = 0;
+
+        for (k = 0; k < count(); k++)
+        {
+            total += (UINT64)at(k) * at(k);
+        }
+        return(total);
+    }
+};
+
+template <UINT8 Depth, UINT8 DtDepth, UINT8 ItDepth, UINT8 Features>
+struct FIFO_BODY
+{
+    cBenchFifo<Depth, DtDepth, ItDepth, Features> F;
+
+    void run(UINT32 ops)
+    {
+        UINT32 i;
+
+        for (i = 0; i < ops; i++)
+        {
+            F.put(sample(i));
+        }
+        sink = F.getAvg() + F.getDerivN() + F.getIntegN();
+    }
+};
+
+template <UINT8 Depth, UINT8 DtDepth, UINT8 ItDepth, UINT8 Features>
+static void benchFifo(FIFO_DT_MODE mode)
+{
+    FIFO_BODY<Depth, DtDepth, ItDepth, Features> *B = new FIFO_BODY<Depth, DtDepth, ItDepth, Features>;
+    REF_FIFO *R = new REF_FIFO;
+    char     name[32];
+    double   ns, cycles, rel;
+    bool     ok = true;
+    UINT32   i;
+
+    snprintf(name, sizeof(name), "fifo_d%u_dt%u_%s", Depth, DtDepth, mode == FIFO_DT_LSQ ? "lsq" : "diff");
+    if (!wanted(name))
+    {
+        delete B;
+        delete R;
+        return;
+    }
+
+    //check every result against the reference over several fills of the window
+    memset(R, 0, sizeof(*R));
+    R->depth   = Depth;
+    R->dtDepth = DtDepth;
+    R->itDepth = ItDepth;
+    R->mode    = mode;
+    if (B->F.setMode(mode) != mode)
+    {
+        fprintf(stderr, "%s: derivative mode not in effect\n", name);
+        ok = false;
+    }
+    for (i = 0; i < 4000 && ok; i++)
+    {
+        B->F.put(sample(i));
+        R->put(sample(i));
+        ok = B->F.getAvg() == R->avg() && B->F.getMax() == R->max() && B->F.getMin() == R->min() &&
+             B->F.getDerivN() == R->derivN && B->F.getIntegN() == R->integN && B->F.getSumSq() == R->sumSq();
+    }
+    if (!ok && i)
+    {
+        fprintf(stderr, "%s: mismatch at sample %lu\n", name, (unsigned long)(i - 1));
+    }
+
+    timeOps(*B, benchOps(BENCH_OPS), &ns, &cycles, &rel);
+    addResult(name, ns, cycles, rel, ok);
+
+    delete B;
+    delete R;
+}
+
+/**
+ * test input in blocks, the sample sequence repeated every BLOCK_DATA samples (a multiple of the block sizes)
+ */
+#define BLOCK_DATA 1024
+
+template <UINT8 Depth, UINT8 DtDepth, UINT8 ItDepth, UINT8 Features, UINT16 Block>
+struct BLOCK_BODY
+{
+    cBenchFifo<Depth, DtDepth, ItDepth, Features> F;
+    UINT16 data[BLOCK_DATA];
+
+    void run(UINT32 ops)
+    {
+        UINT32 i;
+
+        for (i = 0; i < ops; i += Block)
+        {
+            F.putBlock(&data[i % BLOCK_DATA], (ops - i < Block) ? (UINT16)(ops - i) : Block);
+        }
+        sink = F.getAvg() + F.getDerivN() + F.getIntegN();
+    }
+};
+
+/**
+ * updateBlock, per sample. Checked against a fifo fed the same samples one at a time with update()
+ */
+template <UINT8 Depth, UINT8 DtDepth, UINT8 ItDepth, UINT8 Features, UINT16 Block>
+static void benchBlock(FIFO_DT_MODE mode)
+{
+    BLOCK_BODY<Depth, DtDepth, ItDepth, Features, Block> *B = new BLOCK_BODY<Depth, DtDepth, ItDepth, Features, Block>;
+    cBenchFifo<Depth, DtDepth, ItDepth, Features> *R = new cBenchFifo<Depth, DtDepth, ItDepth, Features>;
+    char     name[32];
+    double   ns, cycles, rel;
+    bool     ok = true;
+    UINT32   i, j, k;
+
+    snprintf(name, sizeof(name), "fifo_d%u_dt%u_%s_blk%u", Depth, DtDepth, mode == FIFO_DT_LSQ ? "lsq" : "diff", Block);
+    if (!wanted(name))
+    {
+        delete B;
+        delete R;
+        return;
+    }
+
+    for (i = 0; i < BLOCK_DATA; i++)
+    {
+        B->data[i] = sample(i);
+    }
+
+    //blocks of every length from 1 to Block in turn, so the blocks start and wrap the fifo at every position
+    B->F.setMode(mode);
+    R->setMode(mode);
+    for (i = 0, k = 1; i + k <= BLOCK_DATA && ok; i += k, k = (k % Block) + 1)
+    {
+        B->F.putBlock(&B->data[i], (UINT16)k);
+        for (j = 0; j < k; j++)
+        {
+            R->put(B->data[i + j]);
+        }
+        ok = B->F.same(*R);
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "%s: mismatch\n", name);
+    }
+
+    timeOps(*B, benchOps(BENCH_OPS), &ns, &cycles, &rel);
+    addResult(name, ns, cycles, rel, ok);
+
+    delete B;
+    delete R;
+}
+
+template <UINT8 Depth, UINT8 DtDepth, UINT8 ItDepth, UINT8 Features>
+struct TIMED_FIFO_BODY
+{
+    cBenchFifo<Depth, DtDepth, ItDepth, Features> F;
+
+    void run(UINT32 ops)
+    {
+        UINT32 i;
+
+        for (i = 0; i < ops; i++)
+        {
+            F.put(sample(i), tick(i));
+        }
+        sink = F.getAvg() + (UINT32)F.getTimedN() + (UINT32)F.getTimedIntegN();
+    }
+};
+
+/**
+ * timed fifo update(data, delta), the derivative and integral over the measured times checked against the reference
+ * recomputed from the sample times (exact, the 64 bit sums are integers)
+ */
+template <UINT8 Depth, UINT8 DtDepth, UINT8 ItDepth>
+static void benchFifoTimed(FIFO_DT_MODE mode)
+{
+    TIMED_FIFO_BODY<Depth, DtDepth, ItDepth, FIFO_TIMED | FIFO_LSQ> *B = new TIMED_FIFO_BODY<Depth, DtDepth, ItDepth, FIFO_TIMED | FIFO_LSQ>;
+    REF_FIFO *R = new REF_FIFO;
+    char     name[32];
+    double   ns, cycles, rel;
+    bool     ok = true;
+    UINT32   i;
+
+    snprintf(name, sizeof(name), "fifo_d%u_dt%u_timed_%s", Depth, DtDepth, mode == FIFO_DT_LSQ ? "lsq" : "diff");
+    if (!wanted(name))
+    {
+        delete B;
+        delete R;
+        return;
+    }
+
+    memset(R, 0, sizeof(*R));
+    R->depth   = Depth;
+    R->dtDepth = DtDepth;
+    R->itDepth = ItDepth;
+    R->mode    = mode;
+    B->F.setMode(mode);
+    for (i = 0; i < 4000 && ok; i++)
+    {
+        B->F.put(sample(i), tick(i));
+        R->putTimed(sample(i), tick(i));
+        ok = B->F.getAvg() == R->avg() && B->F.getTimedN() == R->timedN && B->F.getTimedDiv() == R->timedDiv &&
+             B->F.getTimedIntegN() == R->timedIntegN && B->F.getTimedIntegTime() == R->timedIntegTime;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "%s: mismatch at sample %lu\n", name, (unsigned long)(i - 1));
+    }
+
+    timeOps(*B, benchOps(BENCH_OPS), &ns, &cycles, &rel);
+    addResult(name, ns, cycles, rel, ok);
+
+    delete B;
+    delete R;
+}
+
+
+/******************************************************************************
+ * Scheduler dispatch
+ ******************************************************************************/
+
+/**
+ * scheduled sensor, pushes a test sample on every read and counts its reads
+ */
+class cBenchSensor : public cSensor<8, 1, 1>
+{
+public:
+    UINT32 reads;
+
+    cBenchSensor(NEW_SENSOR *S) : cSensor<8, 1, 1>(S)
+    {
+        reads = 0;
+    }
+
+    void readSensor()
+    {
+        putSample(sample(reads++));
+    }
+
+    /**
+     * convert a sample as "readSensor" does (not SENSOR_CACHED, so every read converts)
+     */
+    float convert(UINT16 data)
+    {
+        counts = data;
+        return( getReading(false) );
+    }
+
+    Q16 convertQ16(UINT16 data)
+    {
+        counts = data;
+        return( getReadingQ16(false) );
+    }
+};
+
+struct DISPATCH_BODY
+{
+    void run(UINT32 ops)
+    {
+        UINT32 i;
+
+        for (i = 0; i < ops; i++)
+        {
+            simAdvance(1000);
+            cAcquire::runAcquisition();
+        }
+    }
+};
+
+/**
+ * Time the scheduler with a set of sensors. The scheduler tables are static and sensors can not be removed, so each set
+ * is built and run in a child process, the result is passed back through a pipe.
+ */
+static void benchDispatch(UINT8 sensors, bool mixed)
+{
+    static const ACQ_RATE mix[4] = {_1000Hz_Rate, _100Hz_Rate, _10Hz_Rate, _1Hz_Rate};
+    NEW_SENSOR    def = {"Bench", "Counts", PIN_0, 1.0, 0.0, _1000Hz_Rate};
+    cBenchSensor *S[MAX_NUM_SENSORS];
+    DISPATCH_BODY B;
+    BENCH_RESULT  R;
+    char     name[32];
+    int      fd[2];
+    pid_t    pid;
+    UINT32   ops, ticks, i;
+    bool     ok = true;
+
+    snprintf(name, sizeof(name), "dispatch_%u_%s", sensors, mixed ? "mixed" : "1khz");
+    if (!wanted(name) || pipe(fd))
+    {
+        return;
+    }
+
+    fflush(stdout);
+    if ((pid = fork()) == 0)
+    {
+        close(fd[0]);
+        simSetTime(0);
+        for (i = 0; i < sensors; i++)
+        {
+            def.rate = mixed ? mix[i % 4] : _1000Hz_Rate;
+            S[i] = new cBenchSensor(&def);
+        }
+        cAcquire::runAcquisition();
+
+        //every sensor is read once per period of its rate, the 1Hz ones get a whole number of seconds
+        ops   = benchOps(BENCH_OPS / 4);
+        ops   = ops < 1000 ? 1000 : ops - ops % 1000;
+        timeOps(B, ops, &R.ns, &R.cycles, &R.rel);
+        ticks = ops * BENCH_REPEATS;
+        for (i = 0; i < sensors; i++)
+        {
+            ok = ok && S[i]->reads == ticks / (S[i]->getRate() / 1000);
+        }
+        R.ok = ok && cAcquire::getMissed(_1000Hz_Rate) == 0;
+        if (write(fd[1], &R, sizeof(R)) != sizeof(R))
+        {
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    close(fd[1]);
+    memset(&R, 0, sizeof(R));
+    if (pid < 0 || read(fd[0], &R, sizeof(R)) != sizeof(R))
+    {
+        R.ok = false;
+    }
+    close(fd[0]);
+    if (pid > 0)
+    {
+        waitpid(pid, NULL, 0);
+    }
+    addResult(name, R.ns, R.cycles, R.rel, R.ok);
+}
+
+
+/******************************************************************************
+ * Conversions
+ ******************************************************************************/
+
+struct CONVERT_BODY
+{
+    cBenchSensor *S;
+    bool          fixed;
+
+    void run(UINT32 ops)
+    {
+        UINT32 i, total = 0;
+        float  f = 0;
+
+        if (fixed)
+        {
+            for (i = 0; i < ops; i++)
+            {
+                total += S->convertQ16(i & 0x3FF);
+            }
+        }
+        else
+        {
+            for (i = 0; i < ops; i++)
+            {
+                f += S->convert(i & 0x3FF);
+            }
+        }
+        sink = total + (UINT32)f;
+    }
+};
+
+/**
+ * reference calibration curve, linear between the points
+ */
+static double refCurve(const CAL_POINT *P, UINT8 n, UINT16 x)
+{
+    UINT8 i;
+
+    for (i = 1; i < n - 1 && x > P[i].x; i++)
+    {
+    }
+    return( P[i-1].y + (P[i].y - P[i-1].y) * ((double)x - P[i-1].x) / ((double)P[i].x - P[i-1].x) );
+}
+
+static void benchConvert(void)
+{
+    //load cell line (sketch default), and a non linear table with its points on segment boundaries (exact in the table)
+    static const CAL_POINT points[5] = {{0, -2.0}, {256, 0.5}, {512, 2.0}, {768, 2.8}, {1023, 3.1}};
+    NEW_SENSOR      def = {"Bench", "Nm", PIN_0, 0.00978, -1.5, NONE};
+    cBenchSensor    Line(&def), Table(&def);
+    cCalTable<5, 4> Cal;
+    CONVERT_BODY    B;
+    double   ns, cycles, rel, ref, err;
+    UINT16   x;
+    UINT8    i;
+    bool     ok;
+
+    Table.setCalibration(&Cal);
+    for (i = 0; i < 5; i++)
+    {
+        Table.setCalPoint(i, points[i].x, points[i].y);
+    }
+
+    //float line, the same expression as the reference
+    if (wanted("convert_line_float"))
+    {
+        for (x = 0, ok = true; x < 1024 && ok; x++)
+        {
+            ok = Line.convert(x) == (float)(x * Line.getSlope() + Line.getOffset());
+        }
+        B.S = &Line;
+        B.fixed = false;
+        timeOps(B, benchOps(BENCH_OPS), &ns, &cycles, &rel);
+        addResult("convert_line_float", ns, cycles, rel, ok);
+    }
+
+    //Q16 line, within the precision of the fixed point scale (1/65536 of the reading) and 2 counts of rounding
+    if (wanted("convert_line_q16"))
+    {
+        for (x = 0, ok = true; x < 1024 && ok; x++)
+        {
+            ref = (x * (double)Line.getSlope() + Line.getOffset()) * 65536.0;
+            err = fabs(Line.convertQ16(x) - ref);
+            ok  = err <= fabs(ref) / 65536.0 + 2.0;
+        }
+        B.S = &Line;
+        B.fixed = true;
+        timeOps(B, benchOps(BENCH_OPS), &ns, &cycles, &rel);
+        addResult("convert_line_q16", ns, cycles, rel, ok);
+    }
+
+    //Q16 table, interpolated in integer math, same precision
+    if (wanted("convert_table_q16"))
+    {
+        for (x = 0, ok = true; x < 1024 && ok; x++)
+        {
+            ref = refCurve(points, 5, x) * 65536.0;
+            err = fabs(Table.convertQ16(x) - ref);
+            ok  = err <= fabs(ref) / 65536.0 + 2.0;
+        }
+        B.S = &Table;
+        B.fixed = true;
+        timeOps(B, benchOps(BENCH_OPS), &ns, &cycles, &rel);
+        addResult("convert_table_q16", ns, cycles, rel, ok);
+    }
+}
+
+
+/******************************************************************************
+ * Timed sensor
+ ******************************************************************************/
+
+/**
+ * sensor with a timed or untimed FIFO, a sample pushed as the scheduler would
+ */
+template <UINT8 Features>
+class cBenchTimed : public cSensor<10, 5, 10, Features>
+{
+public:
+    cBenchTimed(NEW_SENSOR *S) : cSensor<10, 5, 10, Features>(S) {}
+
+    void put(UINT16 data) { this->putSample(data); }
+};
+
+struct TIMED_BODY
+{
+    cBenchTimed<FIFO_TIMED | FIFO_LSQ> *S;
+    UINT32 n;
+
+    void run(UINT32 ops)
+    {
+        UINT32 i;
+        float  f = 0;
+
+        for (i = 0; i < ops; i++, n++)
+        {
+            simAdvance(1000);
+            S->put(sample(n));
+            f += S->getDerivative() + S->getIntegral();
+        }
+        sink = (UINT32)f;
+    }
+};
+
+/**
+ * float results agree within float rounding, Q16 within the precision of the fixed point scale and 2 counts of rounding
+ */
+static bool agrees(float f, float ref, Q16 q, Q16 qRef)
+{
+    return( fabs(f - ref) <= fabs(ref) * 1e-5 + 1e-6 && fabs((double)q - qRef) <= fabs((double)qRef) / 65536.0 + 2.0 );
+}
+
+static void benchTimed(FIFO_DT_MODE mode, const char *name)
+{
+    //offset so the integral shows it is held over every sample period, as the timed FIFO integrates it
+    NEW_SENSOR         def = {"Bench", "Nm", PIN_0, 0.00978, -1.5, _1000Hz_Rate};
+    cBenchTimed<FIFO_TIMED | FIFO_LSQ> Timed(&def);
+    cBenchTimed<FIFO_LSQ>              Nominal(&def);
+    TIMED_BODY B;
+    double     ns, cycles, rel;
+    bool       ok = true;
+    UINT32     i;
+
+    if (!wanted(name))
+    {
+        return;
+    }
+
+    //samples on time, the measured times are the nominal spacing. The untimed integral is 0 until the FIFO fills
+    Timed.setDerivativeMode(mode);
+    Nominal.setDerivativeMode(mode);
+    for (i = 0; i < 2000 && ok; i++)
+    {
+        simAdvance(1000);
+        Timed.put(sample(i));
+        Nominal.put(sample(i));
+        ok = i < 10 || (agrees(Timed.getDerivative(), Nominal.getDerivative(), Timed.getDerivativeQ16(), Nominal.getDerivativeQ16()) &&
+                        agrees(Timed.getIntegral(), Nominal.getIntegral(), Timed.getIntegralQ16(), Nominal.getIntegralQ16()));
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "%s: mismatch at sample %lu\n", name, (unsigned long)(i - 1));
+    }
+
+    B.S = &Timed;
+    B.n = i;
+    timeOps(B, benchOps(BENCH_OPS), &ns, &cycles, &rel);
+    addResult(name, ns, cycles, rel, ok);
+}
+
+
+/******************************************************************************
+ * Baseline
+ ******************************************************************************/
+
+static bool spawnRound(char **argv);
+
+/**
+ * @return - true if a result is slower than its baseline by more than the tolerance (relative to the speed reference)
+ *           and by more than timer noise
+ */
+static bool slower(const BENCH_RESULT *R, double rel, double tolerance)
+{
+    //baseline time at the present machine speed
+    double expect = rel * R->ns / R->rel;
+
+    return( R->rel > rel * (1.0 + tolerance / 100.0) && R->ns - expect > BENCH_MIN_NS );
+}
+
+/**
+ * Compare the results with a baseline file, a line per benchmark: name, ns/op, time relative to the speed reference.
+ * A benchmark that reads slower is run again, up to BENCH_RECHECKS more rounds BENCH_RECHECK_MS apart (best timing kept),
+ * a shared machine can be slow for seconds at a time. It is a regression only if it is still slower.
+ *
+ * @param pass - options passed on to the rounds (spawnRound)
+ * @return - number of regressions, -1 if the file can not be read
+ */
+static int checkBaseline(const char *path, double tolerance, char **pass)
+{
+    FILE  *in = fopen(path, "r");
+    char   name[32];
+    const char *all = filter;
+    double ns, rel, expect;
+    int    r, k, regressions = 0;
+
+    if (!in)
+    {
+        return(-1);
+    }
+    while (fscanf(in, "%31s %lf %lf", name, &ns, &rel) == 3)
+    {
+        for (r = 0; r < resultCnt && strcmp(Results[r].name, name) && Results[r].rel > 0; r++)
+        {
+        }
+        if (r >= resultCnt || rel <= 0)
+        {
+            continue;
+        }
+
+        for (k = 0, filter = name; k < BENCH_RECHECKS && slower(&Results[r], rel, tolerance); k++)
+        {
+            usleep(BENCH_RECHECK_MS * 1000);
+            spawnRound(pass);
+        }
+        filter = all;
+
+        if (slower(&Results[r], rel, tolerance))
+        {
+            //baseline time at the present machine speed
+            expect = rel * Results[r].ns / Results[r].rel;
+            printf("REGRESSION %s: %.2f ns/op, baseline %.2f ns/op (%.2f at this speed, +%.0f%%)\n", name,
+                   Results[r].ns, ns, expect, (Results[r].rel / rel - 1.0) * 100.0);
+            regressions++;
+        }
+    }
+    fclose(in);
+    return(regressions);
+}
+
+static bool writeBaseline(const char *path)
+{
+    FILE *out = fopen(path, "w");
+    int   r;
+
+    if (!out)
+    {
+        return(false);
+    }
+    for (r = 0; r < resultCnt; r++)
+    {
+        fprintf(out, "%s %.2f %.6f\n", Results[r].name, Results[r].ns, Results[r].rel);
+    }
+    return( fclose(out) == 0 );
+}
+
+/**
+ * one round of every benchmark, dispatch first (the sets are built in children, they must not inherit the conversion and
+ * timed sensors, which register with the static scheduler)
+ */
+static void benchRound(void)
+{
+    static const UINT8 counts[4] = {1, 5, 10, MAX_NUM_SENSORS};
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        benchDispatch(counts[i], false);
+        benchDispatch(counts[i], true);
+    }
+
+    //difference on a plain fifo (sum of squares from the samples), least squares with the running sums
+    benchFifo<8, 1, 8, 0>(FIFO_DT_DIFF);
+    benchFifo<8, 4, 8, FIFO_LSQ | FIFO_SUMSQ>(FIFO_DT_LSQ);
+    benchFifo<10, 1, 10, 0>(FIFO_DT_DIFF);
+    benchFifo<10, 5, 10, FIFO_LSQ | FIFO_SUMSQ>(FIFO_DT_LSQ);
+    benchFifo<32, 8, 32, 0>(FIFO_DT_DIFF);
+    benchFifo<32, 16, 32, FIFO_LSQ | FIFO_SUMSQ>(FIFO_DT_LSQ);
+    benchFifo<100, 10, 100, 0>(FIFO_DT_DIFF);
+    benchFifo<100, 50, 100, FIFO_LSQ | FIFO_SUMSQ>(FIFO_DT_LSQ);
+
+    //ADC burst sized blocks and recorded run sized blocks
+    benchBlock<10, 1, 10, 0, 8>(FIFO_DT_DIFF);
+    benchBlock<32, 16, 32, FIFO_LSQ | FIFO_SUMSQ, 64>(FIFO_DT_LSQ);
+    benchBlock<100, 10, 100, 0, 64>(FIFO_DT_DIFF);
+
+    benchFifoTimed<10, 5, 10>(FIFO_DT_DIFF);
+    benchFifoTimed<10, 5, 10>(FIFO_DT_LSQ);
+
+    benchConvert();
+
+    benchTimed(FIFO_DT_DIFF, "sensor_timed_diff");
+    benchTimed(FIFO_DT_LSQ, "sensor_timed_lsq");
+}
+
+/**
+ * Run a round in a new process (the benchmark re-executed with -x), the results are passed back through a pipe. A timing
+ * can be stuck slow for the life of a process (code and data placement), a fresh process each round gets a fresh layout.
+ *
+ * @param argv - the options of this run, passed on (-n, -f)
+ * @return - false if the round did not complete
+ */
+static bool spawnRound(char **argv)
+{
+    BENCH_RESULT R;
+    char   fdArg[16], *args[8];
+    int    fd[2], status = -1, n = 0;
+    pid_t  pid;
+
+    if (pipe(fd))
+    {
+        return(false);
+    }
+
+    fflush(stdout);
+    if ((pid = fork()) == 0)
+    {
+        close(fd[0]);
+        snprintf(fdArg, sizeof(fdArg), "%d", fd[1]);
+        args[n++] = argv[0];
+        args[n++] = (char *)"-x";
+        args[n++] = fdArg;
+        args[n++] = (char *)"-n";
+        args[n++] = argv[1];
+        if (filter)
+        {
+            args[n++] = (char *)"-f";
+            args[n++] = (char *)filter;
+        }
+        args[n] = NULL;
+        execv("/proc/self/exe", args);
+        _exit(1);
+    }
+
+    close(fd[1]);
+    while (pid > 0 && read(fd[0], &R, sizeof(R)) == sizeof(R))
+    {
+        addResult(R.name, R.ns, R.cycles, R.rel, R.ok);
+    }
+    close(fd[0]);
+    if (pid > 0)
+    {
+        waitpid(pid, &status, 0);
+    }
+    return( WIFEXITED(status) && WEXITSTATUS(status) == 0 );
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *baseline = NULL, *output = NULL;
+    char        scale[16], *pass[2];
+    double      tolerance = BENCH_TOLERANCE;
+    int         opt, i, round, out = -1, failed = 0, regressions = 0;
+
+    while ((opt = getopt(argc, argv, "b:w:t:n:f:x:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'x': out       = atoi(optarg);      break;
+        case 'b': baseline  = optarg;            break;
+        case 'w': output    = optarg;            break;
+        case 't': tolerance = atof(optarg);      break;
+        case 'n': opsScale  = atof(optarg);      break;
+        case 'f': filter    = optarg;            break;
+        default:
+            fprintf(stderr, "usage: %s [-b baseline file] [-w baseline file] [-t tolerance %%] [-n ops scale] [-f name filter]\n", argv[0]);
+            return(1);
+        }
+    }
+
+    pinCpu();
+
+    //a round (-x, spawned by spawnRound), the results go to the pipe
+    if (out >= 0)
+    {
+        benchRound();
+        for (i = 0; i < resultCnt; i++)
+        {
+            if (write(out, &Results[i], sizeof(Results[i])) != sizeof(Results[i]))
+            {
+                return(1);
+            }
+        }
+        return(0);
+    }
+
+    snprintf(scale, sizeof(scale), "%g", opsScale);
+    pass[0] = argv[0];
+    pass[1] = scale;
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        if (!spawnRound(pass))
+        {
+            //crashed part way, the benchmarks it did not report are missing
+            addResult("round", 0, 0, 0, false);
+        }
+    }
+
+    for (i = 0; i < resultCnt; i++)
+    {
+        printf("%-28s %9.2f ns/op %9.1f cycles/op  %s\n", Results[i].name, Results[i].ns, Results[i].cycles,
+               Results[i].ok ? "ok" : "MISMATCH");
+        failed += Results[i].ok ? 0 : 1;
+    }
+
+    if (baseline && (regressions = checkBaseline(baseline, tolerance, pass)) < 0)
+    {
+        fprintf(stderr, "cannot read baseline %s\n", baseline);
+        return(1);
+    }
+    if (output && !writeBaseline(output))
+    {
+        fprintf(stderr, "cannot write baseline %s\n", output);
+        return(1);
+    }
+
+    printf("%d benchmarks, %d failed the reference check, %d regressions\n", resultCnt, failed, regressions);
+    return( failed || regressions ? 1 : 0 );
+}
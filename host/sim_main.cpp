@@ -0,0 +1,185 @@
+/**
+ * Host harness for the Dyno sketch. Runs the unmodified sketch (setup/loop) against the simulated HAL, stepping the
+ * virtual clock between loop() calls. Runs as fast as the host allows, reports the virtual/wall time ratio and
+ * scheduler timing on exit.
+ *
+ * usage: dyno_sim [-t seconds] [-s loop uSecs] [-a analogRead uSecs] [-c ADC conversion uSecs] [-f speed Hz] [-r Hz/sec]
+ *                 [-b baud] [-d] [-i uSecs:chars] [-e eeprom file] [-w script] [-q]
+ *
+ * -r ramps the speed input from -f at a rate in Hz per second (inertia sweep)
+ * -e keeps the EEPROM in a file (loaded at start, written at exit) so calibration survives between runs
+ * -i sends characters (sketch commands) to the serial port at a virtual time, may be repeated
+ *
+ * @author DJK
+ * @version 0.1
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Dyno.ino"
+
+//default load cell input, ~3.27V on a 5V 10 bit ADC with a slow swing and some noise
+#define SIM_LOAD_COUNTS  670
+#define SIM_LOAD_SWING   20
+#define SIM_LOAD_PERIOD  1000000
+#define SIM_LOAD_NOISE   2
+//default speed input, as generated by the PWM output on pin 9
+#define SIM_SPEED_HZ     490.0
+
+//max number of -i serial inputs
+#define SIM_MAX_INPUTS   8
+
+#ifdef ACQ_PROFILE
+/**
+ * upper bound in uSecs of the highest non empty bucket of a profile histogram, 0 if empty
+ */
+static unsigned long histMax(const UINT16 *hist)
+{
+    int b;
+
+    for (b = ACQ_HIST_BUCKETS - 1; b > 0 && !hist[b]; b--)
+    {
+    }
+    return( b ? (1UL << b) - 1 : 0 );
+}
+#endif
+
+static double wallSecs(void)
+{
+    struct timespec T;
+
+    clock_gettime(CLOCK_MONOTONIC, &T);
+    return( T.tv_sec + T.tv_nsec * 1e-9 );
+}
+
+int main(int argc, char **argv)
+{
+    int       opt;
+    double    secs = 10.0, hz = SIM_SPEED_HZ, hzRate = 0.0, wall;
+    uint32_t  usStep = 10, usAdc = 0, usConv = ADC_SIM_CONVERSION, baud = 0;
+    uint64_t  usEnd, loops = 0;
+    const char *script = NULL, *eeprom = NULL;
+    bool      quiet = false, drop = false;
+    uint64_t  usInput[SIM_MAX_INPUTS];
+    char     *input[SIM_MAX_INPUTS], *sep;
+    int       inputCnt = 0, i;
+    SIM_WAVE  load = {SIM_SINE, SIM_LOAD_COUNTS, SIM_LOAD_SWING, SIM_LOAD_PERIOD, SIM_LOAD_NOISE};
+
+    while ((opt = getopt(argc, argv, "t:s:a:c:f:r:b:di:e:w:q")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': secs   = atof(optarg);                 break;
+        case 's': usStep = strtoul(optarg, NULL, 0);     break;
+        case 'a': usAdc  = strtoul(optarg, NULL, 0);     break;
+        case 'c': usConv = strtoul(optarg, NULL, 0);     break;
+        case 'f': hz     = atof(optarg);                 break;
+        case 'r': hzRate = atof(optarg);                 break;
+        case 'b': baud   = strtoul(optarg, NULL, 0);     break;
+        case 'd': drop   = true;                         break;
+        case 'i':
+            if (inputCnt < SIM_MAX_INPUTS && (sep = strchr(optarg, ':')))
+            {
+                usInput[inputCnt] = strtoull(optarg, NULL, 0);
+                input[inputCnt++] = sep + 1;
+            }
+            break;
+        case 'e': eeprom = optarg;                       break;
+        case 'w': script = optarg;                       break;
+        case 'q': quiet  = true;                         break;
+        default:
+            fprintf(stderr, "usage: %s [-t seconds] [-s loop uSecs] [-a analogRead uSecs] [-c ADC conversion uSecs] [-f speed Hz] [-r Hz/sec] [-b baud] [-d] [-i uSecs:chars] [-e eeprom file] [-w script] [-q]\n", argv[0]);
+            return(1);
+        }
+    }
+
+    //the sensors are constructed (static init) before main, only reset the clock and inputs
+    simSetTime(0);
+    simSetAnalogReadTime(usAdc);
+    simSetWave(PIN_0, load);
+    if (script && !simLoadScript(script))
+    {
+        fprintf(stderr, "cannot open script %s\n", script);
+        return(1);
+    }
+    if (eeprom && !simEepromOpen(eeprom))
+    {
+        fprintf(stderr, "bad eeprom file %s\n", eeprom);
+        return(1);
+    }
+    if (quiet)
+    {
+        Serial.setOutput(NULL);
+    }
+    //simulate a slower serial link than the sketch asks for
+    Serial.setRate(baud);
+
+    cEdgeSim speedSim(&Speed);
+    cAdcSim  adcSim(usConv);
+
+    setup();
+    if (drop)
+    {
+        Telemetry.setPolicy(TLM_TX_DROP);
+    }
+    speedSim.setSweep(hz, hzRate);
+
+    usEnd = (uint64_t)(secs * 1000000.0);
+    wall  = wallSecs();
+
+    while (simTime() < usEnd)
+    {
+        for (i = 0; i < inputCnt; i++)
+        {
+            if (input[i] && simTime() >= usInput[i])
+            {
+                Serial.inject(input[i]);
+                input[i] = NULL;
+            }
+        }
+        speedSim.run(micros());
+        adcSim.run(micros());
+        loop();
+        simAdvance(usStep);
+        loops++;
+    }
+
+    wall = wallSecs() - wall;
+    Serial.flush();
+    cCalStore::flush();
+    simEepromSave();
+
+    fprintf(stderr, "virtual %.3fs, wall %.3fs (x%.0f), %llu loops, %u analog reads, %u ADC conversions, scan %luus, scan max %luus\n",
+            simTime() * 1e-6, wall, wall > 0 ? simTime() * 1e-6 / wall : 0.0, (unsigned long long)loops,
+            simAnalogReads(), (unsigned)adcSim.getConversions(), (unsigned long)scanTime(), (unsigned long)scanTimeMax());
+    fprintf(stderr, "missed/skipped deadlines: 1000Hz %lu/%lu, 100Hz %lu/%lu, 10Hz %lu/%lu, 1Hz %lu/%lu\n",
+            (unsigned long)scanMissed(_1000Hz_Rate), (unsigned long)scanSkipped(_1000Hz_Rate),
+            (unsigned long)scanMissed(_100Hz_Rate),  (unsigned long)scanSkipped(_100Hz_Rate),
+            (unsigned long)scanMissed(_10Hz_Rate),   (unsigned long)scanSkipped(_10Hz_Rate),
+            (unsigned long)scanMissed(_1Hz_Rate),    (unsigned long)scanSkipped(_1Hz_Rate));
+    fprintf(stderr, "telemetry: %lu frames sent, %lu dropped, %lu coalesced, serial stalled %lluus\n",
+            (unsigned long)Telemetry.getSent(), (unsigned long)Telemetry.getDropped(),
+            (unsigned long)Telemetry.getCoalesced(), (unsigned long long)Serial.getStallTime());
+    fprintf(stderr, "calibration store: image %u, %lu EEPROM bytes written\n",
+            (unsigned)cCalStore::getSeq(), (unsigned long)simEepromWrites());
+#ifdef ACQ_PROFILE
+    const ACQ_PROF *prof;
+    uint32_t usPeriod;
+
+    for (i = 0; (prof = cAcquire::getProfile((UINT8)i, &usPeriod)); i++)
+    {
+        fprintf(stderr, "profile %luus: %lu overruns, slice < %luus, jitter < %luus\n", (unsigned long)usPeriod,
+                (unsigned long)prof->overruns, histMax(prof->hist[ACQ_HIST_SLICE]) + 1,
+                histMax(prof->hist[ACQ_HIST_JITTER]) + 1);
+    }
+    for (i = 0; i < cAcquire::getSensorCount(); i++)
+    {
+        fprintf(stderr, "sensor %d readSensor: %lu cycles, max %lu\n", i,
+                (unsigned long)cAcquire::getSensorCycles((UINT8)i, false),
+                (unsigned long)cAcquire::getSensorCycles((UINT8)i, true));
+    }
+#endif
+    return(0);
+}
@@ -0,0 +1,769 @@
+#include <math.h>
+#include <string.h>
+#include "simhal.h"
+
+/**
+ * per pin simulated state, ADC waveform and digital level
+ */
+struct SIM_PIN
+{
+    SIM_WAVE  wave;
+    SIM_POINT table[SIM_MAX_POINTS];
+    uint8_t   numPoints;
+    bool      repeat;
+    uint16_t  (*func)(uint8_t pin, uint32_t us);
+    uint8_t   mode;
+    int       level;
+};
+
+static SIM_PIN  pins[SIM_NUM_PINS];
+static void     (*isrs[SIM_NUM_PINS])(void);
+
+//virtual time in uSecs, 64 bit so that millis() stays consistent across the 32 bit micros() rollover
+static uint64_t usTime;
+static uint32_t usAnalogRead, analogReads, noiseSeed;
+static uint16_t adcMax = 1023;
+
+//EEPROM image, backing file, number of byte writes, virtual time the write in progress completes
+static uint8_t  eeprom[SIM_EEPROM_SIZE];
+static char     eepromPath[256];
+static uint32_t eepromWrites;
+static uint64_t usEepromDone;
+
+//the EEPROM starts erased, as from the factory
+static struct SIM_EEPROM_INIT
+{
+    SIM_EEPROM_INIT() { memset(eeprom, SIM_EEPROM_ERASED, sizeof(eeprom)); }
+} eepromInit;
+
+cSimSerial Serial;
+
+/**
+ * deterministic noise generator (LCG), keeps runs reproducible
+ */
+static int32_t simNoise(uint16_t amplitude)
+{
+    noiseSeed = noiseSeed * 1664525UL + 1013904223UL;
+
+    return( amplitude ? (int32_t)((noiseSeed >> 16) % (2 * amplitude + 1)) - amplitude : 0 );
+}
+
+/**
+ * interpolate the breakpoint table of a pin at the given time
+ */
+static float simTable(SIM_PIN *P, uint64_t us)
+{
+    uint8_t i;
+    uint32_t span, t;
+
+    if (!P->numPoints)
+    {
+        return(0);
+    }
+
+    span = P->table[P->numPoints - 1].us;
+    t = (P->repeat && span) ? (uint32_t)(us % span) : (us > span ? span : (uint32_t)us);
+
+    for (i = 1; i < P->numPoints; i++)
+    {
+        if (t < P->table[i].us)
+        {
+            float f = (float)(t - P->table[i-1].us) / (float)(P->table[i].us - P->table[i-1].us);
+            return( P->table[i-1].counts + f * ((float)P->table[i].counts - P->table[i-1].counts) );
+        }
+    }
+    return( P->table[P->numPoints - 1].counts );
+}
+
+
+/******************************************************************************
+ * Arduino core API
+ ******************************************************************************/
+
+uint32_t micros(void)
+{
+    return( (uint32_t)usTime );
+}
+
+uint32_t millis(void)
+{
+    return( (uint32_t)(usTime / 1000) );
+}
+
+void delay(uint32_t ms)
+{
+    usTime += (uint64_t)ms * 1000;
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    usTime += us;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (pin < SIM_NUM_PINS)
+    {
+        pins[pin].mode = mode;
+    }
+}
+
+/**
+ * Sample the scripted waveform of a pin at the current virtual time. The conversion time set by simSetAnalogReadTime()
+ * is charged to the virtual clock, as a synchronous conversion would on the target.
+ */
+int analogRead(uint8_t pin)
+{
+    int value;
+
+    analogReads++;
+    value = simAnalogValue(pin, usTime);
+    usTime += usAnalogRead;
+
+    return(value);
+}
+
+void analogWrite(uint8_t pin, int value)
+{
+    if (pin < SIM_NUM_PINS)
+    {
+        pins[pin].level = value;
+    }
+}
+
+void analogReference(uint8_t mode)
+{
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin < SIM_NUM_PINS)
+    {
+        pins[pin].level = value;
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    return( pin < SIM_NUM_PINS ? pins[pin].level : LOW );
+}
+
+void attachInterrupt(uint8_t interrupt, void (*isr)(void), int mode)
+{
+    (void)mode;
+
+    if (interrupt < SIM_NUM_PINS)
+    {
+        isrs[interrupt] = isr;
+    }
+}
+
+void detachInterrupt(uint8_t interrupt)
+{
+    if (interrupt < SIM_NUM_PINS)
+    {
+        isrs[interrupt] = NULL;
+    }
+}
+
+
+/******************************************************************************
+ * Virtual clock
+ ******************************************************************************/
+
+/**
+ * reset virtual time, waveforms, pins and counters to power up state
+ */
+void simReset(void)
+{
+    memset(pins, 0, sizeof(pins));
+    memset(isrs, 0, sizeof(isrs));
+    usTime       = 0;
+    usAnalogRead = 0;
+    analogReads  = 0;
+    noiseSeed    = 1;
+    adcMax       = 1023;
+}
+
+void simSetTime(uint64_t us)
+{
+    usTime = us;
+}
+
+void simAdvance(uint32_t us)
+{
+    usTime += us;
+}
+
+uint64_t simTime(void)
+{
+    return(usTime);
+}
+
+
+/******************************************************************************
+ * ADC waveforms
+ ******************************************************************************/
+
+/**
+ * Sample the scripted waveform of a pin at a given virtual time, without charging conversion time. Used by analogRead()
+ * and by simulated ADC backends that convert in the background (free running, DMA).
+ *
+ * @return - ADC counts, clipped to the ADC range
+ */
+uint16_t simAnalogValue(uint8_t pin, uint64_t us)
+{
+    SIM_PIN *P;
+    float value = 0;
+
+    if (pin >= SIM_NUM_PINS)
+    {
+        return(0);
+    }
+    P = &pins[pin];
+
+    switch (P->wave.type)
+    {
+    case SIM_CONST:
+        value = P->wave.offset;
+        break;
+    case SIM_SINE:
+        value = P->wave.offset + (P->wave.usPeriod ?
+                P->wave.amplitude * sin(2.0 * M_PI * (double)(us % P->wave.usPeriod) / P->wave.usPeriod) : 0);
+        break;
+    case SIM_SQUARE:
+        value = P->wave.offset + ((P->wave.usPeriod && (us % P->wave.usPeriod) < P->wave.usPeriod / 2) ?
+                P->wave.amplitude : -P->wave.amplitude);
+        break;
+    case SIM_RAMP:
+        value = P->wave.offset + (P->wave.usPeriod ?
+                P->wave.amplitude * (float)(us % P->wave.usPeriod) / P->wave.usPeriod : 0);
+        break;
+    case SIM_TABLE:
+        value = simTable(P, us);
+        break;
+    case SIM_FUNC:
+        value = P->func ? P->func(pin, (uint32_t)us) : 0;
+        break;
+    }
+
+    value += simNoise(P->wave.noise);
+
+    //clip to ADC range
+    value = value < 0 ? 0 : value;
+    return( value > adcMax ? adcMax : (uint16_t)(value + 0.5f) );
+}
+
+/**
+ * set ADC resolution, 10 bits (UNO) by default, 12 bits for DUE/MAPLE
+ */
+void simSetAdcBits(uint8_t bits)
+{
+    adcMax = (uint16_t)((1UL << bits) - 1);
+}
+
+/**
+ * set virtual time charged for each analogRead() call (~112uS on a 16MHz AVR)
+ */
+void simSetAnalogReadTime(uint32_t us)
+{
+    usAnalogRead = us;
+}
+
+void simSetWave(uint8_t pin, SIM_WAVE wave)
+{
+    if (pin < SIM_NUM_PINS)
+    {
+        pins[pin].wave = wave;
+    }
+}
+
+void simSetConst(uint8_t pin, uint16_t counts)
+{
+    SIM_WAVE W = {SIM_CONST, (float)counts, 0, 0, 0};
+
+    simSetWave(pin, W);
+}
+
+/**
+ * Script a pin with a breakpoint table, counts are interpolated between points. Times are relative to virtual time 0.
+ *
+ * @param points - breakpoints, ascending in time
+ * @param num    - number of breakpoints, clipped to SIM_MAX_POINTS
+ * @param repeat - true repeats the table with the period of the last breakpoint, otherwise the last value is held
+ */
+void simSetTable(uint8_t pin, const SIM_POINT *points, uint8_t num, bool repeat)
+{
+    SIM_PIN *P;
+
+    if (pin < SIM_NUM_PINS && points)
+    {
+        P = &pins[pin];
+        P->numPoints = num < SIM_MAX_POINTS ? num : SIM_MAX_POINTS;
+        memcpy(P->table, points, P->numPoints * sizeof(SIM_POINT));
+        P->repeat = repeat;
+        P->wave.type = SIM_TABLE;
+    }
+}
+
+void simSetFunc(uint8_t pin, uint16_t (*func)(uint8_t pin, uint32_t us))
+{
+    if (pin < SIM_NUM_PINS)
+    {
+        pins[pin].func = func;
+        pins[pin].wave.type = SIM_FUNC;
+    }
+}
+
+/**
+ * Load a waveform script. One breakpoint per line: "<uSecs> <pin> <counts>", '#' starts a comment.
+ * Breakpoints are appended to each pin's table in file order, the last value is held.
+ *
+ * @return - false if the file could not be opened
+ */
+bool simLoadScript(const char *path)
+{
+    FILE *F;
+    char line[128];
+    unsigned long us;
+    unsigned pin, counts;
+    SIM_PIN *P;
+
+    F = fopen(path, "r");
+    if (!F)
+    {
+        return(false);
+    }
+
+    while (fgets(line, sizeof(line), F))
+    {
+        if (line[0] == '#' || sscanf(line, "%lu %u %u", &us, &pin, &counts) != 3 || pin >= SIM_NUM_PINS)
+        {
+            continue;
+        }
+        P = &pins[pin];
+        if (P->numPoints < SIM_MAX_POINTS)
+        {
+            P->table[P->numPoints].us = us;
+            P->table[P->numPoints].counts = counts;
+            P->numPoints++;
+            P->wave.type = SIM_TABLE;
+        }
+    }
+    fclose(F);
+    return(true);
+}
+
+/**
+ * @return - number of analogRead() calls since reset, used to count ADC conversions
+ */
+uint32_t simAnalogReads(void)
+{
+    return(analogReads);
+}
+
+
+/******************************************************************************
+ * EEPROM
+ ******************************************************************************/
+
+/**
+ * wait (in virtual time) for the write in progress
+ */
+static void eepromWait(void)
+{
+    if (usTime < usEepromDone)
+    {
+        usTime = usEepromDone;
+    }
+}
+
+uint8_t eeprom_read_byte(const uint8_t *addr)
+{
+    uintptr_t a = (uintptr_t)addr;
+
+    eepromWait();
+    return( a < SIM_EEPROM_SIZE ? eeprom[a] : SIM_EEPROM_ERASED );
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+    uint8_t  *d = (uint8_t *)dst;
+    uintptr_t a = (uintptr_t)src;
+
+    eepromWait();
+    for (; n; n--, a++)
+    {
+        *d++ = a < SIM_EEPROM_SIZE ? eeprom[a] : SIM_EEPROM_ERASED;
+    }
+}
+
+void eeprom_write_byte(uint8_t *addr, uint8_t value)
+{
+    uintptr_t a = (uintptr_t)addr;
+
+    eepromWait();
+    if (a < SIM_EEPROM_SIZE)
+    {
+        eeprom[a]    = value;
+        usEepromDone = usTime + SIM_EEPROM_WRITE_US;
+        eepromWrites++;
+    }
+}
+
+void eeprom_update_byte(uint8_t *addr, uint8_t value)
+{
+    if (eeprom_read_byte(addr) != value)
+    {
+        eeprom_write_byte(addr, value);
+    }
+}
+
+bool eeprom_is_ready(void)
+{
+    return(usTime >= usEepromDone);
+}
+
+/**
+ * Open the EEPROM backing file. The image is loaded if the file exists, otherwise the EEPROM is erased.
+ *
+ * @param path - image file (raw SIM_EEPROM_SIZE bytes)
+ * @return - false if the path is too long
+ */
+bool simEepromOpen(const char *path)
+{
+    FILE *f;
+
+    if (!path || strlen(path) >= sizeof(eepromPath))
+    {
+        return(false);
+    }
+    strcpy(eepromPath, path);
+
+    simEepromErase();
+    if ((f = fopen(path, "rb")))
+    {
+        if (fread(eeprom, 1, SIM_EEPROM_SIZE, f) != SIM_EEPROM_SIZE)
+        {
+            //a short file leaves the rest of the EEPROM erased
+        }
+        fclose(f);
+    }
+    return(true);
+}
+
+/**
+ * write the image to the backing file (if one is open)
+ */
+bool simEepromSave(void)
+{
+    FILE *f;
+    bool ok;
+
+    if (!eepromPath[0] || !(f = fopen(eepromPath, "wb")))
+    {
+        return(false);
+    }
+    ok = fwrite(eeprom, 1, SIM_EEPROM_SIZE, f) == SIM_EEPROM_SIZE;
+    fclose(f);
+    return(ok);
+}
+
+void simEepromErase(void)
+{
+    memset(eeprom, SIM_EEPROM_ERASED, sizeof(eeprom));
+    eepromWrites = 0;
+    usEepromDone = 0;
+}
+
+/**
+ * @return - number of EEPROM byte writes (wear, and 3.3mS each on the target)
+ */
+uint32_t simEepromWrites(void)
+{
+    return(eepromWrites);
+}
+
+
+/******************************************************************************
+ * Digital pins and interrupts
+ ******************************************************************************/
+
+void simSetDigital(uint8_t pin, uint8_t value)
+{
+    if (pin < SIM_NUM_PINS)
+    {
+        pins[pin].level = value;
+    }
+}
+
+/**
+ * @return - last value written to the pin (digitalWrite or analogWrite duty)
+ */
+int simGetOutput(uint8_t pin)
+{
+    return( pin < SIM_NUM_PINS ? pins[pin].level : 0 );
+}
+
+/**
+ * run the ISR attached to an interrupt, at the current virtual time
+ */
+void simTriggerInterrupt(uint8_t interrupt)
+{
+    if (interrupt < SIM_NUM_PINS && isrs[interrupt])
+    {
+        isrs[interrupt]();
+    }
+}
+
+
+/******************************************************************************
+ * Serial
+ ******************************************************************************/
+
+cSimSerial::cSimSerial()
+{
+    out       = stdout;
+    baud      = 0;
+    rate      = 0;
+    txBytes   = 0;
+    usPerByte = 0;
+    usTxDone  = 0;
+    usStalled = 0;
+    rxHead    = 0;
+    rxTail    = 0;
+}
+
+void cSimSerial::begin(uint32_t bitsPerSec)
+{
+    baud      = rate ? rate : bitsPerSec;
+    usPerByte = baud ? 10000000.0 / baud : 0;
+    usTxDone  = (double)usTime;
+}
+
+/**
+ * override the line rate set by begin() (e.g. simulate a slow link), 0 uses the rate passed to begin(). Call before begin().
+ */
+void cSimSerial::setRate(uint32_t bitsPerSec)
+{
+    rate = bitsPerSec;
+}
+
+/**
+ * @return - number of bytes in the TX buffer not yet sent on the line, at the current virtual time
+ */
+uint32_t cSimSerial::txQueued(void)
+{
+    if (!usPerByte || usTxDone <= (double)usTime)
+    {
+        return(0);
+    }
+    return( (uint32_t)ceil((usTxDone - (double)usTime) / usPerByte) );
+}
+
+/**
+ * @return - total virtual time (uSecs) write() was blocked on a full TX buffer
+ */
+uint64_t cSimSerial::getStallTime(void)
+{
+    return(usStalled);
+}
+
+void cSimSerial::end(void)
+{
+}
+
+void cSimSerial::flush(void)
+{
+    if (out)
+    {
+        fflush(out);
+    }
+}
+
+/**
+ * redirect serial output, NULL discards it (profiling runs)
+ */
+void cSimSerial::setOutput(FILE *stream)
+{
+    out = stream;
+}
+
+/**
+ * @return - total number of bytes written to the port
+ */
+uint32_t cSimSerial::getTxBytes(void)
+{
+    return(txBytes);
+}
+
+int cSimSerial::available(void)
+{
+    return( (uint8_t)(rxHead - rxTail) );
+}
+
+int cSimSerial::read(void)
+{
+    if (rxHead == rxTail)
+    {
+        return(-1);
+    }
+    return( (uint8_t)rxBuf[rxTail++ % SIM_SERIAL_RX_SIZE] );
+}
+
+/**
+ * simulate received bytes (commands to the sketch), bytes beyond the RX buffer size are lost as on the target
+ */
+void cSimSerial::inject(const char *str)
+{
+    while (*str && (uint8_t)(rxHead - rxTail) < SIM_SERIAL_RX_SIZE)
+    {
+        rxBuf[rxHead++ % SIM_SERIAL_RX_SIZE] = *str++;
+    }
+}
+
+int cSimSerial::availableForWrite(void)
+{
+    uint32_t queued = txQueued();
+
+    return( queued < SIM_SERIAL_TX_SIZE - 1 ? SIM_SERIAL_TX_SIZE - 1 - queued : 0 );
+}
+
+/**
+ * queue a byte for the line, blocks (advances virtual time) while the TX buffer is full
+ */
+size_t cSimSerial::write(uint8_t c)
+{
+    uint64_t usFree;
+
+    if (usPerByte)
+    {
+        if (txQueued() >= SIM_SERIAL_TX_SIZE - 1)
+        {
+            //wait for the byte at the front of the buffer to go out
+            usFree = (uint64_t)ceil(usTxDone - (SIM_SERIAL_TX_SIZE - 2) * usPerByte);
+            usStalled += usFree - usTime;
+            usTime = usFree;
+        }
+        usTxDone = (usTxDone > (double)usTime ? usTxDone : (double)usTime) + usPerByte;
+    }
+
+    txBytes++;
+    if (out)
+    {
+        fputc(c, out);
+    }
+    return(1);
+}
+
+size_t cSimSerial::write(const uint8_t *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        write(buf[i]);
+    }
+    return(len);
+}
+
+size_t cSimSerial::print(const char *str)
+{
+    return( write((const uint8_t *)str, strlen(str)) );
+}
+
+size_t cSimSerial::print(char c)
+{
+    return( write((uint8_t)c) );
+}
+
+size_t cSimSerial::print(int value)
+{
+    return( print((long)value) );
+}
+
+size_t cSimSerial::print(unsigned int value)
+{
+    return( print((unsigned long)value) );
+}
+
+size_t cSimSerial::print(long value)
+{
+    char str[24];
+
+    snprintf(str, sizeof(str), "%ld", value);
+    return( print(str) );
+}
+
+size_t cSimSerial::print(unsigned long value)
+{
+    char str[24];
+
+    snprintf(str, sizeof(str), "%lu", value);
+    return( print(str) );
+}
+
+size_t cSimSerial::print(double value, int digits)
+{
+    return( printFloat(value, digits) );
+}
+
+/**
+ * same format as the Arduino Print class, fixed number of decimals
+ */
+size_t cSimSerial::printFloat(double value, int digits)
+{
+    char str[48];
+
+    if (isnan(value))
+    {
+        return( print("nan") );
+    }
+    if (isinf(value))
+    {
+        return( print("inf") );
+    }
+    snprintf(str, sizeof(str), "%.*f", digits, value);
+    return( print(str) );
+}
+
+size_t cSimSerial::println(void)
+{
+    return( print("\r\n") );
+}
+
+size_t cSimSerial::println(const char *str)
+{
+    return( print(str) + println() );
+}
+
+size_t cSimSerial::println(char c)
+{
+    return( print(c) + println() );
+}
+
+size_t cSimSerial::println(int value)
+{
+    return( print(value) + println() );
+}
+
+size_t cSimSerial::println(unsigned int value)
+{
+    return( print(value) + println() );
+}
+
+size_t cSimSerial::println(long value)
+{
+    return( print(value) + println() );
+}
+
+size_t cSimSerial::println(unsigned long value)
+{
+    return( print(value) + println() );
+}
+
+size_t cSimSerial::println(double value, int digits)
+{
+    return( print(value, digits) + println() );
+}
@@ -0,0 +1,217 @@
+#ifndef SIMHAL_H
+#define SIMHAL_H
+
+/**
+ * Simulated Arduino HAL for the native (linux) host build. Stands in for Arduino.h when HOST_BUILD is defined (see typedef.h).
+ *
+ * Time is a virtual clock that only moves when the harness advances it (simAdvance) or when a simulated peripheral
+ * costs time (analogRead conversion time). This lets the real scheduler and FIFO math run much faster than real time,
+ * and deterministically, for profiling and regression.
+ *
+ * ADC inputs are driven by scripted waveforms per pin (constant, sine, square, ramp, breakpoint table or callback).
+ *
+ * @author DJK
+ * @version 0.1
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+//pin modes and levels
+#define INPUT          0x0
+#define OUTPUT         0x1
+#define INPUT_PULLUP   0x2
+#define INPUT_ANALOG   0x3
+#define LOW            0x0
+#define HIGH           0x1
+
+//interrupt trigger modes
+#define CHANGE         1
+#define FALLING        2
+#define RISING         3
+
+//analog references (UNO values)
+#define EXTERNAL       0
+#define DEFAULT        1
+#define INTERNAL       3
+
+//number of simulated pins
+#define SIM_NUM_PINS   32
+//number of breakpoints in a scripted waveform table
+#define SIM_MAX_POINTS 64
+//size of the simulated serial TX buffer (as SERIAL_TX_BUFFER_SIZE on AVR)
+#define SIM_SERIAL_TX_SIZE 64
+//size of the simulated serial RX buffer
+#define SIM_SERIAL_RX_SIZE 64
+//size of the simulated EEPROM (UNO), erased state, time of a byte write in uSecs
+#define SIM_EEPROM_SIZE     1024
+#define SIM_EEPROM_ERASED   0xFF
+#define SIM_EEPROM_WRITE_US 3300
+
+//no interrupt preemption on the host, critical sections are no-ops
+#define noInterrupts()
+#define interrupts()
+
+#define digitalPinToInterrupt(p) (p)
+
+/**
+ * Arduino core API
+ */
+uint32_t micros(void);
+uint32_t millis(void);
+void     delay(uint32_t ms);
+void     delayMicroseconds(uint32_t us);
+void     pinMode(uint8_t pin, uint8_t mode);
+int      analogRead(uint8_t pin);
+void     analogWrite(uint8_t pin, int value);
+void     analogReference(uint8_t mode);
+void     digitalWrite(uint8_t pin, uint8_t value);
+int      digitalRead(uint8_t pin);
+void     attachInterrupt(uint8_t interrupt, void (*isr)(void), int mode);
+void     detachInterrupt(uint8_t interrupt);
+
+/**
+ * avr-libc EEPROM API (avr/eeprom.h). A write takes SIM_EEPROM_WRITE_US of virtual time, a write (or read) while the
+ * previous write is in progress waits for it, as on the target.
+ */
+uint8_t  eeprom_read_byte(const uint8_t *addr);
+void     eeprom_read_block(void *dst, const void *src, size_t n);
+void     eeprom_write_byte(uint8_t *addr, uint8_t value);
+void     eeprom_update_byte(uint8_t *addr, uint8_t value);
+bool     eeprom_is_ready(void);
+
+
+/**
+ * simulated waveform types for an ADC pin
+ */
+enum SIM_WAVE_TYPE
+{
+    SIM_CONST,
+    SIM_SINE,
+    SIM_SQUARE,
+    SIM_RAMP,
+    SIM_TABLE,
+    SIM_FUNC
+};
+
+/**
+ * breakpoint of a scripted waveform table, counts are linearly interpolated between points
+ */
+struct SIM_POINT
+{
+    uint32_t us;
+    uint16_t counts;
+};
+
+/**
+ * Waveform definition for an ADC pin. offset/amplitude are in ADC counts, period in uSecs of virtual time.
+ * "noise" adds uniform (deterministic, seeded) noise of +/- noise counts.
+ */
+struct SIM_WAVE
+{
+    SIM_WAVE_TYPE type;
+    float         offset;
+    float         amplitude;
+    uint32_t      usPeriod;
+    uint16_t      noise;
+};
+
+/**
+ * virtual clock control
+ */
+void     simReset(void);
+void     simSetTime(uint64_t us);
+void     simAdvance(uint32_t us);
+uint64_t simTime(void);
+
+/**
+ * ADC waveform control
+ */
+void     simSetAdcBits(uint8_t bits);
+void     simSetAnalogReadTime(uint32_t us);
+uint16_t simAnalogValue(uint8_t pin, uint64_t us);
+void     simSetWave(uint8_t pin, SIM_WAVE wave);
+void     simSetConst(uint8_t pin, uint16_t counts);
+void     simSetTable(uint8_t pin, const SIM_POINT *points, uint8_t num, bool repeat);
+void     simSetFunc(uint8_t pin, uint16_t (*func)(uint8_t pin, uint32_t us));
+bool     simLoadScript(const char *path);
+uint32_t simAnalogReads(void);
+
+/**
+ * EEPROM backing file, loaded on open (a missing file reads as erased) and written by simEepromSave
+ */
+bool     simEepromOpen(const char *path);
+bool     simEepromSave(void);
+void     simEepromErase(void);
+uint32_t simEepromWrites(void);
+
+/**
+ * digital pin / interrupt control
+ */
+void     simSetDigital(uint8_t pin, uint8_t value);
+int      simGetOutput(uint8_t pin);
+void     simTriggerInterrupt(uint8_t interrupt);
+
+
+/**
+ * Simulated serial port, output is written to a stdio stream (stdout by default, NULL discards).
+ * The UART is modelled as on the target: a SIM_SERIAL_TX_SIZE byte TX buffer drained at the baud rate (10 bits per byte)
+ * in virtual time. Writing to a full buffer blocks, advancing the virtual clock as the target would stall.
+ */
+class cSimSerial
+{
+private:
+    FILE    *out;
+    uint32_t baud, rate, txBytes;
+    /**
+     * uSecs per byte on the line, virtual time the TX buffer is empty, total time stalled in write
+     */
+    double   usPerByte, usTxDone;
+    uint64_t usStalled;
+    /**
+     * received bytes not yet read (injected by the harness)
+     */
+    char     rxBuf[SIM_SERIAL_RX_SIZE];
+    uint8_t  rxHead, rxTail;
+
+    uint32_t txQueued(void);
+
+    size_t   printFloat(double value, int digits);
+
+public:
+    cSimSerial();
+    void     begin(uint32_t rate);
+    void     end(void);
+    void     flush(void);
+    void     setOutput(FILE *stream);
+    void     setRate(uint32_t bitsPerSec);
+    uint32_t getTxBytes(void);
+    uint64_t getStallTime(void);
+    int      available(void);
+    int      availableForWrite(void);
+    int      read(void);
+    void     inject(const char *str);
+
+    size_t   write(uint8_t c);
+    size_t   write(const uint8_t *buf, size_t len);
+    size_t   print(const char *str);
+    size_t   print(char c);
+    size_t   print(int value);
+    size_t   print(unsigned int value);
+    size_t   print(long value);
+    size_t   print(unsigned long value);
+    size_t   print(double value, int digits = 2);
+    size_t   println(void);
+    size_t   println(const char *str);
+    size_t   println(char c);
+    size_t   println(int value);
+    size_t   println(unsigned int value);
+    size_t   println(long value);
+    size_t   println(unsigned long value);
+    size_t   println(double value, int digits = 2);
+};
+
+extern cSimSerial Serial;
+
+#endif
@@ -0,0 +1,92 @@
+/**
+ * Telemetry decoder. Reads the binary telemetry stream of the sketch (serial port capture or dyno_sim output) and prints
+ * the serial plotter text the sketch used to print, or CSV with sequence numbers and timestamps.
+ *
+ * usage: tlm_decode [-c] [-x] [-p] [-s] [file]       (stdin if no file)
+ *    -c  CSV output
+ *    -x  print burst capture dumps as CSV (timestamp, counts and units per channel) instead of the data frames
+ *    -p  print scheduler profiles (latency histograms, sensor cycle counts) instead of the data frames
+ *    -s  print frame statistics to stderr
+ *
+ *    build/dyno_sim -t 10 | build/tlm_decode
+ *
+ * @author DJK
+ * @version 0.1
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tlmdecode.h"
+
+int main(int argc, char **argv)
+{
+    int   opt, c;
+    bool  csv = false, stats = false, capture = false, profile = false;
+    FILE *in = stdin;
+    cTlmDecoder Decoder;
+    cCapDecoder Capture;
+
+    while ((opt = getopt(argc, argv, "cxps")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c': csv     = true; break;
+        case 'x': capture = true; break;
+        case 'p': profile = true; break;
+        case 's': stats   = true; break;
+        default:
+            fprintf(stderr, "usage: %s [-c] [-x] [-p] [-s] [file]\n", argv[0]);
+            return(1);
+        }
+    }
+
+    if (optind < argc && !(in = fopen(argv[optind], "rb")))
+    {
+        fprintf(stderr, "cannot open %s\n", argv[optind]);
+        return(1);
+    }
+
+    while ((c = fgetc(in)) != EOF)
+    {
+        if (!Decoder.feed((UINT8)c))
+        {
+            continue;
+        }
+
+        if (capture)
+        {
+            if (Capture.addFrame(Decoder.getFrame()))
+            {
+                Capture.printCsv(stdout);
+                if (Capture.getClipped())
+                {
+                    fprintf(stderr, "capture: %u fields clipped on the target\n", (unsigned)Capture.getClipped());
+                }
+            }
+        }
+        else if (profile)
+        {
+            Decoder.printProfile(stdout);
+        }
+        else if (Decoder.getFrame()->type == TLM_FRAME_DATA)
+        {
+            if (csv)
+            {
+                Decoder.printCsv(stdout);
+            }
+            else
+            {
+                Decoder.printPlotter(stdout);
+            }
+        }
+    }
+
+    if (stats)
+    {
+        fprintf(stderr, "%lu frames, %lu CRC errors, %lu lost, %lu bytes discarded\n",
+                (unsigned long)Decoder.getFrames(), (unsigned long)Decoder.getCrcErrors(),
+                (unsigned long)Decoder.getLost(), (unsigned long)Decoder.getDiscarded());
+    }
+    return(0);
+}
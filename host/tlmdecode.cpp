@@ -0,0 +1,450 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tlmdecode.h"
+
+cTlmDecoder::cTlmDecoder()
+{
+    reset();
+}
+
+/**
+ * discard any partial frame, held values and statistics
+ */
+void cTlmDecoder::reset()
+{
+    pos       = 0;
+    seen      = 0;
+    updated   = 0;
+    frames    = 0;
+    crcErrors = 0;
+    lost      = 0;
+    discarded = 0;
+    nextSeq   = 0;
+    memset(values, 0, sizeof(values));
+    memset(&frm, 0, sizeof(frm));
+}
+
+/**
+ * Feed one received byte
+ *
+ * @return - true when a complete, valid frame has been decoded (getFrame), data frames also update the held values
+ */
+bool cTlmDecoder::feed(UINT8 byte)
+{
+    UINT8  retry[TLM_MAX_FRAME];
+    UINT16 n, i;
+    bool   done = false;
+
+    if (parse(byte))
+    {
+        if (frameDone())
+        {
+            return(true);
+        }
+
+        //bad frame, search for a sync word in the bytes after the false one
+        crcErrors++;
+        n = pos - 1;
+        memcpy(retry, &buf[1], n);
+        pos = 0;
+        discarded++;
+        for (i = 0; i < n; i++)
+        {
+            //a valid frame found inside is reported, anything after it is decoded on the following bytes
+            done = feed(retry[i]) || done;
+        }
+    }
+    return(done);
+}
+
+/**
+ * collect a byte into the frame buffer
+ *
+ * @return - true when a full frame (header, payload, CRC) has been collected
+ */
+bool cTlmDecoder::parse(UINT8 byte)
+{
+    //sync word
+    if ((pos == 0 && byte != TLM_SYNC0) || (pos == 1 && byte != TLM_SYNC1))
+    {
+        discarded += pos + 1;
+        pos = 0;
+        if (byte == TLM_SYNC0)
+        {
+            discarded--;
+            buf[pos++] = byte;
+        }
+        return(false);
+    }
+
+    //a length beyond the largest frame can only be a false sync
+    if (pos == 3 && byte > TLM_MAX_PAYLOAD)
+    {
+        discarded += 3;
+        pos = 0;
+        return(false);
+    }
+
+    buf[pos++] = byte;
+
+    return( pos >= TLM_HEADER_SIZE && pos == TLM_HEADER_SIZE + buf[3] + TLM_CRC_SIZE );
+}
+
+/**
+ * check the CRC of the collected frame and decode it
+ *
+ * @return - false if the CRC does not match
+ */
+bool cTlmDecoder::frameDone()
+{
+    const UINT8 *payload;
+    UINT16 bitmap;
+    UINT8  ch, at;
+
+    if (cTelemetryBase::crc16(&buf[2], pos - 2 - TLM_CRC_SIZE, 0xFFFF) != getU16(&buf[pos - TLM_CRC_SIZE]))
+    {
+        return(false);
+    }
+
+    frm.type   = buf[2];
+    frm.len    = buf[3];
+    frm.seq    = getU16(&buf[4]);
+    frm.usTime = getU32(&buf[6]);
+    memcpy(frm.payload, &buf[TLM_HEADER_SIZE], frm.len);
+    pos = 0;
+
+    //sequence gaps
+    if (frames)
+    {
+        lost += (UINT16)(frm.seq - nextSeq);
+    }
+    nextSeq = frm.seq + 1;
+    frames++;
+
+    //data frame, hold the values
+    updated = 0;
+    if (frm.type == TLM_FRAME_DATA && frm.len >= 2)
+    {
+        payload = frm.payload;
+        bitmap  = getU16(payload);
+        at      = 2;
+        for (ch = 0; ch < TLM_MAX_CHANNELS && at + 4 <= frm.len; ch++)
+        {
+            if (bitmap & (1U << ch))
+            {
+                values[ch] = (Q16)getU32(payload + at);
+                at += 4;
+                updated |= (1U << ch);
+            }
+        }
+        seen |= updated;
+    }
+    return(true);
+}
+
+/**
+ * @return - last decoded frame
+ */
+const TLM_FRAME *cTlmDecoder::getFrame()
+{
+    return(&frm);
+}
+
+/**
+ * @return - bitmap of the channels seen so far
+ */
+UINT16 cTlmDecoder::getChannels()
+{
+    return(seen);
+}
+
+/**
+ * @return - bitmap of the channels in the last data frame
+ */
+UINT16 cTlmDecoder::getUpdated()
+{
+    return(updated);
+}
+
+/**
+ * @return - latest value of a channel in engineering units
+ */
+double cTlmDecoder::getValue(UINT8 ch)
+{
+    return( ch < TLM_MAX_CHANNELS ? values[ch] / 65536.0 : 0.0 );
+}
+
+/**
+ * Print the latest values of all channels seen, space separated with 2 decimals (serial plotter text, as the sketch
+ * printed with Serial.print)
+ */
+void cTlmDecoder::printPlotter(FILE *out)
+{
+    UINT8 ch;
+    bool  first = true;
+
+    for (ch = 0; ch < TLM_MAX_CHANNELS; ch++)
+    {
+        if (seen & (1U << ch))
+        {
+            fprintf(out, first ? "%.2f" : " %.2f", getValue(ch));
+            first = false;
+        }
+    }
+    fputc('\n', out);
+}
+
+/**
+ * Print the last frame as CSV: sequence number, timestamp (uSecs), then the latest values of all channels seen
+ */
+void cTlmDecoder::printCsv(FILE *out)
+{
+    UINT8 ch;
+
+    fprintf(out, "%u,%lu", frm.seq, (unsigned long)frm.usTime);
+    for (ch = 0; ch < TLM_MAX_CHANNELS; ch++)
+    {
+        if (seen & (1U << ch))
+        {
+            fprintf(out, ",%.5f", getValue(ch));
+        }
+    }
+    fputc('\n', out);
+}
+
+/**
+ * Print the last frame if it is a scheduler profile frame (cTelemetryBase::sendProfile): a rate frame as its overruns and the
+ * time slice and start jitter histograms (bucket lower bound in uSecs, counts), a sensor frame as a line per sensor
+ *
+ * @return - false if the last frame is not a profile frame
+ */
+bool cTlmDecoder::printProfile(FILE *out)
+{
+    const UINT8 *p = frm.payload;
+    UINT8 b, buckets, i;
+
+    if (frm.type == TLM_FRAME_PROF_RATE && frm.len >= 9 && frm.len >= 9 + 4 * p[8])
+    {
+        buckets = p[8];
+        fprintf(out, "rate %luus, %lu overruns\n", (unsigned long)getU32(p), (unsigned long)getU32(p + 4));
+        fprintf(out, "  uSecs ");
+        for (b = 0; b < buckets; b++)
+        {
+            fprintf(out, b + 1 < buckets ? " %6lu" : " %5lu+", b ? 1UL << (b - 1) : 0UL);
+        }
+        fprintf(out, "\n  slice ");
+        for (b = 0; b < buckets; b++)
+        {
+            fprintf(out, " %6u", getU16(p + 9 + 2 * b));
+        }
+        fprintf(out, "\n  jitter");
+        for (b = 0; b < buckets; b++)
+        {
+            fprintf(out, " %6u", getU16(p + 9 + 2 * (buckets + b)));
+        }
+        fputc('\n', out);
+        return(true);
+    }
+
+    if (frm.type == TLM_FRAME_PROF_SENSOR && frm.len >= 2 && frm.len >= 2 + 8 * p[1])
+    {
+        for (i = 0; i < p[1]; i++)
+        {
+            fprintf(out, "sensor %u: %lu cycles, max %lu\n", p[0] + i,
+                    (unsigned long)getU32(p + 2 + 8 * i), (unsigned long)getU32(p + 6 + 8 * i));
+        }
+        return(true);
+    }
+    return(false);
+}
+
+UINT32 cTlmDecoder::getFrames()
+{
+    return(frames);
+}
+
+UINT32 cTlmDecoder::getCrcErrors()
+{
+    return(crcErrors);
+}
+
+UINT32 cTlmDecoder::getLost()
+{
+    return(lost);
+}
+
+UINT32 cTlmDecoder::getDiscarded()
+{
+    return(discarded);
+}
+
+/**
+ * little endian field readers
+ */
+UINT16 cTlmDecoder::getU16(const UINT8 *buf)
+{
+    return( (UINT16)(buf[0] | (buf[1] << 8)) );
+}
+
+UINT32 cTlmDecoder::getU32(const UINT8 *buf)
+{
+    return( (UINT32)buf[0] | ((UINT32)buf[1] << 8) | ((UINT32)buf[2] << 16) | ((UINT32)buf[3] << 24) );
+}
+
+
+/******************************************************************************
+ * Burst capture decoder
+ ******************************************************************************/
+
+cCapDecoder::cCapDecoder()
+{
+    chans    = 0;
+    records  = 0;
+    received = 0;
+    usFirst  = 0;
+    usPeriod = 0;
+    timeShift = 0;
+    clipped  = 0;
+    times    = NULL;
+    counts   = NULL;
+}
+
+cCapDecoder::~cCapDecoder()
+{
+    free(times);
+    free(counts);
+}
+
+/**
+ * Pass a decoded frame, capture info frames start a new capture, data frames fill in the records
+ *
+ * @return - true when the last record of the capture has been received
+ */
+bool cCapDecoder::addFrame(const TLM_FRAME *F)
+{
+    UINT16 r, first, f, fields;
+    UINT32 raw;
+    UINT8  ch;
+
+    if (F->type == TLM_FRAME_CAP_INFO && F->len >= 12 && F->payload[0] <= CAP_MAX_CHANNELS &&
+        F->len >= 12 + 8 * F->payload[0])
+    {
+        chans    = F->payload[0];
+        records  = cTlmDecoder::getU16(&F->payload[2]);
+        usFirst  = cTlmDecoder::getU32(&F->payload[4]);
+        usPeriod = cTlmDecoder::getU32(&F->payload[8]);
+        for (ch = 0; ch < chans; ch++)
+        {
+            raw = cTlmDecoder::getU32(&F->payload[12 + 8 * ch]);
+            memcpy(&slope[ch], &raw, 4);
+            raw = cTlmDecoder::getU32(&F->payload[16 + 8 * ch]);
+            memcpy(&offset[ch], &raw, 4);
+        }
+        //time tick and clipped fields, not sent by older firmware (uSec ticks)
+        timeShift = (F->len >= 15 + 8 * chans) ? F->payload[12 + 8 * chans] : 0;
+        clipped   = (F->len >= 15 + 8 * chans) ? cTlmDecoder::getU16(&F->payload[13 + 8 * chans]) : 0;
+        received = 0;
+        times  = (UINT32 *)realloc(times, (records + 1) * sizeof(UINT32));
+        counts = (UINT16 *)realloc(counts, (records * chans + 1) * sizeof(UINT16));
+        return(records == 0);
+    }
+
+    if (F->type != TLM_FRAME_CAP_DATA || F->len < 2 || !times)
+    {
+        return(false);
+    }
+
+    //whole records, in order (a lost frame leaves the capture incomplete)
+    first  = cTlmDecoder::getU16(F->payload);
+    fields = ((F->len - 2) * 2) / 3;
+    fields -= fields % (1 + chans);
+    if (first != received)
+    {
+        return(false);
+    }
+
+    for (f = 0; f < fields && received < records; f += 1 + chans)
+    {
+        r = received++;
+        times[r] = r ? times[r - 1] + ((UINT32)cCaptureBase::getField(&F->payload[2], f) << timeShift) : usFirst;
+        for (ch = 0; ch < chans; ch++)
+        {
+            counts[r * chans + ch] = cCaptureBase::getField(&F->payload[2], f + 1 + ch);
+        }
+    }
+    return(isComplete());
+}
+
+bool cCapDecoder::isComplete()
+{
+    return(times && received == records);
+}
+
+UINT16 cCapDecoder::getRecords()
+{
+    return(received);
+}
+
+UINT8 cCapDecoder::getChannels()
+{
+    return(chans);
+}
+
+/**
+ * @return - recording period in uSecs
+ */
+UINT32 cCapDecoder::getPeriod()
+{
+    return(usPeriod);
+}
+
+/**
+ * @return - number of fields the target clipped to CAP_FIELD_MAX (times or counts out of range)
+ */
+UINT16 cCapDecoder::getClipped()
+{
+    return(clipped);
+}
+
+/**
+ * @return - timestamp of a record (uSecs, micros() on the target)
+ */
+UINT32 cCapDecoder::getTime(UINT16 r)
+{
+    return( r < received ? times[r] : 0 );
+}
+
+/**
+ * @return - raw counts of a channel in a record
+ */
+UINT16 cCapDecoder::getCounts(UINT16 r, UINT8 ch)
+{
+    return( r < received && ch < chans ? counts[r * chans + ch] : 0 );
+}
+
+/**
+ * @return - value of a channel in a record in engineering units (sensor line equation sent in the info frame)
+ */
+double cCapDecoder::getValue(UINT16 r, UINT8 ch)
+{
+    return( ch < chans ? getCounts(r, ch) * (double)slope[ch] + offset[ch] : 0.0 );
+}
+
+/**
+ * Print the records as CSV: timestamp (uSecs), then counts and engineering units of each channel
+ */
+void cCapDecoder::printCsv(FILE *out)
+{
+    UINT16 r;
+    UINT8  ch;
+
+    for (r = 0; r < received; r++)
+    {
+        fprintf(out, "%lu", (unsigned long)times[r]);
+        for (ch = 0; ch < chans; ch++)
+        {
+            fprintf(out, ",%u,%.4f", getCounts(r, ch), getValue(r, ch));
+        }
+        fputc('\n', out);
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef TLMDECODE_H
+#define TLMDECODE_H
+
+/**
+ * Host side decoder for the binary telemetry frames sent by cTelemetry (see telemetry.h for the frame format).
+ * Bytes are fed in as they arrive, the decoder finds the sync word, checks the CRC and resynchronizes on errors.
+ * The latest value of every channel is held, so data frames carrying different channel sets (channels at different
+ * rates) can be printed as complete lines, e.g. the serial plotter text the sketch used to print.
+ *
+ * @author DJK
+ * @version 0.1
+ */
+
+#include "typedef.h"
+#include "telemetry.h"
+#include "capture.h"
+
+/**
+ * a decoded frame
+ */
+struct TLM_FRAME
+{
+    UINT8  type;
+    UINT8  len;
+    UINT16 seq;
+    UINT32 usTime;
+    UINT8  payload[TLM_MAX_PAYLOAD];
+};
+
+class cTlmDecoder
+{
+private:
+    UINT8     buf[TLM_MAX_FRAME];
+    UINT16    pos;
+    TLM_FRAME frm;
+    /**
+     * latest value of each channel (Q16.16), channels seen so far
+     */
+    Q16       values[TLM_MAX_CHANNELS];
+    UINT16    seen, updated;
+    /**
+     * statistics, frames decoded, CRC errors, frames lost (sequence gaps), bytes discarded while searching for sync
+     */
+    UINT32    frames, crcErrors, lost, discarded;
+    UINT16    nextSeq;
+
+    bool      parse(UINT8 byte);
+    bool      frameDone();
+
+public:
+    cTlmDecoder();
+    void      reset();
+    bool      feed(UINT8 byte);
+    const TLM_FRAME *getFrame();
+    UINT16    getChannels();
+    UINT16    getUpdated();
+    double    getValue(UINT8 ch);
+    void      printPlotter(FILE *out);
+    void      printCsv(FILE *out);
+    bool      printProfile(FILE *out);
+    UINT32    getFrames();
+    UINT32    getCrcErrors();
+    UINT32    getLost();
+    UINT32    getDiscarded();
+
+    static UINT16 getU16(const UINT8 *buf);
+    static UINT32 getU32(const UINT8 *buf);
+};
+
+
+/**
+ * Decoder for a burst capture dump (cCaptureBase::dump), rebuilds the records from the capture info and data frames
+ * passed in from cTlmDecoder. Timestamps are rebuilt from the first record's timestamp and the per record deltas.
+ */
+class cCapDecoder
+{
+private:
+    UINT8   chans;
+    UINT16  records, received;
+    UINT32  usFirst, usPeriod;
+    float   slope[CAP_MAX_CHANNELS], offset[CAP_MAX_CHANNELS];
+    /**
+     * time field tick (2^timeShift uSecs), fields clipped by the target
+     */
+    UINT8   timeShift;
+    UINT16  clipped;
+    /**
+     * per record timestamp and counts (records x chans)
+     */
+    UINT32 *times;
+    UINT16 *counts;
+
+public:
+    cCapDecoder();
+    ~cCapDecoder();
+    bool    addFrame(const TLM_FRAME *F);
+    bool    isComplete();
+    UINT16  getRecords();
+    UINT8   getChannels();
+    UINT32  getPeriod();
+    UINT16  getClipped();
+    UINT32  getTime(UINT16 r);
+    UINT16  getCounts(UINT16 r, UINT8 ch);
+    double  getValue(UINT16 r, UINT8 ch);
+    void    printCsv(FILE *out);
+};
+
+#endif
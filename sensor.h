@@ -2,10 +2,48 @@
 #define SENSOR_H
 #include "FIFOMath.h"
 #include "acquisition.h"
+#include "adc.h"
+#include "caltable.h"
+#include "calstore.h"
 
 //defines length of string array
 #define STR_LNGTH 10
 
+//default 2 point calibration, points on the line of the NEW_SENSOR slope/offset at 0 and full scale counts (10 bit)
+#define CAL_X2_DEFAULT 1023
+
+/**
+ * Q16.16 fixed point engineering units (16 bit signed integer part, 16 bit fraction), range +/-32768 units (Q16 is typedef'd in caltable.h)
+ */
+#define Q16_ONE            65536L
+#define Q16_TO_FLOAT(q)    ((float)(q) * (1.0 / 65536.0))
+#define FLOAT_TO_Q16(f)    floatToQ16(f)
+
+/**
+ * round a float to Q16.16, saturating at +/-32767.99998 units (a float to integer cast out of range is undefined)
+ *
+ * @param f - engineering units
+ * @return - Q16.16 value, NaN converts to 0
+ */
+static inline Q16 floatToQ16(float f)
+{
+    float q = f * 65536.0;
+
+    if (q >= 2147483647.0)
+    {
+        return((Q16)0x7FFFFFFFL);
+    }
+    if (q <= -2147483647.0)
+    {
+        return(-(Q16)0x7FFFFFFFL);
+    }
+    if (q != q)
+    {
+        return(0);
+    }
+    return((Q16)(q + (q < 0 ? -0.5 : 0.5)));
+}
+
 /**
  * rename for public access via sketch with something user friendly
  */
@@ -16,6 +54,14 @@
 #define scanTime()      cAcquire::getTimeSlice(false)
 #define scanTimeMax()   cAcquire::getTimeSlice(true)
 #define scanTimeReset() cAcquire::resetTimeSlice()
+#define scanMissed(rate)  cAcquire::getMissed(rate)
+#define scanSkipped(rate) cAcquire::getSkipped(rate)
+#define scanMissedReset() cAcquire::resetMissed()
+/**
+ * start/stop the free running ADC, sensors read the latest ADC block instead of converting inline (see cAdcScan)
+ */
+#define scanAdcStart(ref) cAdcScan::begin(ref)
+#define scanAdcStop()     cAdcScan::end()
 
 /**
  * pindef enum, to be used for setting IO mode of the pin and reading from analogs.
@@ -42,15 +88,60 @@ enum ADC_PINS
   PIN_19 = 19,
   PIN_20 = 20,
   PIN_27 = 27,
-  PIN_28 = 28
+  PIN_28 = 28,
+  PIN_NONE = 0xFF   //no analog input, the sensor is fed by its own readSensor (derived channels, counters)
+
+};
+
+
+/**
+ * Fixed point scale factor, precomputed from a float so that x * scale is an integer multiply and shift:
+ *    x * scale = ((x * mant) >> rshift) << lshift
+ * The mantissa is kept to 15 bits so that the partial products of a 32 bit input fit 32 bits (no 64 bit math on AVR).
+ */
+struct FIX_SCALE
+{
+  SINT16 mant;
+  UINT8  rshift;
+  UINT8  lshift;
+};
+
+/**
+ * Optional sensor features, or'd with the FIFO_FEATURES into the Features template parameter of the sensor classes
+ */
+enum SENSOR_FEATURES
+{
+  SENSOR_CACHED = 0x80  //float results cached per update (SENSOR_CACHE), for a sensor read several times per sample
+};
 
+/**
+ * Cached float results of a SENSOR_CACHED sensor: getReading (last sample, avg) and getVariance, and the update sequence
+ * number (cFIFOMathBase::updateSeq) each of those, getDerivative and getIntegral was computed at. A repeated read without
+ * a new sample returns the cached value.
+ */
+struct SENSOR_CACHE
+{
+  float   raw, avg, var;
+  UINT16  seqRaw, seqAvg, seqDt, seqIt, seqVar;
 };
 
+/**
+ * Pointers to the sensor storage owned by the derived class (see SENSOR_STORAGE), passed into cSensorBase on construction
+ */
+struct SENSOR_BUFFERS
+{
+  FIFO_BUFFERS  fifo;
+  /**
+   * float result cache, NULL when the sensor is not SENSOR_CACHED (every read converts)
+   */
+  SENSOR_CACHE  *cache;
+};
 
 /**
  * Sensor structure that is used to create a "new" sensor. All attributes of the sensor are defined here.
  * Name, slope, offset, pin number etc. The intention is for the user to statically define these
  * in the sketch and then create a sensor class, passing a reference to "NEW_SENSOR" into the class.
+ * The FIFO depths (avg, derivative, integral) are template parameters of the sensor class, so the storage is sized at compile time.
  * 
  * @author DJK
  * @version 0.1
@@ -77,19 +168,6 @@ struct NEW_SENSOR
    * The sensor class assumes a linear relationship between counts and units. This is the offset.
    */
   float offset;
-  /**
-   * Each sensor acquisition(sample) is put into a FIFO buffer giving way to computations that can be performed (sum, avg, derivative, integral).
-   * This determines the depth of the buffer for averaging, setting the max depth for other computaitons.
-   */
-  UINT8 sample_depth;
-  /**
-   * Depth of the derivative calculation (in # of samples)
-   */
-  UINT8 deriv_depth;
-  /**
-   * Depth of the integral calculation (in # of samples)
-   */
-  UINT8 integ_depth;
   /**
    * rate at which the sensor will be sampled by the acquisition scheduler.
    * (also determines time component for average, derivative and integral calculations)
@@ -99,27 +177,40 @@ struct NEW_SENSOR
 
 
 /**
- * Sensor class, resposnible for transforming an "ADC count" into meaningful sensor data. Provides transform of counts to a floating point
+ * Sensor base class, resposnible for transforming an "ADC count" into meaningful sensor data. Provides transform of counts to a floating point
  * number along with string names and units string for the sensor (engineering units). Derived from the FIFOMath class, allows for computations (avg, sum, derivative, integration)
  * on sensors based upon the last "N" (depth) samples of the input. This class is also derived from cAcquire which is a static base class that
  * can be used to schedule peroidic readings for all sensor objects (as defined by "rate" enum). A NEW_SENSOR struct reference is passed into the constructor for initialization and scheduling.
+ * The FIFO storage is provided by the derived cSensor template, which is the class the sketch creates.
  * 
- * @see cFifoMath
+ * @see cSensor
+ * @see cFIFOMathBase
  * @see cAcquire
  */
-class cSensor : cFIFOMath, cAcquire 
+class cSensorBase : cFIFOMathBase, cAcquire 
 {
+  friend class cCalStore;
+
 private:
 
   void  calcLine();
-  float normalize(UINT64 data);
+  void  StoreSetupData();
+  void  getCalRecord(CAL_RECORD *R);
+  void  setCalRecord(const CAL_RECORD *R);
+  void  calcFixed();
+  void  flushCache();
+  float normalize(UINT32 data);
   float normalize(UINT16 data);
-  float normalize(SINT32 data);
+  Q16   normalizeQ16(SINT32 data);
+  Q16   sampleQ16(UINT16 data);
+  void  updateFifo(UINT16 data);
+  float secsTick();
 
 public:
-  cSensor(NEW_SENSOR *S);
   void  setX1Y1(UINT16 X1value, float Y1value);
   void  setX2Y2(UINT16 X2value, float Y2value);
+  void  setCalibration(cCalTableBase *table);
+  bool  setCalPoint(UINT8 index, UINT16 X, float Y);
   virtual void  readSensor(void);
   float getReading(bool filtered);
   float getDerivative();
@@ -127,12 +218,37 @@ public:
   float getSum();
   float getMax();
   float getMin();
+  float getMaxLatched();
+  float getMinLatched();
+  float getVariance();
+  float getStdDev();
+  float getRms();
+  void  resetLatched();
+  FIFO_DT_MODE setDerivativeMode(FIFO_DT_MODE mode);
 
+  Q16   getReadingQ16(bool filtered);
+  Q16   getDerivativeQ16();
+  Q16   getIntegralQ16();
+  Q16   getSumQ16();
+  Q16   getMaxQ16();
+  Q16   getMinQ16();
+  Q16   getMaxLatchedQ16();
+  Q16   getMinLatchedQ16();
 
   ACQ_RATE getRate(void);
+  UINT16   getCounts(void);
+  float    getSlope(void);
+  float    getOffset(void);
   
 protected: 
 
+  cSensorBase(NEW_SENSOR *S, SENSOR_BUFFERS buffers, UINT8 depth, UINT8 dtDepth, UINT8 itDepth);
+
+  void      putSample(UINT16 data);
+
+  static void   setScale(float value, UINT8 fracBits, FIX_SCALE *S);
+  static SINT32 scale(SINT32 data, const FIX_SCALE *S);
+
   /**
    * Y coordinates used for mapping coordinates for y = mx + b transform. Y is specified in floating eng units
    */
@@ -145,6 +261,22 @@ protected:
    * slope and offset components used for linerization to engineering units
    */
   float     m,b;
+  /**
+   * multi point calibration, NULL for the line equation. Single sample values (reading, avg, max, min) are converted by
+   * the table, sums of samples (sum, derivative, integral, variance) by the line through the end points of the table
+   */
+  cCalTableBase *cal;
+  /**
+   * fixed point line equation (from m,b) used by the Q16 getters, recomputed by calcLine. The derivative and integral
+   * have the time base (from rate) folded in, so that only the final result needs to be in the Q16.16 range.
+   * The derivative is a rate of change, so it has no offset, its scale also divides by cFIFOMathBase::derivDiv.
+   */
+  FIX_SCALE mFix, mDtFix, mItFix;
+  Q16       bFix, bItFix;
+  /**
+   * float derivative scale, m * hz / derivDiv
+   */
+  float     mDt;
   /**
   * ADC sensor data raw data in counts, last known reading
   */
@@ -154,6 +286,14 @@ protected:
   */
   float     normalData, normalDataDt, normalDataIt;
   /**
+  * float result cache (SENSOR_CACHED), NULL if not cached
+  */
+  SENSOR_CACHE *cache;
+  /**
+  * time base of the sampling rate, in seconds and Hz
+  */
+  float     secs, hz;
+  /**
   *  sensor units name (ASCII string) 
   */
   char units[STR_LNGTH] ;
@@ -166,9 +306,70 @@ protected:
   */
   ADC_PINS  pinNum;
   /**
+  * channel of the pin in the free running ADC scan, sequence number of the last ADC block consumed
+  */
+  UINT8     adcChan, adcSeq;
+  /**
   * Periodic update rate for sensor 
   */
   ACQ_RATE  rate;
+  /**
+  * record of the sensor in the calibration store (cCalStore), CAL_STORE_NONE if not stored
+  */
+  UINT8     storeRec;
+};
+
+
+/**
+ * Float result cache, empty when the sensor is not SENSOR_CACHED
+ */
+template <bool Cached>
+struct SENSOR_CACHE_STORAGE
+{
+  SENSOR_CACHE *cacheBuffer() { return(NULL); }
+};
+
+template <>
+struct SENSOR_CACHE_STORAGE<true>
+{
+  SENSOR_CACHE cacheData;
+
+  SENSOR_CACHE *cacheBuffer() { return(&cacheData); }
+};
+
+/**
+ * Sensor storage sized at compile time: the FIFO storage and the optional features, see FIFO_STORAGE and SENSOR_FEATURES
+ */
+template <UINT8 Depth, UINT8 DtDepth, UINT8 ItDepth, UINT8 Features = 0>
+struct SENSOR_STORAGE : FIFO_STORAGE<Depth, DtDepth, ItDepth, Features>, SENSOR_CACHE_STORAGE<(Features & SENSOR_CACHED) != 0>
+{
+  SENSOR_BUFFERS buffers()
+  {
+    SENSOR_BUFFERS B = {FIFO_STORAGE<Depth, DtDepth, ItDepth, Features>::buffers(), this->cacheBuffer()};
+    return(B);
+  }
+};
+
+
+/**
+ * Sensor class with FIFO storage sized at compile time, this is the class created by the sketch.
+ * 
+ * @param Depth    - Each sensor acquisition(sample) is put into a FIFO buffer giving way to computations that can be performed (sum, avg, derivative, integral).
+ *                   This determines the depth of the buffer for averaging, setting the max depth for other computaitons.
+ * @param DtDepth  - Depth of the derivative calculation (in # of samples), 0 disables
+ * @param ItDepth  - Depth of the integral calculation (in # of samples), 0 disables
+ * @param Features - optional features, FIFO_FEATURES and SENSOR_FEATURES or'd, each costs RAM only in the sensors that have it:
+ *                   FIFO_TIMED timestamps each sample, the derivative and integral use the measured time between samples
+ *                   rather than the nominal rate (for a scan that runs late), 2 bytes per sample and a micros() per read.
+ *                   FIFO_LSQ allows the least squares derivative, FIFO_SUMSQ makes the variance / RMS O(1),
+ *                   SENSOR_CACHED caches the float results per sample
+ * @see cSensorBase
+ */
+template <UINT8 Depth, UINT8 DtDepth = 1, UINT8 ItDepth = 1, UINT8 Features = 0>
+class cSensor : private SENSOR_STORAGE<Depth, DtDepth, ItDepth, Features>, public cSensorBase
+{
+public:
+  cSensor(NEW_SENSOR *S) : cSensorBase(S, this->buffers(), Depth, DtDepth, ItDepth) {}
 };
 
 
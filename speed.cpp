@@ -0,0 +1,267 @@
+#include "speed.h"
+
+/**
+ * Static re-declarations for cSpeed class (memory allocation for statics)
+ */
+cSpeed* cSpeed::Inputs[MAX_NUM_SPEED];
+UINT8   cSpeed::inputCnt;
+
+/**
+ * Constructor for the speed class.
+ *
+ * @param pin          - digital input pin the pulse train is connected to. Must support an external interrupt (pin 2 or 3 on UNO)
+ * @param pulsesPerRev - number of pulses per revolution, used for RPM scaling
+ * @param periods      - number of periods to average for the speed calculation, clipped to 1 - (SPEED_RING_SIZE - 1)
+ * @param usTimeout    - time in uSecs without an edge after which the input is considered stopped
+ */
+cSpeed::cSpeed(UINT8 pin, UINT8 pulsesPerRev, UINT8 periods, UINT32 usTimeout)
+{
+    pinNum     = pin;
+    pulsesRev  = pulsesPerRev;
+    timeout    = usTimeout ? usTimeout : SPEED_TIMEOUT_DEFAULT;
+
+    //clip # periods, we need N+1 timestamps in the ring for N periods
+    numPeriods = (periods > 0 && periods < SPEED_RING_SIZE) ? periods : SPEED_RING_SIZE - 1;
+
+    head    = 0;
+    edgeCnt = 0;
+}
+
+/**
+ * Set the pin mode and attach the edge timestamp ISR to the input pin. Bound by MAX_NUM_SPEED, objects beyond that
+ * may still be fed through the "edge" method.
+ */
+void cSpeed::begin()
+{
+    void (*isr)(void);
+
+    pinMode(pinNum, INPUT);
+
+    if (inputCnt < MAX_NUM_SPEED)
+    {
+        Inputs[inputCnt] = this;
+        isr = (inputCnt == 0) ? cSpeed::isr0 : cSpeed::isr1;
+        inputCnt++;
+
+#ifdef MAPLE
+        attachInterrupt(pinNum, isr, RISING);
+#else
+        attachInterrupt(digitalPinToInterrupt(pinNum), isr, RISING);
+#endif
+    }
+}
+
+/**
+ * ISR trampolines, timestamp the edge and push into the ring of the attached object
+ */
+void cSpeed::isr0()
+{
+    Inputs[0]->edge(micros());
+}
+
+void cSpeed::isr1()
+{
+    Inputs[1]->edge(micros());
+}
+
+/**
+ * Push a new edge timestamp into the ring buffer. This is called from interrupt context, so it is kept short.
+ * If the input has been stopped for longer than the timeout, the averaging is restarted so that the stopped time
+ * is not included in the first periods after restart.
+ *
+ * @param usStamp - time of the edge in uSecs (micros())
+ */
+void cSpeed::edge(UINT32 usStamp)
+{
+    //restart averaging after a stop (unsigned subtraction is rollover safe)
+    if (edgeCnt && ((usStamp - edgeStamps[head]) > timeout))
+    {
+        edgeCnt = 0;
+    }
+
+    head = (head + 1) & (SPEED_RING_SIZE - 1);
+    edgeStamps[head] = usStamp;
+
+    edgeCnt = (edgeCnt < SPEED_RING_SIZE) ? edgeCnt + 1 : SPEED_RING_SIZE;
+}
+
+/**
+ * Discard all captured edges, speed reads as stopped until enough new edges arrive
+ */
+void cSpeed::reset()
+{
+    noInterrupts();
+    edgeCnt = 0;
+    interrupts();
+}
+
+/**
+ * Get the average period of the last "N" periods. Non blocking, computed from the timestamps in the ring buffer.
+ * If the time since the last edge is longer than the average period, the input is slowing down and the elapsed time is
+ * used instead (speed can be no higher than that).
+ *
+ * @return - period in uSecs, 0 if the input is stopped (timeout) or not enough edges have been captured
+ */
+UINT32 cSpeed::getPeriod()
+{
+    UINT32 newest, oldest, sinceEdge, period;
+    UINT8  n;
+
+    //take a consistent snapshot of the ring, the ISR may push a new edge at any time
+    noInterrupts();
+    n = edgeCnt;
+    //N+1 edges for N periods
+    n = (n > numPeriods) ? numPeriods : (n ? n - 1 : 0);
+    newest = edgeStamps[head];
+    oldest = edgeStamps[(head - n) & (SPEED_RING_SIZE - 1)];
+    interrupts();
+
+    //need at least one full period
+    if (!n)
+    {
+        return(0);
+    }
+
+    //zero speed timeout
+    sinceEdge = micros() - newest;
+    if (sinceEdge > timeout)
+    {
+        return(0);
+    }
+
+    period = (newest - oldest) / n;
+
+    //decelerating, the next edge is late
+    return( sinceEdge > period ? sinceEdge : period );
+}
+
+/**
+ * Get the input frequency in Hz (pulses per second)
+ *
+ * @return - frequency in Hz, 0.0 if stopped
+ */
+float cSpeed::getFreq()
+{
+    UINT32 period = getPeriod();
+
+    return( period ? 1000000.0 / period : 0.0 );
+}
+
+/**
+ * Get the speed in revolutions per minute, scaled by pulses per revolution
+ *
+ * @return - speed in RPM, 0.0 if stopped
+ */
+float cSpeed::getRPM()
+{
+    return( pulsesRev ? (getFreq() / pulsesRev) * 60.0 : 0.0 );
+}
+
+/**
+ * @return - true if no edge has been seen within the timeout, or not enough edges captured
+ */
+bool cSpeed::isStopped()
+{
+    return( getPeriod() == 0 );
+}
+
+/**
+ * Copy the newest edge timestamps, for per pulse processing (e.g. acceleration). Only the edges since the last restart
+ * (timeout) are returned.
+ *
+ * @param stamps - destination, oldest first
+ * @param n      - max number of timestamps, clipped to SPEED_RING_SIZE
+ * @return - number of timestamps copied
+ */
+UINT8 cSpeed::getEdges(UINT32 *stamps, UINT8 n)
+{
+    UINT8 i, newest;
+
+    n = n < SPEED_RING_SIZE ? n : SPEED_RING_SIZE;
+
+    //consistent snapshot of the ring
+    noInterrupts();
+    n = n < edgeCnt ? n : edgeCnt;
+    newest = head;
+    for (i = 0; i < n; i++)
+    {
+        stamps[i] = edgeStamps[(newest - (n - 1) + i) & (SPEED_RING_SIZE - 1)];
+    }
+    interrupts();
+
+    return(n);
+}
+
+/**
+ * @return - pulses per revolution
+ */
+UINT8 cSpeed::getPulsesRev()
+{
+    return(pulsesRev);
+}
+
+
+/**
+ * Simulated edge source constructor
+ *
+ * @param S      - speed object that receives the simulated edges
+ */
+cEdgeSim::cEdgeSim(cSpeed *S)
+{
+    target     = S;
+    usPeriod   = 0;
+    usNextEdge = 0;
+    freq       = 0;
+    hzPerSec   = 0;
+}
+
+/**
+ * Set the frequency of the simulated input, the first edge is one period from now
+ *
+ * @param hz     - frequency in Hz, 0 stops the input
+ */
+void cEdgeSim::setFreq(float hz)
+{
+    setSweep(hz, 0.0);
+}
+
+/**
+ * Set a linearly changing frequency (acceleration sweep), the frequency is updated at every edge
+ *
+ * @param hz     - starting frequency in Hz
+ * @param hzRate - rate of change in Hz per second (0 = constant), the input stops if the frequency falls to 0
+ */
+void cEdgeSim::setSweep(float hz, float hzRate)
+{
+    freq       = hz;
+    hzPerSec   = hzRate;
+    usPeriod   = (hz > 0.0) ? (UINT32)(1000000.0 / hz) : 0;
+    usNextEdge = micros() + usPeriod;
+}
+
+/**
+ * Push all edges that have come due into the target with their ideal timestamps. Call periodically (main loop).
+ *
+ * @param usNow  - current time in uSecs (micros())
+ */
+void cEdgeSim::run(UINT32 usNow)
+{
+    if (target && usPeriod)
+    {
+        //signed compare is rollover safe
+        while ((SINT32)(usNow - usNextEdge) >= 0)
+        {
+            target->edge(usNextEdge);
+            if (hzPerSec)
+            {
+                freq    += hzPerSec * usPeriod * 0.000001;
+                usPeriod = (freq > 0.0) ? (UINT32)(1000000.0 / freq) : 0;
+                if (!usPeriod)
+                {
+                    break;
+                }
+            }
+            usNextEdge += usPeriod;
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef SPEED_H
+#define SPEED_H
+#include "typedef.h"
+
+/**
+ * depth of the edge timestamp ring buffer. Must be a power of 2, as the index wraparound is masked.
+ * This bounds the number of periods that may be used for the speed computation (SPEED_RING_SIZE - 1)
+ */
+#define SPEED_RING_SIZE 16
+
+/**
+ * default time (uSecs) without an edge after which the speed input is considered stopped
+ */
+#define SPEED_TIMEOUT_DEFAULT 500000
+
+/**
+ * max number of speed inputs that may be attached to an external interrupt (one ISR trampoline each)
+ */
+#define MAX_NUM_SPEED 2
+
+
+/**
+ * The speed class timestamps the rising edges of a pulse input (tooth wheel, hall sensor, opto etc) from an interrupt, and stores them
+ * into a ring buffer. The frequency, period and RPM are then calculated from the last "N" periods in the buffer without blocking the main
+ * loop (as pulseIn() does). If no edge is seen within the timeout, the input is reported as stopped (0Hz).
+ *
+ * The "edge" method is public so that the timestamps can come from a source other than the interrupt (input capture, simulation).
+ *
+ * @author DJK
+ * @version 0.1
+ */
+class cSpeed
+{
+private:
+    /**
+     * ring buffer of edge timestamps in uSecs (micros() at time of edge)
+     */
+    volatile UINT32 edgeStamps[SPEED_RING_SIZE];
+    /**
+     * index of the newest timestamp in the ring buffer
+     */
+    volatile UINT8  head;
+    /**
+     * number of edges captured, saturates at SPEED_RING_SIZE (used to wait for enough periods to average)
+     */
+    volatile UINT8  edgeCnt;
+    /**
+     * number of periods used for the average, pulses per revolution, input pin
+     */
+    UINT8  numPeriods, pulsesRev, pinNum;
+    /**
+     * time (uSecs) without an edge after which the input is considered stopped
+     */
+    UINT32 timeout;
+
+    /**
+     * list of objects attached to external interrupts, indexed by ISR trampoline
+     */
+    static cSpeed *Inputs[MAX_NUM_SPEED];
+    /**
+     * number of objects attached to external interrupts
+     */
+    static UINT8 inputCnt;
+    static void isr0();
+    static void isr1();
+
+public:
+    cSpeed(UINT8 pin, UINT8 pulsesPerRev, UINT8 periods, UINT32 usTimeout);
+    void   begin();
+    void   edge(UINT32 usStamp);
+    void   reset();
+    UINT32 getPeriod();
+    float  getFreq();
+    float  getRPM();
+    bool   isStopped();
+    UINT8  getEdges(UINT32 *stamps, UINT8 n);
+    UINT8  getPulsesRev();
+};
+
+
+/**
+ * Simulated edge source. Generates edges at a requested frequency and pushes the (ideal) timestamps into a cSpeed object
+ * as they come due. Used to exercise the speed measurement without a pulse input (bench testing, host build).
+ *
+ * @see cSpeed
+ */
+class cEdgeSim
+{
+private:
+    /**
+     * object receiving the simulated edges
+     */
+    cSpeed *target;
+    /**
+     * period of the simulated input in uSecs (0 = stopped), timestamp of the next edge
+     */
+    UINT32 usPeriod, usNextEdge;
+    /**
+     * frequency and its rate of change (Hz per second) for acceleration sweeps
+     */
+    float  freq, hzPerSec;
+
+public:
+    cEdgeSim(cSpeed *S);
+    void setFreq(float hz);
+    void setSweep(float hz, float hzRate);
+    void run(UINT32 usNow);
+};
+
+#endif
@@ -0,0 +1,178 @@
+#include <string.h>
+#include "sweep.h"
+
+//rad/s per RPM
+#define SWEEP_RPM_RAD  0.10471976
+//rad per revolution
+#define SWEEP_TWO_PI   6.2831853
+
+/**
+ * Sweep constructor, registers the measurement with the acquisition scheduler
+ *
+ * @param S            - speed input (edge timestamps)
+ * @param brakeTorque  - brake torque sensor (Nm), NULL if none. Should be read at "rate" or faster
+ * @param rotorInertia - inertia of everything turning at the measured speed, kg*m^2
+ * @param edges        - number of edges in the acceleration fit, clipped to SWEEP_FIT_MIN..SWEEP_FIT_MAX
+ * @param rate         - output rate (e.g. _100Hz_Rate)
+ */
+cSweep::cSweep(cSpeed *S, cSensorBase *brakeTorque, float rotorInertia, UINT8 edges, ACQ_RATE rate)
+{
+    speed     = S;
+    brake     = brakeTorque;
+    inertia   = rotorInertia;
+    fitPoints = edges < SWEEP_FIT_MIN ? SWEEP_FIT_MIN : (edges > SWEEP_FIT_MAX ? SWEEP_FIT_MAX : edges);
+    running   = false;
+    memset(&point, 0, sizeof(point));
+    memset(&peakPower, 0, sizeof(peakPower));
+    memset(&peakTorque, 0, sizeof(peakTorque));
+
+    cAcquire::addHook(rate, cSweep::tickHook, this);
+}
+
+/**
+ * start a sweep, the peaks are cleared
+ */
+void cSweep::start()
+{
+    memset(&peakPower, 0, sizeof(peakPower));
+    memset(&peakTorque, 0, sizeof(peakTorque));
+    running = true;
+}
+
+/**
+ * stop the sweep, the last point and the peaks are held
+ */
+void cSweep::stop()
+{
+    running = false;
+}
+
+bool cSweep::isRunning()
+{
+    return(running);
+}
+
+/**
+ * @param rotorInertia - inertia of everything turning at the measured speed, kg*m^2
+ */
+void cSweep::setInertia(float rotorInertia)
+{
+    inertia = rotorInertia;
+}
+
+/**
+ * @return - latest curve point, updated on every tick while running. The members may be sent as telemetry values.
+ */
+const SWEEP_POINT* cSweep::getPoint()
+{
+    return(&point);
+}
+
+/**
+ * @return - point of max power seen during the sweep
+ */
+const SWEEP_POINT* cSweep::getPeakPower()
+{
+    return(&peakPower);
+}
+
+/**
+ * @return - point of max torque seen during the sweep
+ */
+const SWEEP_POINT* cSweep::getPeakTorque()
+{
+    return(&peakTorque);
+}
+
+void cSweep::tickHook(void *ctx)
+{
+    ((cSweep*)ctx)->tick();
+}
+
+/**
+ * Least squares line through the speed of each pulse period (at the middle of the period), time relative to the newest edge.
+ *
+ * @param omega - speed at the newest edge, rad/s
+ * @param alpha - acceleration, rad/s^2
+ * @return - false if there are not enough edges (stopped)
+ */
+bool cSweep::fit(float *omega, float *alpha)
+{
+    UINT32 stamps[SWEEP_FIT_MAX];
+    UINT32 period;
+    UINT8  n, k;
+    float  radPerPulse, x, y, sx = 0, sy = 0, sxx = 0, sxy = 0, det;
+
+    if (speed->isStopped())
+    {
+        return(false);
+    }
+    n = speed->getEdges(stamps, fitPoints);
+    if (n < SWEEP_FIT_MIN)
+    {
+        return(false);
+    }
+
+    radPerPulse = SWEEP_TWO_PI / speed->getPulsesRev();
+
+    //n - 1 periods, x in seconds before the newest edge (unsigned differences are rollover safe)
+    for (k = 1; k < n; k++)
+    {
+        period = stamps[k] - stamps[k-1];
+        if (!period)
+        {
+            return(false);
+        }
+        x = -0.000001 * ((stamps[n-1] - stamps[k]) + 0.5 * period);
+        y = radPerPulse * 1000000.0 / period;
+        sx  += x;
+        sy  += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    n--;
+
+    det = n * sxx - sx * sx;
+    if (det <= 0)
+    {
+        return(false);
+    }
+    *alpha = (n * sxy - sx * sy) / det;
+    //intercept, the speed at x = 0 (newest edge)
+    *omega = (sy - *alpha * sx) / n;
+
+    return(true);
+}
+
+/**
+ * compute the curve point, runs after the sensors of the rate so the brake torque is this tick's reading
+ */
+void cSweep::tick()
+{
+    float omega, alpha;
+
+    if (!running)
+    {
+        return;
+    }
+
+    if (!fit(&omega, &alpha))
+    {
+        memset(&point, 0, sizeof(point));
+        return;
+    }
+
+    point.rpm    = omega / SWEEP_RPM_RAD;
+    point.alpha  = alpha;
+    point.torque = inertia * alpha + (brake ? brake->getReading(false) : 0.0);
+    point.power  = point.torque * omega;
+
+    if (point.power > peakPower.power)
+    {
+        peakPower = point;
+    }
+    if (point.torque > peakTorque.torque)
+    {
+        peakTorque = point;
+    }
+}
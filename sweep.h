@@ -0,0 +1,78 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+#include "typedef.h"
+#include "sensor.h"
+#include "speed.h"
+
+/**
+ * number of edges (pulse periods + 1) in the acceleration fit, bound by the speed edge ring
+ */
+#define SWEEP_FIT_DEFAULT 8
+#define SWEEP_FIT_MAX     SPEED_RING_SIZE
+#define SWEEP_FIT_MIN     3
+
+/**
+ * one point of the power/torque vs speed curve
+ */
+struct SWEEP_POINT
+{
+  float rpm;      //fitted speed at the newest edge
+  float alpha;    //angular acceleration, rad/s^2
+  float torque;   //inertia torque + brake torque, Nm
+  float power;    //Watts
+};
+
+
+/**
+ * Inertia (acceleration) sweep measurement. During a sweep the rotor is accelerated (or coasts down) through the speed
+ * range, the torque needed to accelerate the rotor is its inertia times the angular acceleration, so the power curve
+ * can be measured with a light brake, or none at all.
+ *
+ * On every tick of its rate (a cAcquire tick hook) the newest edge timestamps of the speed input are read, each pulse
+ * period gives a speed sample at the middle of the period, and a least squares line through the samples gives the
+ * acceleration (slope) and the speed at the newest edge. This averages the edge jitter over the fit window without the
+ * lag of filtering the speed first and then differentiating.
+ *
+ *   torque = inertia * alpha + brake torque,    power = torque * omega
+ *
+ * Peak power and peak torque (with their speeds) are latched while the sweep runs.
+ *
+ * @author DJK
+ * @version 0.1
+ */
+class cSweep
+{
+private:
+  cSpeed       *speed;
+  /**
+   * measured brake torque (Nm), NULL for a pure inertia dyno
+   */
+  cSensorBase  *brake;
+  /**
+   * rotor inertia in kg*m^2, edges in the fit
+   */
+  float         inertia;
+  UINT8         fitPoints;
+  bool          running;
+  /**
+   * latest point, peaks
+   */
+  SWEEP_POINT   point, peakPower, peakTorque;
+
+  static void   tickHook(void *ctx);
+  void          tick();
+  bool          fit(float *omega, float *alpha);
+
+public:
+  cSweep(cSpeed *S, cSensorBase *brakeTorque, float rotorInertia, UINT8 edges, ACQ_RATE rate);
+
+  void               start();
+  void               stop();
+  bool               isRunning();
+  void               setInertia(float rotorInertia);
+  const SWEEP_POINT* getPoint();
+  const SWEEP_POINT* getPeakPower();
+  const SWEEP_POINT* getPeakTorque();
+};
+
+#endif
@@ -0,0 +1,551 @@
+#include "telemetry.h"
+
+#if (TLM_TX_SIZE & (TLM_TX_SIZE - 1)) || TLM_TX_SIZE > 32768
+#error "TLM_TX_SIZE must be a power of 2, 32768 max"
+#endif
+
+#if defined(ACQ_PROFILE) && (9 + 4 * ACQ_HIST_BUCKETS) > TLM_MAX_PAYLOAD
+#error "ACQ_HIST_BUCKETS too large for a profile frame"
+#endif
+
+/**
+ * Constructor for the TX ring buffer, empty
+ */
+cTxRing::cTxRing()
+{
+    head = 0;
+    tail = 0;
+}
+
+/**
+ * Queue a block of bytes (a frame), all or nothing. Never waits.
+ *
+ * @return - false if there is not enough room, nothing is queued
+ */
+bool cTxRing::put(const UINT8 *data, UINT16 len)
+{
+    UINT16 i;
+
+    if (len > getFree())
+    {
+        return(false);
+    }
+
+    for (i = 0; i < len; i++)
+    {
+        buf[(head + i) & (TLM_TX_SIZE - 1)] = data[i];
+    }
+    head += len;
+
+    return(true);
+}
+
+/**
+ * Move queued bytes into the serial port, only as many as its TX buffer has room for so that the write does not block.
+ * Call from loop().
+ */
+void cTxRing::service()
+{
+    UINT16 room, len, pos;
+
+    room = Serial.availableForWrite();
+
+    while (room && head != tail)
+    {
+        //contiguous part of the ring
+        pos = tail & (TLM_TX_SIZE - 1);
+        len = getUsed();
+        len = len < (UINT16)(TLM_TX_SIZE - pos) ? len : TLM_TX_SIZE - pos;
+        len = len < room ? len : room;
+
+        Serial.write(&buf[pos], len);
+        tail += len;
+        room -= len;
+    }
+}
+
+/**
+ * @return - number of bytes queued
+ */
+UINT16 cTxRing::getUsed()
+{
+    return(head - tail);
+}
+
+/**
+ * @return - number of bytes free
+ */
+UINT16 cTxRing::getFree()
+{
+    return(TLM_TX_SIZE - (head - tail));
+}
+
+
+/**
+ * Constructor for the telemetry class, no channels
+ *
+ * @param storage - channel table, owned by the derived class
+ * @param maxChan - size of the channel table
+ */
+cTelemetryBase::cTelemetryBase(TLM_CHANNEL *storage, UINT8 maxChan)
+{
+    channels    = storage;
+    maxChannels = maxChan;
+    chanCnt = 0;
+    seq     = 0;
+    policy  = TLM_TX_COALESCE;
+    pending = 0;
+#ifdef ACQ_PROFILE
+    profNext = TLM_PROF_IDLE;
+#endif
+    resetCounters();
+}
+
+/**
+ * add a channel, bound by the size of the channel table
+ *
+ * @return - channel index (bit in the frame bitmap), TLM_MAX_CHANNELS if the list is full
+ */
+UINT8 cTelemetryBase::addChannel(cSensorBase *S, const void *var, TLM_SOURCE source, ACQ_RATE rate)
+{
+    TLM_CHANNEL *C;
+
+    if (chanCnt >= maxChannels)
+    {
+        return(TLM_MAX_CHANNELS);
+    }
+
+    C = &channels[chanCnt];
+    C->sensor = S;
+    C->var    = var;
+    C->source = source;
+    chanCnt++;
+    setRate(chanCnt - 1, rate);
+
+    return(chanCnt - 1);
+}
+
+/**
+ * Add a sensor value channel
+ *
+ * @param S      - sensor
+ * @param source - value of the sensor to send (reading, average, derivative etc)
+ * @param rate   - rate the channel is sent at, NONE = only sent by "sendData"
+ * @return - channel index (bit in the frame bitmap), TLM_MAX_CHANNELS if the list is full
+ */
+UINT8 cTelemetryBase::addSensor(cSensorBase *S, TLM_SOURCE source, ACQ_RATE rate)
+{
+    return( S && source < TLM_Q16_VAR ? addChannel(S, NULL, source, rate) : TLM_MAX_CHANNELS );
+}
+
+/**
+ * Add a sketch variable channel, the variable is read when the frame is built
+ *
+ * @param var  - Q16.16 or float variable
+ * @param rate - rate the channel is sent at, NONE = only sent by "sendData"
+ * @return - channel index (bit in the frame bitmap), TLM_MAX_CHANNELS if the list is full
+ */
+UINT8 cTelemetryBase::addValue(const Q16 *var, ACQ_RATE rate)
+{
+    return( var ? addChannel(NULL, var, TLM_Q16_VAR, rate) : TLM_MAX_CHANNELS );
+}
+
+UINT8 cTelemetryBase::addValue(const float *var, ACQ_RATE rate)
+{
+    return( var ? addChannel(NULL, var, TLM_FLOAT_VAR, rate) : TLM_MAX_CHANNELS );
+}
+
+/**
+ * Change the rate of a channel, the first send is one period from now
+ *
+ * @param ch   - channel index
+ * @param rate - rate the channel is sent at, NONE turns the periodic send off
+ */
+void cTelemetryBase::setRate(UINT8 ch, ACQ_RATE rate)
+{
+    if (ch < chanCnt)
+    {
+        channels[ch].usPeriod = (UINT32)rate;
+        channels[ch].usNext   = micros() + (UINT32)rate;
+    }
+}
+
+/**
+ * Set what to do with data frames that do not fit in the TX ring buffer
+ *
+ * @param txPolicy - TLM_TX_DROP or TLM_TX_COALESCE (default)
+ */
+void cTelemetryBase::setPolicy(TLM_TX_POLICY txPolicy)
+{
+    policy  = txPolicy;
+    pending = 0;
+}
+
+/**
+ * read the value of a channel in Q16.16
+ */
+Q16 cTelemetryBase::getValue(TLM_CHANNEL *C)
+{
+    switch (C->source)
+    {
+    case TLM_READING:    return(C->sensor->getReadingQ16(false));
+    case TLM_AVG:        return(C->sensor->getReadingQ16(true));
+    case TLM_DERIVATIVE: return(C->sensor->getDerivativeQ16());
+    case TLM_INTEGRAL:   return(C->sensor->getIntegralQ16());
+    case TLM_MAX:        return(C->sensor->getMaxQ16());
+    case TLM_MIN:        return(C->sensor->getMinQ16());
+    case TLM_Q16_VAR:    return(*(const Q16 *)C->var);
+    case TLM_FLOAT_VAR:  return(FLOAT_TO_Q16(*(const float *)C->var));
+    }
+    return(0);
+}
+
+/**
+ * Telemetry service, call from loop(). Moves queued bytes to the serial port and sends one data frame with all channels
+ * that are due. Deadlines are advanced by whole periods (no drift), a channel that fell behind by more than a period is
+ * re-based rather than sent repeatedly. A frame that does not fit is handled by the TX policy: dropped, or its channels
+ * are held and sent (with the latest values) in the next frame, as soon as it fits.
+ */
+void cTelemetryBase::run()
+{
+    TLM_CHANNEL *C;
+    UINT32 now = micros();
+    UINT16 bitmap = 0;
+    UINT8  ch;
+
+    tx.service();
+
+#ifdef ACQ_PROFILE
+    //profile being sent, one frame per call as room allows
+    if (profNext != TLM_PROF_IDLE)
+    {
+        sendProfileFrame();
+    }
+#endif
+
+    for (ch = 0; ch < chanCnt; ch++)
+    {
+        C = &channels[ch];
+
+        //signed difference is rollover safe
+        if (C->usPeriod && (SINT32)(now - C->usNext) >= 0)
+        {
+            bitmap |= (1U << ch);
+            C->usNext += C->usPeriod;
+            if ((SINT32)(now - C->usNext) >= 0)
+            {
+                C->usNext = now + C->usPeriod;
+            }
+        }
+    }
+
+    if (policy == TLM_TX_DROP)
+    {
+        if (bitmap && !sendData(bitmap))
+        {
+            dropped++;
+        }
+        return;
+    }
+
+    //coalesce, a frame due while one is held is merged into it
+    if (bitmap && pending)
+    {
+        coalesced++;
+    }
+    bitmap |= pending;
+
+    //wait for room rather than building a frame that can not be queued
+    if (bitmap)
+    {
+        pending = (tx.getFree() >= dataSize(bitmap) && sendData(bitmap)) ? 0 : bitmap;
+    }
+}
+
+/**
+ * @return - size in bytes of a data frame with a set of channels
+ */
+UINT16 cTelemetryBase::dataSize(UINT16 bitmap)
+{
+    UINT16 size = TLM_HEADER_SIZE + 2 + TLM_CRC_SIZE;
+
+    bitmap &= (chanCnt < 16) ? (1U << chanCnt) - 1 : 0xFFFF;
+    for (; bitmap; bitmap >>= 1)
+    {
+        size += (bitmap & 1) ? 4 : 0;
+    }
+    return(size);
+}
+
+/**
+ * Send a data frame with the current values of a set of channels. Not counted as dropped if there is no room.
+ *
+ * @param bitmap - bit N set to send channel N
+ * @return - false if the frame did not fit in the TX ring buffer
+ */
+bool cTelemetryBase::sendData(UINT16 bitmap)
+{
+    UINT8 field[4];
+    UINT8 ch;
+
+    bitmap &= (chanCnt < 16) ? (1U << chanCnt) - 1 : 0xFFFF;
+    if (!frameBegin(TLM_FRAME_DATA, (UINT8)(dataSize(bitmap) - TLM_HEADER_SIZE - TLM_CRC_SIZE)))
+    {
+        return(false);
+    }
+
+    //the values are written to the ring as they are read
+    putU16(field, bitmap);
+    frameAppend(field, 2);
+    for (ch = 0; ch < chanCnt; ch++)
+    {
+        if (bitmap & (1U << ch))
+        {
+            putU32(field, (UINT32)getValue(&channels[ch]));
+            frameAppend(field, 4);
+        }
+    }
+    frameEnd();
+    return(true);
+}
+
+/**
+ * Build and send a frame, counted as dropped if it does not fit in the TX ring buffer (check getTxFree first to wait for room)
+ *
+ * @param type    - frame type
+ * @param payload - payload bytes, up to TLM_MAX_PAYLOAD
+ * @param len     - payload length
+ * @return - false if the frame was dropped
+ */
+bool cTelemetryBase::sendFrame(TLM_FRAME_TYPE type, const UINT8 *payload, UINT8 len)
+{
+    if (len > TLM_MAX_PAYLOAD || !putFrame(type, payload, len))
+    {
+        dropped++;
+        return(false);
+    }
+    return(true);
+}
+
+/**
+ * Send the scheduler profile (ACQ_PROFILE): a frame per rate with its latency histograms and overruns, then the sensor
+ * readSensor cycle counts. The frames are sent by "run" as the TX ring buffer has room, never waiting. A profile being
+ * sent is restarted.
+ *
+ * @return - false if profiling is compiled out (ACQ_PROFILE not defined)
+ */
+bool cTelemetryBase::sendProfile()
+{
+#ifdef ACQ_PROFILE
+    profNext = 0;
+    return(true);
+#else
+    return(false);
+#endif
+}
+
+#ifdef ACQ_PROFILE
+/**
+ * send the next profile frame if there is room for it
+ *
+ * @return - false if there was no room, the frame is sent on a later call
+ */
+bool cTelemetryBase::sendProfileFrame()
+{
+    UINT8  payload[TLM_MAX_PAYLOAD];
+    const ACQ_PROF *P;
+    UINT32 period;
+    UINT8  rates = cAcquire::getRateCount(), sensors = cAcquire::getSensorCount();
+    UINT8  len, b, i, first, n;
+
+    if (profNext < rates)
+    {
+        len = 9 + 4 * ACQ_HIST_BUCKETS;
+        if (tx.getFree() < TLM_HEADER_SIZE + len + TLM_CRC_SIZE)
+        {
+            return(false);
+        }
+
+        P = cAcquire::getProfile(profNext, &period);
+        putU32(payload, period);
+        putU32(payload + 4, P->overruns);
+        payload[8] = ACQ_HIST_BUCKETS;
+        for (b = 0; b < ACQ_HIST_BUCKETS; b++)
+        {
+            putU16(payload + 9 + 2 * b, P->hist[ACQ_HIST_SLICE][b]);
+            putU16(payload + 9 + 2 * (ACQ_HIST_BUCKETS + b), P->hist[ACQ_HIST_JITTER][b]);
+        }
+        putFrame(TLM_FRAME_PROF_RATE, payload, len);
+
+        profNext = (profNext + 1 < rates || sensors) ? profNext + 1 : TLM_PROF_IDLE;
+        return(true);
+    }
+
+    first = (profNext - rates) * TLM_PROF_SENSORS;
+    n     = first < sensors ? sensors - first : 0;
+    n     = n < TLM_PROF_SENSORS ? n : TLM_PROF_SENSORS;
+    len   = 2 + 8 * n;
+    if (n && tx.getFree() < TLM_HEADER_SIZE + len + TLM_CRC_SIZE)
+    {
+        return(false);
+    }
+
+    if (n)
+    {
+        payload[0] = first;
+        payload[1] = n;
+        for (i = 0; i < n; i++)
+        {
+            putU32(payload + 2 + 8 * i, cAcquire::getSensorCycles((UINT8)(first + i), false));
+            putU32(payload + 6 + 8 * i, cAcquire::getSensorCycles((UINT8)(first + i), true));
+        }
+        putFrame(TLM_FRAME_PROF_SENSOR, payload, len);
+    }
+
+    profNext = (first + n < sensors) ? profNext + 1 : TLM_PROF_IDLE;
+    return(true);
+}
+#endif
+
+/**
+ * queue a frame with a payload (frameBegin, frameAppend, frameEnd)
+ */
+bool cTelemetryBase::putFrame(TLM_FRAME_TYPE type, const UINT8 *payload, UINT8 len)
+{
+    if (!frameBegin(type, len))
+    {
+        return(false);
+    }
+    frameAppend(payload, len);
+    frameEnd();
+    return(true);
+}
+
+/**
+ * Start a frame in the TX ring: the header with the next sequence number, timestamped now. The payload is written with
+ * frameAppend (exactly "len" bytes) and the frame closed by frameEnd, room for the whole frame is checked here so the
+ * frame is queued whole or not at all. The sequence number is used up even if the frame does not fit, so that the
+ * receiver sees the gap.
+ *
+ * @param type - frame type
+ * @param len  - payload length
+ * @return - false if the frame does not fit, nothing is queued
+ */
+bool cTelemetryBase::frameBegin(TLM_FRAME_TYPE type, UINT8 len)
+{
+    UINT8 header[TLM_HEADER_SIZE];
+
+    header[0] = TLM_SYNC0;
+    header[1] = TLM_SYNC1;
+    header[2] = (UINT8)type;
+    header[3] = len;
+    putU16(&header[4], seq++);
+    putU32(&header[6], micros());
+
+    if (tx.getFree() < TLM_HEADER_SIZE + len + TLM_CRC_SIZE)
+    {
+        return(false);
+    }
+    tx.put(header, TLM_HEADER_SIZE);
+    crc = crc16(&header[2], TLM_HEADER_SIZE - 2, 0xFFFF);
+    return(true);
+}
+
+/**
+ * write payload bytes of the frame started by frameBegin, added to the CRC
+ */
+void cTelemetryBase::frameAppend(const UINT8 *data, UINT8 len)
+{
+    tx.put(data, len);
+    crc = crc16(data, len, crc);
+}
+
+/**
+ * close the frame, the CRC of type through payload
+ */
+void cTelemetryBase::frameEnd()
+{
+    UINT8 field[TLM_CRC_SIZE];
+
+    putU16(field, crc);
+    tx.put(field, TLM_CRC_SIZE);
+    sent++;
+}
+
+/**
+ * @return - free space in the TX ring buffer in bytes (frame size is payload + TLM_HEADER_SIZE + TLM_CRC_SIZE)
+ */
+UINT16 cTelemetryBase::getTxFree()
+{
+    return(tx.getFree());
+}
+
+/**
+ * @return - sequence number of the next frame
+ */
+UINT16 cTelemetryBase::getSeq()
+{
+    return(seq);
+}
+
+/**
+ * diagnostic counters, frames queued, dropped and coalesced since the last reset
+ */
+UINT32 cTelemetryBase::getSent()
+{
+    return(sent);
+}
+
+UINT32 cTelemetryBase::getDropped()
+{
+    return(dropped);
+}
+
+UINT32 cTelemetryBase::getCoalesced()
+{
+    return(coalesced);
+}
+
+void cTelemetryBase::resetCounters()
+{
+    sent      = 0;
+    dropped   = 0;
+    coalesced = 0;
+}
+
+/**
+ * CRC-16/CCITT (poly 0x1021), bitwise to keep it out of flash tables
+ *
+ * @param crc - initial value (0xFFFF), or the CRC so far to continue
+ */
+UINT16 cTelemetryBase::crc16(const UINT8 *data, UINT16 len, UINT16 crc)
+{
+    UINT8 bit;
+
+    while (len--)
+    {
+        crc ^= (UINT16)(*data++) << 8;
+        for (bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+    }
+    return(crc);
+}
+
+/**
+ * little endian field writers
+ */
+void cTelemetryBase::putU16(UINT8 *buf, UINT16 value)
+{
+    buf[0] = (UINT8)value;
+    buf[1] = (UINT8)(value >> 8);
+}
+
+void cTelemetryBase::putU32(UINT8 *buf, UINT32 value)
+{
+    buf[0] = (UINT8)value;
+    buf[1] = (UINT8)(value >> 8);
+    buf[2] = (UINT8)(value >> 16);
+    buf[3] = (UINT8)(value >> 24);
+}
@@ -0,0 +1,240 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+#include "typedef.h"
+#include "sensor.h"
+
+/**
+ * Binary telemetry frame format (all multi byte fields little endian):
+ *
+ *    offset  size  field
+ *    0       2     sync word, TLM_SYNC0 TLM_SYNC1
+ *    2       1     frame type (TLM_FRAME_TYPE)
+ *    3       1     payload length in bytes
+ *    4       2     sequence number, per port, advanced for every frame sent
+ *    6       4     timestamp, micros() when the frame was built
+ *    10      n     payload
+ *    10+n    2     CRC-16/CCITT (poly 0x1021, init 0xFFFF) of bytes 2 to 9+n (type through payload)
+ *
+ * Data frame payload: channel bitmap (UINT16, bit N = channel N present) followed by one Q16.16 value (SINT32) for each
+ * channel present, in channel order.
+ *
+ * Scheduler profile (ACQ_PROFILE, see acquisition.h), sent on request by "sendProfile": one TLM_FRAME_PROF_RATE frame per
+ * rate, fastest first
+ *    UINT32 period (uSecs), UINT32 overruns, UINT8 buckets, UINT16 time slice histogram[buckets],
+ *    UINT16 start jitter histogram[buckets]
+ * followed by TLM_FRAME_PROF_SENSOR frames, up to TLM_PROF_SENSORS sensors each
+ *    UINT8 first sensor (creation order), UINT8 sensors, per sensor: UINT32 last readSensor cycles, UINT32 max cycles
+ */
+#define TLM_SYNC0         0xA5
+#define TLM_SYNC1         0x5A
+#define TLM_HEADER_SIZE   10
+#define TLM_CRC_SIZE      2
+
+/**
+ * max number of telemetry channels of a port, bound by the bitmap width (the port is sized by cTelemetry<Channels>)
+ */
+#define TLM_MAX_CHANNELS  16
+
+/**
+ * max payload, a data frame with all channels (frames are streamed into the TX ring, only the decoder buffers a whole one)
+ */
+#define TLM_MAX_PAYLOAD   (2 + 4 * TLM_MAX_CHANNELS)
+#define TLM_MAX_FRAME     (TLM_HEADER_SIZE + TLM_MAX_PAYLOAD + TLM_CRC_SIZE)
+
+/**
+ * number of sensors in a profile sensor frame
+ */
+#define TLM_PROF_SENSORS  ((TLM_MAX_PAYLOAD - 2) / 8)
+#define TLM_PROF_IDLE     0xFF
+
+/**
+ * size of the telemetry TX ring buffer in bytes, must be a power of 2
+ */
+#ifndef TLM_TX_SIZE
+#define TLM_TX_SIZE       128
+#endif
+
+/**
+ * default baud rate for binary telemetry, exact divisor on a 16MHz AVR
+ */
+#define TLM_BAUD          250000
+
+/**
+ * frame types
+ */
+enum TLM_FRAME_TYPE
+{
+  TLM_FRAME_DATA        = 0x01,
+  TLM_FRAME_CAP_INFO    = 0x02,   //burst capture header (see capture.h)
+  TLM_FRAME_CAP_DATA    = 0x03,   //burst capture records
+  TLM_FRAME_PROF_RATE   = 0x04,   //scheduler profile of a rate (ACQ_PROFILE)
+  TLM_FRAME_PROF_SENSOR = 0x05    //readSensor cycle counts (ACQ_PROFILE)
+};
+
+/**
+ * what to do with a data frame that does not fit in the TX ring buffer (link slower than the telemetry rate)
+ */
+enum TLM_TX_POLICY
+{
+  TLM_TX_DROP,      //drop the frame
+  TLM_TX_COALESCE   //merge its channels into the next frame, which is sent with the latest values when there is room
+};
+
+/**
+ * value sent for a telemetry channel
+ */
+enum TLM_SOURCE
+{
+  TLM_READING,      //sensor last sample
+  TLM_AVG,          //sensor moving average
+  TLM_DERIVATIVE,   //sensor derivative
+  TLM_INTEGRAL,     //sensor integral
+  TLM_MAX,          //sensor windowed max
+  TLM_MIN,          //sensor windowed min
+  TLM_Q16_VAR,      //Q16.16 variable
+  TLM_FLOAT_VAR     //float variable, converted to Q16.16
+};
+
+/**
+ * telemetry channel definition, a value source and the rate it is sent at
+ */
+struct TLM_CHANNEL
+{
+  cSensorBase *sensor;
+  const void  *var;
+  TLM_SOURCE   source;
+  /**
+   * period (uSecs) the channel is sent at (0 = off), deadline of the next send
+   */
+  UINT32       usPeriod, usNext;
+};
+
+
+/**
+ * TX ring buffer for telemetry frames. Frames are queued whole (or not at all) without ever waiting, "service" moves as many
+ * bytes as the serial TX buffer has room for into the serial port, which is drained by the UART interrupt. The acquisition
+ * loop therefore never blocks on the serial port.
+ */
+class cTxRing
+{
+private:
+  UINT8  buf[TLM_TX_SIZE];
+  /**
+   * free running byte counters, write position and send position (masked on access)
+   */
+  UINT16 head, tail;
+
+public:
+  cTxRing();
+  bool   put(const UINT8 *data, UINT16 len);
+  void   service();
+  UINT16 getUsed();
+  UINT16 getFree();
+};
+
+
+/**
+ * Binary telemetry. Channels (sensor values or sketch variables) are registered with a rate each, the "run" method
+ * (called from loop) sends a data frame with the values of all channels that are due, marked in the channel bitmap.
+ * Values are sent as Q16.16 fixed point, sensor values through the integer (Q16) getters.
+ * Frames are decoded on the PC by the host decoder (host/tlmdecode), which can also print the serial plotter text.
+ * Frames are queued in a TX ring buffer (cTxRing), a frame that does not fit is dropped or coalesced (TLM_TX_POLICY) and
+ * counted, sending never waits on the serial port. Every frame built gets a sequence number, so the receiver sees the
+ * dropped frames as gaps. Frames are written straight into the ring (the CRC computed on the way), there is no frame buffer.
+ *
+ * @see cTelemetry, cSensorBase
+ * @author DJK
+ * @version 0.1
+ */
+class cTelemetryBase
+{
+private:
+  /**
+   * channel table, owned by the derived class, its size and the number of channels added
+   */
+  TLM_CHANNEL *channels;
+  UINT8       maxChannels, chanCnt;
+  UINT16      seq;
+  /**
+   * CRC of the frame being written
+   */
+  UINT16      crc;
+  /**
+   * TX ring buffer, full buffer policy, channels of coalesced frames waiting to be sent
+   */
+  cTxRing       tx;
+  TLM_TX_POLICY policy;
+  UINT16        pending;
+  /**
+   * frames queued, dropped (TLM_TX_DROP) and merged into a later frame (TLM_TX_COALESCE)
+   */
+  UINT32        sent, dropped, coalesced;
+#ifdef ACQ_PROFILE
+  /**
+   * profile being sent, next frame (rates first, then sensors), TLM_PROF_IDLE if none
+   */
+  UINT8         profNext;
+#endif
+
+  UINT8  addChannel(cSensorBase *S, const void *var, TLM_SOURCE source, ACQ_RATE rate);
+  Q16    getValue(TLM_CHANNEL *C);
+  UINT16 dataSize(UINT16 bitmap);
+  bool   putFrame(TLM_FRAME_TYPE type, const UINT8 *payload, UINT8 len);
+  bool   frameBegin(TLM_FRAME_TYPE type, UINT8 len);
+  void   frameAppend(const UINT8 *data, UINT8 len);
+  void   frameEnd();
+#ifdef ACQ_PROFILE
+  bool   sendProfileFrame();
+#endif
+
+protected:
+  cTelemetryBase(TLM_CHANNEL *storage, UINT8 maxChan);
+
+public:
+  UINT8  addSensor(cSensorBase *S, TLM_SOURCE source, ACQ_RATE rate);
+  UINT8  addValue(const Q16 *var, ACQ_RATE rate);
+  UINT8  addValue(const float *var, ACQ_RATE rate);
+  void   setRate(UINT8 ch, ACQ_RATE rate);
+  void   setPolicy(TLM_TX_POLICY txPolicy);
+  void   run();
+  bool   sendData(UINT16 bitmap);
+  bool   sendFrame(TLM_FRAME_TYPE type, const UINT8 *payload, UINT8 len);
+  bool   sendProfile();
+  UINT16 getTxFree();
+  UINT16 getSeq();
+  UINT32 getSent();
+  UINT32 getDropped();
+  UINT32 getCoalesced();
+  void   resetCounters();
+
+  static UINT16 crc16(const UINT8 *data, UINT16 len, UINT16 crc);
+  static void   putU16(UINT8 *buf, UINT16 value);
+  static void   putU32(UINT8 *buf, UINT32 value);
+};
+
+
+/**
+ * telemetry channel table sized at compile time
+ */
+template <UINT8 Channels>
+struct TLM_STORAGE
+{
+  static_assert(Channels >= 1 && Channels <= TLM_MAX_CHANNELS, "1 to TLM_MAX_CHANNELS telemetry channels");
+
+  TLM_CHANNEL tlmChannels[Channels];
+};
+
+/**
+ * Telemetry port with room for a number of channels set at compile time, this is the class created by the sketch.
+ *
+ * @param Channels - max number of channels, up to TLM_MAX_CHANNELS
+ * @see cTelemetryBase
+ */
+template <UINT8 Channels>
+class cTelemetry : private TLM_STORAGE<Channels>, public cTelemetryBase
+{
+public:
+  cTelemetry() : cTelemetryBase(this->tlmChannels, Channels) {}
+};
+
+#endif
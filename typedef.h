@@ -2,13 +2,26 @@
 #ifndef TYPEDEF_H
 #define TYPEDEF_H
 
-#if  ARDUINO >= 100
+#if defined(HOST_BUILD)
+//native (linux) build against the simulated HAL, see host/
+#include "simhal.h"
+#elif  ARDUINO >= 100
 //WProgram renamed to Arduino.h. in new IDE 1.5.2
 #include "Arduino.h"
 #else
 #include "WProgram.h"
 #endif
 
+#if defined(HOST_BUILD)
+//fixed widths on the host so the integer math matches the 8/16 bit target
+typedef uint16_t           UINT16;
+typedef int16_t            SINT16;
+typedef uint8_t            UINT8;
+typedef int32_t            SINT32;
+typedef uint32_t           UINT32;
+typedef int64_t            SINT64;
+typedef uint64_t           UINT64;
+#else
 typedef unsigned int       UINT16;
 typedef signed int         SINT16;
 typedef unsigned char      UINT8;
@@ -17,6 +30,14 @@ typedef signed long        SINT32;
 typedef unsigned long      UINT32;
 typedef signed long long   SINT64;
 typedef unsigned long long UINT64;
+#endif
+
+//2KB RAM parts (UNO): the library tables and the sketch are sized down to fit, see README (RAM)
+#if defined(RAMEND) && RAMEND < 0x1000
+#define SMALL_RAM 1
+#else
+#define SMALL_RAM 0
+#endif
 
 #endif
 